@@ -1,8 +1,21 @@
 #pragma once
 #include <cstddef>
+#include <cstdint>
 namespace lizard::assets {
 extern const unsigned char lizard_regular_png[];
 extern const unsigned int lizard_regular_png_len;
+#if defined(LIZARD_EMBEDDED_PCM_F32) || defined(LIZARD_EMBEDDED_PCM_S16)
+// The default sound decoded at build time (LIZARD_EMBED_SOUND), interleaved.
+#if defined(LIZARD_EMBEDDED_PCM_F32)
+extern const float lizard_processed_clean_no_meta_pcm[];
+#else
+extern const std::int16_t lizard_processed_clean_no_meta_pcm[];
+#endif
+extern const unsigned int lizard_processed_clean_no_meta_pcm_frames;
+extern const unsigned int lizard_processed_clean_no_meta_pcm_channels;
+extern const unsigned int lizard_processed_clean_no_meta_pcm_sample_rate;
+#else
 extern const unsigned char lizard_processed_clean_no_meta_flac[];
 extern const unsigned int lizard_processed_clean_no_meta_flac_len;
+#endif
 } // namespace lizard::assets
@@ -0,0 +1,72 @@
+// Build-time helper: decodes a FLAC file to raw little-endian PCM for
+// embed_resource.cmake's f32/s16 modes.
+//
+//   flac_to_pcm <input.flac> <f32|s16> <output.raw> <output.meta>
+//
+// The meta file holds "channels;rate;frames" as a CMake list.
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#define DR_FLAC_IMPLEMENTATION
+#include "dr_flac.h"
+
+namespace {
+
+template <typename T> void write_le(std::ofstream &out, const std::vector<T> &samples) {
+  for (T sample : samples) {
+    std::uint32_t bits = 0;
+    std::memcpy(&bits, &sample, sizeof(T));
+    for (std::size_t i = 0; i < sizeof(T); ++i) {
+      out.put(static_cast<char>((bits >> (8 * i)) & 0xff));
+    }
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc != 5) {
+    std::fprintf(stderr, "usage: flac_to_pcm <input.flac> <f32|s16> <output.raw> <output.meta>\n");
+    return 2;
+  }
+  bool s16 = std::strcmp(argv[2], "s16") == 0;
+  if (!s16 && std::strcmp(argv[2], "f32") != 0) {
+    std::fprintf(stderr, "flac_to_pcm: unknown format '%s'\n", argv[2]);
+    return 2;
+  }
+  drflac *flac = drflac_open_file(argv[1], nullptr);
+  if (flac == nullptr) {
+    std::fprintf(stderr, "flac_to_pcm: cannot decode %s\n", argv[1]);
+    return 1;
+  }
+  std::uint64_t frames = flac->totalPCMFrameCount;
+  std::uint32_t channels = flac->channels;
+  std::uint32_t rate = flac->sampleRate;
+
+  std::ofstream raw(argv[3], std::ios::binary);
+  if (s16) {
+    std::vector<std::int16_t> samples(frames * channels);
+    frames = drflac_read_pcm_frames_s16(flac, frames, samples.data());
+    samples.resize(frames * channels);
+    write_le(raw, samples);
+  } else {
+    std::vector<float> samples(frames * channels);
+    frames = drflac_read_pcm_frames_f32(flac, frames, samples.data());
+    samples.resize(frames * channels);
+    write_le(raw, samples);
+  }
+  drflac_close(flac);
+
+  std::ofstream meta(argv[4]);
+  meta << channels << ';' << rate << ';' << frames << '\n';
+  raw.close();
+  meta.close();
+  if (!raw || !meta) {
+    std::fprintf(stderr, "flac_to_pcm: failed to write output\n");
+    return 1;
+  }
+  return 0;
+}
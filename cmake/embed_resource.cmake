@@ -1,4 +1,38 @@
+# Embeds INPUT as a C++ array named VAR in OUTPUT.
+#
+# MODE=bytes (default) embeds the file as is. MODE=f32 or MODE=s16 embeds raw
+# little-endian PCM written by flac_to_pcm, aligned for SIMD loads, along with
+# the frame count, channel count and rate read from META ("channels;rate;frames").
+if(NOT DEFINED MODE)
+  set(MODE bytes)
+endif()
+
 file(READ "${INPUT}" data HEX)
 string(REGEX REPLACE "\n" "" data "${data}")
-string(REGEX REPLACE "(..)" "0x\\1," data "${data}")
-file(WRITE "${OUTPUT}" "#include <cstddef>\nnamespace lizard::assets {\nconst unsigned char ${VAR}[] = {${data}};\nconst unsigned int ${VAR}_len = sizeof(${VAR});\n}\n")
+
+if(MODE STREQUAL "bytes")
+  string(REGEX REPLACE "(..)" "0x\\1," data "${data}")
+  file(WRITE "${OUTPUT}" "#include \"embedded.h\"\nnamespace lizard::assets {\nconst unsigned char ${VAR}[] = {${data}};\nconst unsigned int ${VAR}_len = sizeof(${VAR});\n}\n")
+  return()
+endif()
+
+file(READ "${META}" meta)
+string(STRIP "${meta}" meta)
+list(GET meta 0 channels)
+list(GET meta 1 rate)
+list(GET meta 2 frames)
+
+if(MODE STREQUAL "f32")
+  # Bit patterns rather than decimal literals, so the samples round-trip exactly.
+  string(REGEX REPLACE "(..)(..)(..)(..)" "F(0x\\4\\3\\2\\1)," data "${data}")
+  set(type "float")
+  set(prelude "#include <bit>\n#define F(bits) std::bit_cast<float>(std::uint32_t{bits##u})\n")
+elseif(MODE STREQUAL "s16")
+  string(REGEX REPLACE "(..)(..)" "S(0x\\2\\1)," data "${data}")
+  set(type "std::int16_t")
+  set(prelude "#define S(bits) static_cast<std::int16_t>(std::uint16_t{bits##u})\n")
+else()
+  message(FATAL_ERROR "embed_resource: unknown MODE '${MODE}'")
+endif()
+
+file(WRITE "${OUTPUT}" "#include <cstdint>\n#include \"embedded.h\"\n${prelude}namespace lizard::assets {\nalignas(16) const ${type} ${VAR}[] = {${data}};\nconst unsigned int ${VAR}_frames = ${frames};\nconst unsigned int ${VAR}_channels = ${channels};\nconst unsigned int ${VAR}_sample_rate = ${rate};\n}\n")
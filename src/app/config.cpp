@@ -3,16 +3,30 @@
 #include <algorithm>
 #include <cstdlib>
 #include <fstream>
+#include <iterator>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <variant>
 
 #include <nlohmann/json.hpp>
 #include <spdlog/spdlog.h>
 
 #include "util/log.h"
+#include "util/trace.h"
 
 using json = nlohmann::json;
 
 namespace lizard::app {
 
+namespace {
+
+// Editors often save in several steps (truncate, write, rename, chmod);
+// reload once they have settled.
+constexpr std::chrono::milliseconds kReloadDebounce{50};
+
+} // namespace
+
 Config::Config(std::filesystem::path executable_dir, std::optional<std::filesystem::path> cli_path,
                std::chrono::milliseconds interval)
     : interval_(interval) {
@@ -28,44 +42,44 @@ Config::Config(std::filesystem::path executable_dir, std::optional<std::filesyst
   }
 
   {
-    std::unique_lock lock(mutex_);
+    std::unique_lock lock(load_mutex_);
     load(lock);
     if (std::filesystem::exists(config_path_)) {
       last_write_ = std::filesystem::last_write_time(config_path_);
     }
   }
 
-  watcher_ = std::jthread([this](std::stop_token st) {
-    std::unique_lock lk(cv_mutex_);
-    while (!st.stop_requested()) {
-      cv_.wait_for(lk, interval_, [&] { return st.stop_requested(); });
-      if (st.stop_requested()) {
-        break;
-      }
-      lk.unlock();
-      std::unique_lock lock(mutex_);
-      if (!std::filesystem::exists(config_path_)) {
-        lk.lock();
-        continue;
-      }
-      auto current = std::filesystem::last_write_time(config_path_);
-      if (current != last_write_) {
-        last_write_ = current;
-        load(lock);
-        reload_cv_.notify_all();
-      }
-      lk.lock();
-    }
-  });
+  watcher_ = std::make_unique<FileWatcher>(
+      config_path_, [this] { on_file_changed(); }, kReloadDebounce, interval_);
+  // Catch a save that landed between the first load and the watch starting.
+  on_file_changed();
 }
 
 Config::~Config() {
-  watcher_.request_stop();
-  cv_.notify_all();
+  // Stop the watcher before the values its callback reloads go away.
+  watcher_.reset();
+}
+
+// Runs on the watcher thread.
+void Config::on_file_changed() {
+  std::error_code ec;
+  auto current = std::filesystem::last_write_time(config_path_, ec);
+  if (ec) {
+    return; // removed or mid-replace; keep the current settings
+  }
+  {
+    std::unique_lock lock(load_mutex_);
+    if (current == last_write_) {
+      return;
+    }
+    last_write_ = current;
+    load(lock);
+  }
+  reload_cv_.notify_all();
 }
 
 void Config::reload() {
-  std::unique_lock lock(mutex_);
+  std::unique_lock lock(load_mutex_);
   load(lock);
   if (std::filesystem::exists(config_path_)) {
     last_write_ = std::filesystem::last_write_time(config_path_);
@@ -93,260 +107,840 @@ std::filesystem::path Config::user_config_path() {
   return {};
 }
 
-void Config::load(std::unique_lock<std::shared_mutex> &lock) {
-  (void)lock; // lock is held by caller
-  logging_path_ = config_path_.parent_path() / "lizard.log";
-  sound_cooldown_ms_ = 0;
-  std::ifstream in(config_path_);
-  if (!in.is_open()) {
+std::filesystem::path Config::user_cache_dir() {
+#ifdef _WIN32
+  if (auto *local = std::getenv("LOCALAPPDATA")) {
+    return std::filesystem::path(local) / "LizardHook" / "cache";
+  }
+#elif __APPLE__
+  if (auto *home = std::getenv("HOME")) {
+    return std::filesystem::path(home) / "Library" / "Caches" / "LizardHook";
+  }
+#else
+  if (auto *xdg = std::getenv("XDG_CACHE_HOME")) {
+    return std::filesystem::path(xdg) / "lizard_hook";
+  }
+  if (auto *home = std::getenv("HOME")) {
+    return std::filesystem::path(home) / ".cache" / "lizard_hook";
+  }
+#endif
+  return {};
+}
+
+void Config::load(std::unique_lock<std::mutex> &lock) {
+  (void)lock; // load_mutex_ is held by caller
+  LIZARD_TRACE_ZONE("app::Config::load");
+  Values next;
+  {
+    std::shared_lock read(mutex_);
+    next = *values_;
+  }
+  next.logging_path = config_path_.parent_path() / "lizard.log";
+  next.sound_cooldown_ms = 0;
+
+  std::error_code ec;
+  auto mtime = std::filesystem::last_write_time(config_path_, ec);
+  std::ifstream in(config_path_, std::ios::binary);
+  if (in.is_open()) {
+    std::string text{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+    std::uint64_t key = cache_key(text, ec ? 0 : mtime.time_since_epoch().count());
+    Values parsed;
+    parsed.logging_path = next.logging_path;
+    if (read_cache(key, parsed)) {
+      next = std::move(parsed);
+    } else if (parse(text, parsed)) {
+      write_cache(key, parsed);
+      next = std::move(parsed);
+    }
+  } else {
     spdlog::warn("Could not open config file: {}", config_path_.string());
-    lizard::util::init_logging(logging_level_, logging_queue_size_, logging_worker_count_,
-                               logging_path_);
-    return;
   }
 
-  try {
-    json j;
-    in >> j;
+  next.keys = KeyTable(next.key_rules);
+  next.hotkey_table = HotkeyTable(next.hotkeys);
 
-    enabled_ = j.value("enabled", true);
-    mute_ = j.value("mute", false);
+  // Readers are only held off for the pointer swap; the old values are freed
+  // after the lock is released.
+  auto current = std::make_shared<const Values>(std::move(next));
+  std::shared_ptr<const Values> retired;
+  {
+    std::unique_lock write(mutex_);
+    retired = std::exchange(values_, current);
+  }
+  lizard::util::init_logging(current->logging_level, current->logging_queue_size,
+                             current->logging_worker_count, current->logging_path,
+                             current->logging_overflow);
+}
 
-    auto clamp_nonneg = [](int value, const char *name) {
-      if (value < 0) {
-        spdlog::warn("{} negative ({}); clamping to 0", name, value);
-        return 0;
-      }
-      return value;
-    };
+// Streams the document straight into Values without building a DOM. Each
+// known top-level key maps to a member; unknown keys are skipped whatever
+// their shape. A value of the wrong type fails the whole parse, as
+// json::value() would. Range checks are left to validate().
+class Config::Sax final : public nlohmann::json_sax<json> {
+public:
+  explicit Sax(Values &out) : out_(out) {}
+
+  bool weighted_seen() const { return weighted_seen_; }
+  const std::string &error() const { return error_; }
+
+  bool null() override { return slot() == Slot::ignored || mismatch("null"); }
+  bool binary(binary_t &) override { return slot() == Slot::ignored || mismatch("binary"); }
+
+  bool boolean(bool value) override {
+    Slot where = slot();
+    if (where == Slot::ignored) {
+      return true;
+    }
+    if (auto *member = std::get_if<bool Values::*>(&field_); member && where == Slot::top) {
+      out_.*(*member) = value;
+      return true;
+    }
+    if (where == Slot::rule_field && item_key_ == "suppress") {
+      rule_.suppress = value;
+      return true;
+    }
+    return mismatch("boolean");
+  }
+
+  bool number_integer(number_integer_t value) override {
+    return number(static_cast<double>(value), static_cast<int>(value));
+  }
+  bool number_unsigned(number_unsigned_t value) override {
+    return number(static_cast<double>(value), static_cast<int>(value));
+  }
+  bool number_float(number_float_t value, const string_t &) override {
+    return number(value, static_cast<int>(value));
+  }
 
-    if (j.contains("sound_cooldown_ms")) {
-      int requested = clamp_nonneg(j.value("sound_cooldown_ms", 0), "sound_cooldown_ms");
-      if (requested > 0) {
-        spdlog::warn(
-            "sound_cooldown_ms is deprecated and ignored; bursts are limited by max_concurrent_playbacks");
-      }
-    }
-    max_concurrent_playbacks_ =
-        clamp_nonneg(j.value("max_concurrent_playbacks", 16), "max_concurrent_playbacks");
-    badges_per_second_max_ =
-        clamp_nonneg(j.value("badges_per_second_max", 12), "badges_per_second_max");
-    badge_min_px_ = clamp_nonneg(j.value("badge_min_px", 60), "badge_min_px");
-    badge_max_px_ = clamp_nonneg(j.value("badge_max_px", 108), "badge_max_px");
-    if (badge_max_px_ < badge_min_px_) {
-      spdlog::warn("badge_max_px ({}) less than badge_min_px ({}); clamping to {}", badge_max_px_,
-                   badge_min_px_, badge_min_px_);
-      badge_max_px_ = badge_min_px_;
-    }
-    fullscreen_pause_ = j.value("fullscreen_pause", true);
-    exclude_processes_ = j.value("exclude_processes", std::vector<std::string>{});
-    ignore_injected_ = j.value("ignore_injected", true);
-    audio_backend_ = j.value("audio_backend", std::string("miniaudio"));
-    auto strategy_in = j.value("badge_spawn_strategy", std::string("random_screen"));
-    if (strategy_in != "random_screen" && strategy_in != "near_caret") {
-      spdlog::warn("Unknown badge_spawn_strategy ({}); defaulting to random_screen", strategy_in);
-      strategy_in = "random_screen";
-    }
-    badge_spawn_strategy_ = std::move(strategy_in);
-    fps_mode_ = j.value("fps_mode", std::string("auto"));
-    fps_fixed_ = clamp_nonneg(j.value("fps_fixed", 60), "fps_fixed");
-    if (fps_fixed_ <= 0) {
-      spdlog::warn("fps_fixed non-positive ({}); using 60", fps_fixed_);
-      fps_fixed_ = 60;
-    }
-
-    int volume_in = j.value("volume_percent", 65);
-    volume_percent_ = clamp_nonneg(volume_in, "volume_percent");
-    if (volume_percent_ > 100) {
-      spdlog::warn("volume_percent ({}) out of range; clamping to 100", volume_percent_);
-      volume_percent_ = 100;
-    }
-
-    dpi_scaling_mode_ = j.value("dpi_scaling_mode", std::string("per_monitor_v2"));
-    logging_level_ = j.value("logging_level", std::string("info"));
-    logging_queue_size_ = clamp_nonneg(j.value("logging_queue_size", 8192), "logging_queue_size");
-    logging_worker_count_ =
-        clamp_nonneg(j.value("logging_worker_count", 1), "logging_worker_count");
-    if (logging_worker_count_ == 0) {
-      spdlog::warn("logging_worker_count zero; clamping to 1");
-      logging_worker_count_ = 1;
-    }
-    logging_path_ = j.value("logging_path", logging_path_.string());
-
-    if (j.contains("sound_path")) {
-      auto path = std::filesystem::path(j.at("sound_path").get<std::string>());
-      if (path.empty()) {
-        sound_path_ = std::nullopt;
+  bool string(string_t &value) override {
+    switch (slot()) {
+    case Slot::ignored:
+      return true;
+    case Slot::top:
+      if (auto *member = std::get_if<std::string Values::*>(&field_)) {
+        out_.*(*member) = std::move(value);
+        return true;
+      }
+      if (auto *member = std::get_if<std::optional<std::filesystem::path> Values::*>(&field_)) {
+        out_.*(*member) = value.empty() ? std::nullopt
+                                        : std::optional<std::filesystem::path>(value);
+        return true;
+      }
+      if (auto *member = std::get_if<std::filesystem::path Values::*>(&field_)) {
+        out_.*(*member) = value;
+        return true;
+      }
+      if (auto *assign = std::get_if<EnumField>(&field_)) {
+        (*assign)(out_, key_, value);
+        return true;
+      }
+      break;
+    case Slot::list_item:
+      list_->push_back(std::move(value));
+      return true;
+    case Slot::hotkey_item:
+      bind(value);
+      return true;
+    case Slot::sample_item:
+      if (!value.empty()) {
+        samples_->push_back(SoundSample{value, 1.0});
+      }
+      return true;
+    case Slot::sample_path:
+      sample_.path = value;
+      sample_has_path_ = true;
+      return true;
+    case Slot::rule_field:
+      if (item_key_ == "sound") {
+        rule_.sound = value;
+        return true;
+      }
+      break;
+    case Slot::rule_entry:
+      if (item_key_ == "emoji") {
+        rule_.emoji.push_back(std::move(value));
+        return true;
+      }
+      if (auto key_class = from_string<KeyClass>(value)) {
+        rule_.classes.push_back(*key_class);
       } else {
-        if (!path.is_absolute()) {
-          path = config_path_.parent_path() / path;
-        }
-        sound_path_ = std::move(path);
+        spdlog::warn("key_rules: unknown key class ({}); ignoring it", value);
+      }
+      return true;
+    default:
+      break;
+    }
+    return mismatch("string");
+  }
+
+  bool start_object(std::size_t) override {
+    if (depth_ == 0 && skip_ == 0) {
+      ++depth_;
+      return true;
+    }
+    switch (slot()) {
+    case Slot::ignored:
+      ++skip_;
+      return true;
+    case Slot::top:
+      if (auto *member = std::get_if<std::unordered_map<std::string, double> Values::*>(&field_)) {
+        weighted_ = &(out_.*(*member));
+        weighted_->clear();
+        weighted_seen_ = true;
+        ++depth_;
+        return true;
+      }
+      if (auto *member = std::get_if<std::vector<Hotkey> Values::*>(&field_)) {
+        hotkeys_ = &(out_.*(*member));
+        ++depth_;
+        return true;
+      }
+      break;
+    case Slot::sample_item:
+      sample_ = SoundSample{};
+      sample_has_path_ = false;
+      item_key_.clear();
+      ++depth_;
+      return true;
+    case Slot::rule_item:
+      rule_ = KeyRule{};
+      item_key_.clear();
+      ++depth_;
+      return true;
+    default:
+      break;
+    }
+    return mismatch("object");
+  }
+
+  bool start_array(std::size_t) override {
+    if (depth_ == 0 && skip_ == 0) {
+      return fail("the root is not an object");
+    }
+    switch (slot()) {
+    case Slot::ignored:
+      ++skip_;
+      return true;
+    case Slot::top:
+      if (auto *member = std::get_if<std::vector<std::string> Values::*>(&field_)) {
+        list_ = &(out_.*(*member));
+        list_->clear();
+        ++depth_;
+        return true;
+      }
+      if (auto *member = std::get_if<std::vector<SoundSample> Values::*>(&field_)) {
+        samples_ = &(out_.*(*member));
+        samples_->clear();
+        ++depth_;
+        return true;
+      }
+      if (auto *member = std::get_if<std::vector<KeyRule> Values::*>(&field_)) {
+        rules_ = &(out_.*(*member));
+        rules_->clear();
+        ++depth_;
+        return true;
+      }
+      break;
+    case Slot::rule_field:
+      if (item_key_ == "keys" || item_key_ == "emoji") {
+        ++depth_;
+        return true;
       }
+      break;
+    default:
+      break;
+    }
+    return mismatch("array");
+  }
+
+  bool end_object() override { return end(); }
+  bool end_array() override { return end(); }
+
+  bool key(string_t &name) override {
+    if (skip_ > 0) {
+      return true;
+    }
+    if (depth_ == 1) {
+      field_ = lookup(name);
+      key_ = std::move(name);
+    } else if (depth_ == 2 && weighted_ != nullptr) {
+      weighted_key_ = std::move(name);
+    } else if (depth_ == 2 && hotkeys_ != nullptr) {
+      item_key_ = std::move(name);
+    } else if (depth_ == 3) {
+      item_key_ = std::move(name);
+    }
+    return true;
+  }
+
+  bool parse_error(std::size_t, const std::string &,
+                   const nlohmann::detail::exception &e) override {
+    return fail(e.what());
+  }
+
+private:
+  using EnumField = void (*)(Values &, std::string_view, std::string_view);
+  using Field =
+      std::variant<std::monostate, bool Values::*, int Values::*, double Values::*,
+                   std::string Values::*, std::vector<std::string> Values::*,
+                   std::optional<std::filesystem::path> Values::*, std::filesystem::path Values::*,
+                   std::unordered_map<std::string, double> Values::*,
+                   std::vector<SoundSample> Values::*, std::vector<KeyRule> Values::*,
+                   std::vector<Hotkey> Values::*, EnumField>;
+
+  // Spellings are resolved here, so nothing downstream compares strings. An
+  // unknown one keeps the default.
+  template <auto Member>
+  static void assign(Values &out, std::string_view key, std::string_view text) {
+    using E = std::remove_cvref_t<decltype(out.*Member)>;
+    if (auto value = from_string<E>(text)) {
+      out.*Member = *value;
     } else {
-      sound_path_ = std::nullopt;
+      spdlog::warn("Unknown {} ({}); defaulting to {}", key, text, to_string(E{}));
+      out.*Member = E{};
     }
+  }
 
-    if (j.contains("emoji_atlas")) {
-      auto path = std::filesystem::path(j.at("emoji_atlas").get<std::string>());
-      if (path.empty()) {
-        emoji_atlas_ = std::nullopt;
-      } else {
-        if (!path.is_absolute()) {
-          path = config_path_.parent_path() / path;
+  // Where the next value lands.
+  enum class Slot {
+    ignored,       // inside an unknown key
+    top,           // the value of a known top-level key
+    list_item,     // an element of a string array
+    sample_item,   // an element of sound_samples
+    sample_path,   // "path" in a sound_samples object
+    sample_weight, // "weight" in a sound_samples object
+    weighted_item, // a value in emoji_weighted
+    rule_item,     // an element of key_rules
+    rule_field,    // a known field of a key_rules object
+    rule_entry,    // an element of a key_rules object's "keys" or "emoji"
+    hotkey_item,   // a chord in hotkeys
+    invalid,
+  };
+
+  static Field lookup(const std::string &name) {
+    static const std::unordered_map<std::string, Field> fields = {
+        {"enabled", &Values::enabled},
+        {"mute", &Values::mute},
+        {"sound_cooldown_ms", &Values::sound_cooldown_ms},
+        {"max_concurrent_playbacks", &Values::max_concurrent_playbacks},
+        {"badges_per_second_max", &Values::badges_per_second_max},
+        {"badge_min_px", &Values::badge_min_px},
+        {"badge_max_px", &Values::badge_max_px},
+        {"emoji", &Values::emoji},
+        {"emoji_weighted", &Values::emoji_weighted},
+        {"emoji_pngs", &Values::emoji_pngs},
+        {"sound_path", &Values::sound_path},
+        {"sound_samples", &Values::sound_samples},
+        {"sound_pool_budget_mb", &Values::sound_pool_budget_mb},
+        {"sound_stream_threshold_mb", &Values::sound_stream_threshold_mb},
+        {"sound_pcm_format", &assign<&Values::sound_pcm_format>},
+        {"sound_coalesce_mode", &assign<&Values::sound_coalesce_mode>},
+        {"sound_coalesce_ms", &Values::sound_coalesce_ms},
+        {"sound_pitch_variation_cents", &Values::sound_pitch_variation_cents},
+        {"sound_gain_variation_db", &Values::sound_gain_variation_db},
+        {"emoji_atlas", &Values::emoji_atlas},
+        {"fullscreen_pause", &Values::fullscreen_pause},
+        {"exclude_processes", &Values::exclude_processes},
+        {"ignore_injected", &Values::ignore_injected},
+        {"audio_backend", &assign<&Values::audio_backend>},
+        {"audio_profile", &assign<&Values::audio_profile>},
+        {"badge_spawn_strategy", &assign<&Values::badge_spawn_strategy>},
+        {"fps_mode", &assign<&Values::fps_mode>},
+        {"fps_fixed", &Values::fps_fixed},
+        {"volume_percent", &Values::volume_percent},
+        {"dpi_scaling_mode", &assign<&Values::dpi_scaling_mode>},
+        {"logging_level", &Values::logging_level},
+        {"logging_queue_size", &Values::logging_queue_size},
+        {"logging_worker_count", &Values::logging_worker_count},
+        {"logging_overflow", &assign<&Values::logging_overflow>},
+        {"logging_path", &Values::logging_path},
+        {"key_rules", &Values::key_rules},
+        {"hotkeys", &Values::hotkeys},
+    };
+    auto it = fields.find(name);
+    return it == fields.end() ? Field{} : it->second;
+  }
+
+  static bool is_rule_field(std::string_view name) {
+    constexpr std::array<std::string_view, 5> kFields = {"keys", "suppress", "sound", "emoji",
+                                                         "badge_scale"};
+    return std::find(kFields.begin(), kFields.end(), name) != kFields.end();
+  }
+
+  Slot slot() const {
+    if (skip_ > 0) {
+      return Slot::ignored;
+    }
+    if (depth_ == 1) {
+      return field_.index() == 0 ? Slot::ignored : Slot::top;
+    }
+    if (depth_ == 2) {
+      if (list_ != nullptr) {
+        return Slot::list_item;
+      }
+      if (samples_ != nullptr) {
+        return Slot::sample_item;
+      }
+      if (weighted_ != nullptr) {
+        return Slot::weighted_item;
+      }
+      if (rules_ != nullptr) {
+        return Slot::rule_item;
+      }
+      if (hotkeys_ != nullptr) {
+        return Slot::hotkey_item;
+      }
+    }
+    if (rules_ != nullptr) {
+      if (depth_ == 3) {
+        return is_rule_field(item_key_) ? Slot::rule_field : Slot::ignored;
+      }
+      return depth_ == 4 ? Slot::rule_entry : Slot::invalid;
+    }
+    if (depth_ == 3) {
+      if (item_key_ == "path") {
+        return Slot::sample_path;
+      }
+      return item_key_ == "weight" ? Slot::sample_weight : Slot::ignored;
+    }
+    return Slot::invalid;
+  }
+
+  bool number(double value, int integer) {
+    switch (slot()) {
+    case Slot::ignored:
+      return true;
+    case Slot::top:
+      if (auto *member = std::get_if<int Values::*>(&field_)) {
+        out_.*(*member) = integer;
+        return true;
+      }
+      if (auto *member = std::get_if<double Values::*>(&field_)) {
+        out_.*(*member) = value;
+        return true;
+      }
+      break;
+    case Slot::weighted_item:
+      (*weighted_)[weighted_key_] = value;
+      return true;
+    case Slot::sample_weight:
+      sample_.weight = value;
+      return true;
+    case Slot::rule_field:
+      if (item_key_ == "badge_scale") {
+        rule_.badge_scale = value;
+        return true;
+      }
+      break;
+    case Slot::rule_entry:
+      if (item_key_ == "keys") {
+        rule_.keycodes.push_back(integer);
+        return true;
+      }
+      break;
+    default:
+      break;
+    }
+    return mismatch("number");
+  }
+
+  bool end() {
+    if (skip_ > 0) {
+      --skip_;
+      return true;
+    }
+    if (rules_ != nullptr && depth_ >= 3) {
+      if (depth_ == 3) {
+        rules_->push_back(std::move(rule_));
+        item_key_.clear();
+      }
+    } else if (depth_ == 3) {
+      if (!sample_has_path_) {
+        return fail("sound_samples: entry without a path");
+      }
+      if (!sample_.path.empty()) {
+        samples_->push_back(std::move(sample_));
+      }
+      item_key_.clear();
+    } else if (depth_ == 2) {
+      list_ = nullptr;
+      samples_ = nullptr;
+      weighted_ = nullptr;
+      rules_ = nullptr;
+      hotkeys_ = nullptr;
+      item_key_.clear();
+    }
+    --depth_;
+    return true;
+  }
+
+  // Replaces the chord of the action named by item_key_. An empty chord
+  // unbinds it; one that does not parse keeps the default.
+  void bind(std::string_view chord) {
+    auto action = from_string<HotkeyAction>(item_key_);
+    if (!action) {
+      spdlog::warn("hotkeys: unknown action ({}); ignoring it", item_key_);
+      return;
+    }
+    std::erase_if(*hotkeys_, [&](const Hotkey &hotkey) { return hotkey.action == *action; });
+    if (chord.empty()) {
+      return;
+    }
+    auto hotkey = parse_chord(*action, chord);
+    if (!hotkey) {
+      spdlog::warn("hotkeys: invalid chord for {} ({}); using the default", item_key_, chord);
+      for (const auto &fallback : default_hotkeys()) {
+        if (fallback.action == *action) {
+          hotkey = fallback;
         }
-        emoji_atlas_ = std::move(path);
       }
-    } else {
-      emoji_atlas_ = std::nullopt;
     }
+    hotkeys_->push_back(*hotkey);
+  }
+
+  bool mismatch(const char *what) {
+    if (depth_ == 0) {
+      return fail("the root is not an object");
+    }
+    return fail(fmt::format("{}: unexpected {}", key_, what));
+  }
+  bool fail(std::string message) {
+    if (error_.empty()) {
+      error_ = std::move(message);
+    }
+    return false;
+  }
+
+  Values &out_;
+  int depth_ = 0; // 1 inside the root object
+  int skip_ = 0;  // nesting inside an ignored value
+  std::string key_;
+  Field field_;
+  std::vector<std::string> *list_ = nullptr;
+  std::vector<SoundSample> *samples_ = nullptr;
+  SoundSample sample_;
+  bool sample_has_path_ = false;
+  std::string item_key_; // key in a sound_samples or key_rules element, or in hotkeys
+  std::vector<KeyRule> *rules_ = nullptr;
+  KeyRule rule_;
+  std::vector<Hotkey> *hotkeys_ = nullptr;
+  std::unordered_map<std::string, double> *weighted_ = nullptr;
+  std::string weighted_key_;
+  bool weighted_seen_ = false;
+  std::string error_;
+};
+
+// Comments are allowed, as in lizard.json.sample.
+bool Config::parse(const std::string &text, Values &next) const {
+  LIZARD_TRACE_ZONE("app::Config::parse");
+  Sax sax(next);
+  if (!json::sax_parse(text, &sax, json::input_format_t::json, true, true)) {
+    spdlog::error("Failed to parse config {}: {}", config_path_.string(), sax.error());
+    return false;
+  }
+  validate(next, sax.weighted_seen());
+  return true;
+}
 
-    emoji_pngs_ = j.value("emoji_pngs", std::vector<std::string>{});
+void Config::validate(Values &next, bool weighted_seen) const {
+  auto clamp_nonneg = [](int value, const char *name) {
+    if (value < 0) {
+      spdlog::warn("{} negative ({}); clamping to 0", name, value);
+      return 0;
+    }
+    return value;
+  };
+  auto resolve = [&](std::optional<std::filesystem::path> &path) {
+    if (path && !path->is_absolute()) {
+      path = config_path_.parent_path() / *path;
+    }
+  };
+
+  if (clamp_nonneg(next.sound_cooldown_ms, "sound_cooldown_ms") > 0) {
+    spdlog::warn(
+        "sound_cooldown_ms is deprecated and ignored; bursts are limited by max_concurrent_playbacks");
+  }
+  next.sound_cooldown_ms = 0;
+  next.max_concurrent_playbacks =
+      clamp_nonneg(next.max_concurrent_playbacks, "max_concurrent_playbacks");
+  next.badges_per_second_max = clamp_nonneg(next.badges_per_second_max, "badges_per_second_max");
+  next.badge_min_px = clamp_nonneg(next.badge_min_px, "badge_min_px");
+  next.badge_max_px = clamp_nonneg(next.badge_max_px, "badge_max_px");
+  if (next.badge_max_px < next.badge_min_px) {
+    spdlog::warn("badge_max_px ({}) less than badge_min_px ({}); clamping to {}",
+                 next.badge_max_px, next.badge_min_px, next.badge_min_px);
+    next.badge_max_px = next.badge_min_px;
+  }
+  next.fps_fixed = clamp_nonneg(next.fps_fixed, "fps_fixed");
+  if (next.fps_fixed <= 0) {
+    spdlog::warn("fps_fixed non-positive ({}); using 60", next.fps_fixed);
+    next.fps_fixed = 60;
+  }
+  next.volume_percent = clamp_nonneg(next.volume_percent, "volume_percent");
+  if (next.volume_percent > 100) {
+    spdlog::warn("volume_percent ({}) out of range; clamping to 100", next.volume_percent);
+    next.volume_percent = 100;
+  }
+  next.logging_queue_size = clamp_nonneg(next.logging_queue_size, "logging_queue_size");
+  next.logging_worker_count = clamp_nonneg(next.logging_worker_count, "logging_worker_count");
+  if (next.logging_worker_count == 0) {
+    spdlog::warn("logging_worker_count zero; clamping to 1");
+    next.logging_worker_count = 1;
+  }
+
+  resolve(next.sound_path);
+  std::erase_if(next.sound_samples, [](const SoundSample &sample) {
+    if (!(sample.weight > 0.0)) {
+      spdlog::warn("sound_samples entry {} has non-positive weight ({}); skipping",
+                   sample.path.string(), sample.weight);
+      return true;
+    }
+    return false;
+  });
+  for (auto &sample : next.sound_samples) {
+    if (!sample.path.is_absolute()) {
+      sample.path = config_path_.parent_path() / sample.path;
+    }
+  }
+  next.sound_pool_budget_mb = clamp_nonneg(next.sound_pool_budget_mb, "sound_pool_budget_mb");
+  next.sound_stream_threshold_mb =
+      clamp_nonneg(next.sound_stream_threshold_mb, "sound_stream_threshold_mb");
+  next.sound_coalesce_ms = clamp_nonneg(next.sound_coalesce_ms, "sound_coalesce_ms");
+  next.sound_pitch_variation_cents =
+      clamp_nonneg(next.sound_pitch_variation_cents, "sound_pitch_variation_cents");
+  if (!(next.sound_gain_variation_db >= 0.0)) {
+    spdlog::warn("sound_gain_variation_db negative ({}); clamping to 0",
+                 next.sound_gain_variation_db);
+    next.sound_gain_variation_db = 0.0;
+  }
 
-    if (!emoji_pngs_.empty()) {
-      emoji_.clear();
-      emoji_weighted_.clear();
-    } else if (j.contains("emoji_weighted")) {
-      emoji_weighted_.clear();
-      for (auto &[k, v] : j.at("emoji_weighted").items()) {
-        emoji_weighted_[k] = v.get<double>();
+  for (auto &rule : next.key_rules) {
+    std::erase_if(rule.keycodes, [](int keycode) {
+      if (keycode < 0 || keycode >= static_cast<int>(KeyTable::kSize)) {
+        spdlog::warn("key_rules: keycode {} out of range; ignoring it", keycode);
+        return true;
+      }
+      return false;
+    });
+    if (!(rule.badge_scale > 0.0)) {
+      spdlog::warn("key_rules: badge_scale non-positive ({}); using 1", rule.badge_scale);
+      rule.badge_scale = 1.0;
+    }
+    rule.sample = -1;
+    if (!rule.sound.empty()) {
+      if (!rule.sound.is_absolute()) {
+        rule.sound = config_path_.parent_path() / rule.sound;
+      }
+      auto it = std::find_if(next.sound_samples.begin(), next.sound_samples.end(),
+                             [&](const SoundSample &sample) { return sample.path == rule.sound; });
+      if (it == next.sound_samples.end()) {
+        spdlog::warn("key_rules: sound {} is not listed in sound_samples; ignoring it",
+                     rule.sound.string());
+      } else {
+        rule.sample = static_cast<int>(it - next.sound_samples.begin());
       }
-      emoji_.clear();
-    } else {
-      emoji_ = j.value("emoji", std::vector<std::string>{"\U0001F98E"});
-      emoji_weighted_.clear();
     }
-  } catch (const std::exception &e) {
-    spdlog::error("Failed to parse config {}: {}", config_path_.string(), e.what());
   }
 
-  lizard::util::init_logging(logging_level_, logging_queue_size_, logging_worker_count_,
-                             logging_path_);
+  resolve(next.emoji_atlas);
+  if (!next.emoji_pngs.empty()) {
+    next.emoji.clear();
+    next.emoji_weighted.clear();
+  } else if (weighted_seen) {
+    next.emoji.clear();
+  } else {
+    next.emoji_weighted.clear();
+  }
 }
 
 bool Config::enabled() const {
   std::shared_lock lock(mutex_);
-  return enabled_;
+  return values_->enabled;
 }
 
 bool Config::mute() const {
   std::shared_lock lock(mutex_);
-  return mute_;
+  return values_->mute;
 }
 
 std::vector<std::string> Config::emoji() const {
   std::shared_lock lock(mutex_);
-  return emoji_;
+  return values_->emoji;
 }
 
 std::unordered_map<std::string, double> Config::emoji_weighted() const {
   std::shared_lock lock(mutex_);
-  return emoji_weighted_;
+  return values_->emoji_weighted;
 }
 
 std::vector<std::string> Config::emoji_pngs() const {
   std::shared_lock lock(mutex_);
-  return emoji_pngs_;
+  return values_->emoji_pngs;
 }
 
 std::optional<std::filesystem::path> Config::sound_path() const {
   std::shared_lock lock(mutex_);
-  return sound_path_;
+  return values_->sound_path;
+}
+
+std::vector<SoundSample> Config::sound_samples() const {
+  std::shared_lock lock(mutex_);
+  return values_->sound_samples;
+}
+
+int Config::sound_pool_budget_mb() const {
+  std::shared_lock lock(mutex_);
+  return values_->sound_pool_budget_mb;
+}
+
+int Config::sound_stream_threshold_mb() const {
+  std::shared_lock lock(mutex_);
+  return values_->sound_stream_threshold_mb;
+}
+
+SoundPcmFormat Config::sound_pcm_format() const {
+  std::shared_lock lock(mutex_);
+  return values_->sound_pcm_format;
+}
+
+SoundCoalesceMode Config::sound_coalesce_mode() const {
+  std::shared_lock lock(mutex_);
+  return values_->sound_coalesce_mode;
+}
+
+int Config::sound_coalesce_ms() const {
+  std::shared_lock lock(mutex_);
+  return values_->sound_coalesce_ms;
+}
+
+int Config::sound_pitch_variation_cents() const {
+  std::shared_lock lock(mutex_);
+  return values_->sound_pitch_variation_cents;
+}
+
+double Config::sound_gain_variation_db() const {
+  std::shared_lock lock(mutex_);
+  return values_->sound_gain_variation_db;
 }
 
 std::optional<std::filesystem::path> Config::emoji_atlas() const {
   std::shared_lock lock(mutex_);
-  return emoji_atlas_;
+  return values_->emoji_atlas;
 }
 
 int Config::sound_cooldown_ms() const {
   std::shared_lock lock(mutex_);
-  return sound_cooldown_ms_;
+  return values_->sound_cooldown_ms;
 }
 
 int Config::max_concurrent_playbacks() const {
   std::shared_lock lock(mutex_);
-  return max_concurrent_playbacks_;
+  return values_->max_concurrent_playbacks;
 }
 
 int Config::badges_per_second_max() const {
   std::shared_lock lock(mutex_);
-  return badges_per_second_max_;
+  return values_->badges_per_second_max;
 }
 
 int Config::badge_min_px() const {
   std::shared_lock lock(mutex_);
-  return badge_min_px_;
+  return values_->badge_min_px;
 }
 
 int Config::badge_max_px() const {
   std::shared_lock lock(mutex_);
-  return badge_max_px_;
+  return values_->badge_max_px;
 }
 
 bool Config::fullscreen_pause() const {
   std::shared_lock lock(mutex_);
-  return fullscreen_pause_;
+  return values_->fullscreen_pause;
 }
 
 std::vector<std::string> Config::exclude_processes() const {
   std::shared_lock lock(mutex_);
-  return exclude_processes_;
+  return values_->exclude_processes;
 }
 
 bool Config::ignore_injected() const {
   std::shared_lock lock(mutex_);
-  return ignore_injected_;
+  return values_->ignore_injected;
+}
+
+AudioBackend Config::audio_backend() const {
+  std::shared_lock lock(mutex_);
+  return values_->audio_backend;
 }
 
-std::string Config::audio_backend() const {
+AudioProfile Config::audio_profile() const {
   std::shared_lock lock(mutex_);
-  return audio_backend_;
+  return values_->audio_profile;
 }
 
-std::string Config::badge_spawn_strategy() const {
+BadgeSpawnStrategy Config::badge_spawn_strategy() const {
   std::shared_lock lock(mutex_);
-  return badge_spawn_strategy_;
+  return values_->badge_spawn_strategy;
 }
 
-std::string Config::fps_mode() const {
+FpsMode Config::fps_mode() const {
   std::shared_lock lock(mutex_);
-  return fps_mode_;
+  return values_->fps_mode;
 }
 
 int Config::fps_fixed() const {
   std::shared_lock lock(mutex_);
-  return fps_fixed_;
+  return values_->fps_fixed;
 }
 
 int Config::volume_percent() const {
   std::shared_lock lock(mutex_);
-  return volume_percent_;
+  return values_->volume_percent;
 }
 
-std::string Config::dpi_scaling_mode() const {
+DpiScalingMode Config::dpi_scaling_mode() const {
   std::shared_lock lock(mutex_);
-  return dpi_scaling_mode_;
+  return values_->dpi_scaling_mode;
 }
 
 std::string Config::logging_level() const {
   std::shared_lock lock(mutex_);
-  return logging_level_;
+  return values_->logging_level;
 }
 
 int Config::logging_queue_size() const {
   std::shared_lock lock(mutex_);
-  return logging_queue_size_;
+  return values_->logging_queue_size;
 }
 
 int Config::logging_worker_count() const {
   std::shared_lock lock(mutex_);
-  return logging_worker_count_;
+  return values_->logging_worker_count;
+}
+
+util::OverflowPolicy Config::logging_overflow() const {
+  std::shared_lock lock(mutex_);
+  return values_->logging_overflow;
 }
 
 std::filesystem::path Config::logging_path() const {
   std::shared_lock lock(mutex_);
-  return logging_path_;
+  return values_->logging_path;
+}
+
+KeyReaction Config::key_reaction(int keycode) const {
+  std::shared_lock lock(mutex_);
+  return values_->keys[keycode];
+}
+
+std::vector<std::vector<std::string>> Config::key_emoji_sets() const {
+  std::shared_lock lock(mutex_);
+  return values_->keys.emoji_sets();
+}
+
+HotkeyMatch Config::match_hotkey(HotkeyMatcher &matcher, int keycode, bool pressed) const {
+  std::shared_lock lock(mutex_);
+  return matcher.feed(values_->hotkey_table, keycode, pressed);
 }
 
 } // namespace lizard::app
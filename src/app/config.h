@@ -1,20 +1,82 @@
 #pragma once
 
+#include <array>
 #include <chrono>
 #include <condition_variable>
+#include <cstdint>
 #include <filesystem>
+#include <memory>
 #include <mutex>
 #include <optional>
 #include <shared_mutex>
 #include <string>
-#include <thread>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
+#include "file_watcher.h"
+#include "hotkeys.h"
+#include "key_rules.h"
+#include "util/log.h"
+
 namespace lizard::app {
 
+struct SoundSample {
+  std::filesystem::path path;
+  double weight = 1.0;
+};
+
+// Settings with a fixed set of spellings are resolved to these once, when the
+// file is parsed. enum_names() lists each enum's spellings in declaration
+// order; the first one is the default.
+enum class BadgeSpawnStrategy { RandomScreen, NearCaret };
+enum class FpsMode { Auto, Fixed };
+enum class AudioBackend { Miniaudio, Wasapi, CoreAudio, Alsa, Null };
+enum class DpiScalingMode { PerMonitorV2, System };
+enum class SoundPcmFormat { F32, S16 };
+enum class SoundCoalesceMode { Boost, Retrigger, Off };
+enum class AudioProfile { Default, LowLatency };
+
+constexpr std::array<std::string_view, 2> enum_names(BadgeSpawnStrategy) {
+  return {"random_screen", "near_caret"};
+}
+constexpr std::array<std::string_view, 2> enum_names(FpsMode) { return {"auto", "fixed"}; }
+constexpr std::array<std::string_view, 5> enum_names(AudioBackend) {
+  return {"miniaudio", "wasapi", "coreaudio", "alsa", "null"};
+}
+constexpr std::array<std::string_view, 2> enum_names(DpiScalingMode) {
+  return {"per_monitor_v2", "system"};
+}
+constexpr std::array<std::string_view, 2> enum_names(SoundPcmFormat) { return {"f32", "s16"}; }
+constexpr std::array<std::string_view, 3> enum_names(SoundCoalesceMode) {
+  return {"boost", "retrigger", "off"};
+}
+constexpr std::array<std::string_view, 2> enum_names(AudioProfile) {
+  return {"default", "low_latency"};
+}
+constexpr std::array<std::string_view, 2> enum_names(util::OverflowPolicy) {
+  return {"block", "overrun_oldest"};
+}
+
+template <typename E> constexpr std::string_view to_string(E value) {
+  return enum_names(E{})[static_cast<std::size_t>(value)];
+}
+
+template <typename E> constexpr std::optional<E> from_string(std::string_view text) {
+  constexpr auto names = enum_names(E{});
+  for (std::size_t i = 0; i < names.size(); ++i) {
+    if (names[i] == text) {
+      return static_cast<E>(i);
+    }
+  }
+  return std::nullopt;
+}
+
 class Config {
 public:
+  // The file is watched for changes and reloaded shortly after each save.
+  // `interval` is the polling period used only where the platform offers no
+  // change notifications.
   Config(std::filesystem::path executable_dir,
          std::optional<std::filesystem::path> cli_path = std::nullopt,
          std::chrono::milliseconds interval = std::chrono::seconds(1));
@@ -26,6 +88,14 @@ public:
   std::unordered_map<std::string, double> emoji_weighted() const;
   std::vector<std::string> emoji_pngs() const;
   std::optional<std::filesystem::path> sound_path() const;
+  std::vector<SoundSample> sound_samples() const;
+  int sound_pool_budget_mb() const;
+  int sound_stream_threshold_mb() const;
+  SoundPcmFormat sound_pcm_format() const;
+  SoundCoalesceMode sound_coalesce_mode() const;
+  int sound_coalesce_ms() const;
+  int sound_pitch_variation_cents() const;
+  double sound_gain_variation_db() const;
   std::optional<std::filesystem::path> emoji_atlas() const;
   // Deprecated: retained for compatibility; always returns 0.
   int sound_cooldown_ms() const;
@@ -36,59 +106,109 @@ public:
   bool fullscreen_pause() const;
   std::vector<std::string> exclude_processes() const;
   bool ignore_injected() const;
-  std::string audio_backend() const;
-  std::string badge_spawn_strategy() const;
-  std::string fps_mode() const;
+  AudioBackend audio_backend() const;
+  AudioProfile audio_profile() const;
+  BadgeSpawnStrategy badge_spawn_strategy() const;
+  FpsMode fps_mode() const;
   int fps_fixed() const;
   int volume_percent() const;
-  std::string dpi_scaling_mode() const;
+  DpiScalingMode dpi_scaling_mode() const;
   std::string logging_level() const;
   int logging_queue_size() const;
   int logging_worker_count() const;
+  util::OverflowPolicy logging_overflow() const;
   std::filesystem::path logging_path() const;
+  // Compiled from `key_rules`; a plain table lookup, cheap enough for the
+  // keyboard hook.
+  KeyReaction key_reaction(int keycode) const;
+  // The emoji lists KeyReaction::emoji_set refers to.
+  std::vector<std::vector<std::string>> key_emoji_sets() const;
+  // Feeds one key event through `matcher` against the `hotkeys` chords.
+  HotkeyMatch match_hotkey(HotkeyMatcher &matcher, int keycode, bool pressed) const;
 
   void reload();
   std::condition_variable &reload_cv() { return reload_cv_; }
   static std::filesystem::path user_config_path();
+  // Per-user directory for files that are safe to delete, such as compiled
+  // shaders; empty if the platform gives no home for it.
+  static std::filesystem::path user_cache_dir();
 
 private:
-  void load(std::unique_lock<std::shared_mutex> &lock);
+  // Everything read from the file. Loading fills a private copy and then
+  // swaps the pointer, so readers never wait on file I/O or parsing.
+  struct Values {
+    bool enabled{true};
+    bool mute{false};
+    int sound_cooldown_ms{0};
+    int max_concurrent_playbacks{16};
+    int badges_per_second_max{12};
+    int badge_min_px{60};
+    int badge_max_px{108};
+    std::vector<std::string> emoji{"\U0001F98E"};
+    std::unordered_map<std::string, double> emoji_weighted{};
+    std::vector<std::string> emoji_pngs{};
+    std::optional<std::filesystem::path> sound_path{};
+    std::vector<SoundSample> sound_samples{};
+    int sound_pool_budget_mb{24};
+    int sound_stream_threshold_mb{8};
+    SoundPcmFormat sound_pcm_format{};
+    SoundCoalesceMode sound_coalesce_mode{};
+    int sound_coalesce_ms{60};
+    int sound_pitch_variation_cents{0};
+    double sound_gain_variation_db{0.0};
+    std::optional<std::filesystem::path> emoji_atlas{};
+    bool fullscreen_pause{true};
+    std::vector<std::string> exclude_processes{};
+    bool ignore_injected{true};
+    AudioBackend audio_backend{};
+    AudioProfile audio_profile{};
+    BadgeSpawnStrategy badge_spawn_strategy{};
+    FpsMode fps_mode{};
+    int fps_fixed{60};
+    int volume_percent{65};
+    DpiScalingMode dpi_scaling_mode{};
+    std::string logging_level{"info"};
+    int logging_queue_size{8192};
+    int logging_worker_count{1};
+    util::OverflowPolicy logging_overflow{};
+    std::filesystem::path logging_path{};
+    std::vector<KeyRule> key_rules{};
+    std::vector<Hotkey> hotkeys{default_hotkeys()};
+    // Not stored in the cache; rebuilt from key_rules and hotkeys on every
+    // load.
+    KeyTable keys{};
+    HotkeyTable hotkey_table{};
+  };
+
+  class Sax;
+
+  // Reads the file into a copy of the current values and publishes it.
+  void load(std::unique_lock<std::mutex> &lock);
+  // Parses without building a DOM, then validates. False leaves `next`
+  // partly filled.
+  bool parse(const std::string &text, Values &next) const;
+  // Clamps and defaults whatever parse() read, logging each adjustment.
+  void validate(Values &next, bool weighted_seen) const;
 
+  // Validated values are also stored in a versioned binary file next to the
+  // JSON (config_cache.cpp), so an unchanged file loads without parsing.
+  // Identifies the JSON a cache was built from.
+  std::uint64_t cache_key(std::string_view text, std::int64_t mtime) const;
+  std::filesystem::path cache_path() const;
+  bool read_cache(std::uint64_t key, Values &out) const;
+  void write_cache(std::uint64_t key, const Values &values) const;
+  void on_file_changed();
+
+  // Guards values_ only; held exclusively just for the pointer swap.
   mutable std::shared_mutex mutex_;
+  // Serialises load(); guards last_write_.
+  std::mutex load_mutex_;
   std::filesystem::path config_path_;
   std::filesystem::file_time_type last_write_{};
-  std::jthread watcher_;
+  std::unique_ptr<FileWatcher> watcher_;
   std::chrono::milliseconds interval_;
-  std::condition_variable cv_;
-  std::mutex cv_mutex_;
   std::condition_variable reload_cv_;
-
-  // config values
-  bool enabled_{true};
-  bool mute_{false};
-  int sound_cooldown_ms_{0};
-  int max_concurrent_playbacks_{16};
-  int badges_per_second_max_{12};
-  int badge_min_px_{60};
-  int badge_max_px_{108};
-  std::vector<std::string> emoji_{"\U0001F98E"};
-  std::unordered_map<std::string, double> emoji_weighted_{};
-  std::vector<std::string> emoji_pngs_{};
-  std::optional<std::filesystem::path> sound_path_{};
-  std::optional<std::filesystem::path> emoji_atlas_{};
-  bool fullscreen_pause_{true};
-  std::vector<std::string> exclude_processes_{};
-  bool ignore_injected_{true};
-  std::string audio_backend_{"miniaudio"};
-  std::string badge_spawn_strategy_{"random_screen"};
-  std::string fps_mode_{"auto"};
-  int fps_fixed_{60};
-  int volume_percent_{65};
-  std::string dpi_scaling_mode_{"per_monitor_v2"};
-  std::string logging_level_{"info"};
-  int logging_queue_size_{8192};
-  int logging_worker_count_{1};
-  std::filesystem::path logging_path_{};
+  std::shared_ptr<const Values> values_{std::make_shared<const Values>()};
 };
 
 } // namespace lizard::app
@@ -0,0 +1,268 @@
+// Binary snapshot of validated config values, stored next to the JSON as
+// "<name>.cache". It is only a startup shortcut: anything unexpected in it
+// (old version, truncation, another file's key) falls back to parsing.
+
+#include "config.h"
+
+#include <array>
+#include <cstring>
+#include <type_traits>
+
+#include "util/blob_file.h"
+
+namespace lizard::app {
+
+namespace {
+
+using util::fnv1a;
+
+constexpr std::array<char, 4> kMagic = {'L', 'Z', 'C', 'C'};
+// Bump whenever Values, the field order below or validation changes.
+constexpr std::uint32_t kVersion = 7;
+
+std::string_view utf8(const std::u8string &text) {
+  return {reinterpret_cast<const char *>(text.data()), text.size()};
+}
+
+class Writer {
+public:
+  template <typename... Ts> void operator()(const Ts &...values) { (put(values), ...); }
+  const std::string &bytes() const { return out_; }
+
+private:
+  template <typename T> void raw(const T &value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    out_.append(reinterpret_cast<const char *>(&value), sizeof(T));
+  }
+  void put(bool value) { raw(static_cast<std::uint8_t>(value)); }
+  void put(int value) { raw(static_cast<std::int32_t>(value)); }
+  void put(double value) { raw(value); }
+  template <typename E>
+    requires std::is_enum_v<E>
+  void put(E value) {
+    raw(static_cast<std::uint8_t>(value));
+  }
+  void put(std::string_view text) {
+    raw(static_cast<std::uint32_t>(text.size()));
+    out_.append(text);
+  }
+  void put(const std::string &text) { put(std::string_view(text)); }
+  void put(const std::filesystem::path &path) { put(utf8(path.u8string())); }
+  void put(const std::optional<std::filesystem::path> &path) {
+    put(path.has_value());
+    if (path) {
+      put(*path);
+    }
+  }
+  void put(const std::vector<std::string> &list) {
+    raw(static_cast<std::uint32_t>(list.size()));
+    for (const auto &item : list) {
+      put(item);
+    }
+  }
+  void put(const std::unordered_map<std::string, double> &map) {
+    raw(static_cast<std::uint32_t>(map.size()));
+    for (const auto &[key, value] : map) {
+      put(key);
+      put(value);
+    }
+  }
+  void put(const std::vector<SoundSample> &samples) {
+    raw(static_cast<std::uint32_t>(samples.size()));
+    for (const auto &sample : samples) {
+      put(sample.path);
+      put(sample.weight);
+    }
+  }
+  void put(const KeyRule &rule) {
+    (*this)(rule.keycodes, rule.classes, rule.suppress, rule.sound, rule.sample, rule.emoji,
+            rule.badge_scale);
+  }
+  void put(const Hotkey &hotkey) { (*this)(hotkey.action, hotkey.modifiers, hotkey.keycode); }
+  template <typename T> void put(const std::vector<T> &items) {
+    raw(static_cast<std::uint32_t>(items.size()));
+    for (const auto &item : items) {
+      put(item);
+    }
+  }
+
+  std::string out_;
+};
+
+// Mirrors Writer. Any short read marks the reader failed and leaves the
+// remaining values alone.
+class Reader {
+public:
+  explicit Reader(std::string_view in) : in_(in) {}
+  template <typename... Ts> void operator()(Ts &...values) { (get(values), ...); }
+  bool ok() const { return ok_ && in_.empty(); }
+
+private:
+  template <typename T> bool raw(T &value) {
+    if (!ok_ || in_.size() < sizeof(T)) {
+      ok_ = false;
+      return false;
+    }
+    std::memcpy(&value, in_.data(), sizeof(T));
+    in_.remove_prefix(sizeof(T));
+    return true;
+  }
+  bool count(std::uint32_t &n) { return raw(n) && n <= in_.size(); }
+  void get(bool &value) {
+    std::uint8_t byte = 0;
+    if (raw(byte)) {
+      value = byte != 0;
+    }
+  }
+  void get(int &value) {
+    std::int32_t word = 0;
+    if (raw(word)) {
+      value = word;
+    }
+  }
+  void get(double &value) { raw(value); }
+  template <typename E>
+    requires std::is_enum_v<E>
+  void get(E &value) {
+    std::uint8_t index = 0;
+    if (raw(index)) {
+      if (index < enum_names(E{}).size()) {
+        value = static_cast<E>(index);
+      } else {
+        ok_ = false;
+      }
+    }
+  }
+  void get(std::string &text) {
+    std::uint32_t n = 0;
+    if (!count(n)) {
+      ok_ = false;
+      return;
+    }
+    text.assign(in_.data(), n);
+    in_.remove_prefix(n);
+  }
+  void get(std::filesystem::path &path) {
+    std::string text;
+    get(text);
+    path = std::filesystem::path(std::u8string(text.begin(), text.end()));
+  }
+  void get(std::optional<std::filesystem::path> &path) {
+    bool present = false;
+    get(present);
+    if (present) {
+      path.emplace();
+      get(*path);
+    } else {
+      path.reset();
+    }
+  }
+  void get(std::vector<std::string> &list) {
+    std::uint32_t n = 0;
+    if (!count(n)) {
+      ok_ = false;
+      return;
+    }
+    list.assign(n, {});
+    for (auto &item : list) {
+      get(item);
+    }
+  }
+  void get(std::unordered_map<std::string, double> &map) {
+    std::uint32_t n = 0;
+    if (!count(n)) {
+      ok_ = false;
+      return;
+    }
+    map.clear();
+    for (std::uint32_t i = 0; i < n && ok_; ++i) {
+      std::string key;
+      double value = 0.0;
+      get(key);
+      get(value);
+      map[std::move(key)] = value;
+    }
+  }
+  void get(std::vector<SoundSample> &samples) {
+    std::uint32_t n = 0;
+    if (!count(n)) {
+      ok_ = false;
+      return;
+    }
+    samples.assign(n, {});
+    for (auto &sample : samples) {
+      get(sample.path);
+      get(sample.weight);
+    }
+  }
+  void get(KeyRule &rule) {
+    (*this)(rule.keycodes, rule.classes, rule.suppress, rule.sound, rule.sample, rule.emoji,
+            rule.badge_scale);
+  }
+  void get(Hotkey &hotkey) { (*this)(hotkey.action, hotkey.modifiers, hotkey.keycode); }
+  template <typename T> void get(std::vector<T> &items) {
+    std::uint32_t n = 0;
+    if (!count(n)) {
+      ok_ = false;
+      return;
+    }
+    items.assign(n, T{});
+    for (auto &item : items) {
+      get(item);
+    }
+  }
+
+  std::string_view in_;
+  bool ok_ = true;
+};
+
+// The one place that lists the cached fields, shared by both directions.
+template <typename Archive, typename V> void fields(Archive &ar, V &v) {
+  ar(v.enabled, v.mute, v.sound_cooldown_ms, v.max_concurrent_playbacks, v.badges_per_second_max,
+     v.badge_min_px, v.badge_max_px, v.emoji, v.emoji_weighted, v.emoji_pngs, v.sound_path,
+     v.sound_samples, v.sound_pool_budget_mb, v.sound_stream_threshold_mb, v.sound_pcm_format,
+     v.sound_coalesce_mode, v.sound_coalesce_ms, v.sound_pitch_variation_cents,
+     v.sound_gain_variation_db, v.emoji_atlas, v.fullscreen_pause, v.exclude_processes,
+     v.ignore_injected, v.audio_backend, v.audio_profile, v.badge_spawn_strategy, v.fps_mode,
+     v.fps_fixed, v.volume_percent, v.dpi_scaling_mode, v.logging_level, v.logging_queue_size,
+     v.logging_worker_count, v.logging_overflow, v.logging_path, v.key_rules, v.hotkeys);
+}
+
+} // namespace
+
+std::uint64_t Config::cache_key(std::string_view text, std::int64_t mtime) const {
+  // Relative asset paths are resolved against the config's directory, so the
+  // path is part of the key too.
+  std::uint64_t hash = fnv1a(utf8(config_path_.u8string()), fnv1a(text));
+  return fnv1a(std::string_view(reinterpret_cast<const char *>(&mtime), sizeof(mtime)), hash);
+}
+
+std::filesystem::path Config::cache_path() const {
+  auto path = config_path_;
+  path += ".cache";
+  return path;
+}
+
+bool Config::read_cache(std::uint64_t key, Values &out) const {
+  auto payload = util::read_blob(cache_path(), {kMagic, kVersion, key});
+  if (!payload) {
+    return false;
+  }
+  Values cached;
+  Reader reader(*payload);
+  fields(reader, cached);
+  if (!reader.ok()) {
+    return false;
+  }
+  out = std::move(cached);
+  return true;
+}
+
+// Failing to write the cache only costs the next startup a parse.
+void Config::write_cache(std::uint64_t key, const Values &values) const {
+  Writer writer;
+  fields(writer, values);
+  util::write_blob(cache_path(), {kMagic, kVersion, key}, writer.bytes());
+}
+
+} // namespace lizard::app
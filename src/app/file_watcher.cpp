@@ -0,0 +1,321 @@
+#include "file_watcher.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <system_error>
+
+#include <spdlog/spdlog.h>
+
+#include "util/trace.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <cerrno>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
+#define LIZARD_WATCH_KQUEUE
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/event.h>
+#include <unistd.h>
+#ifndef O_EVTONLY
+#define O_EVTONLY O_RDONLY
+#endif
+#endif
+
+namespace lizard::app {
+
+FileWatcher::FileWatcher(std::filesystem::path path, std::function<void()> on_change,
+                         std::chrono::milliseconds debounce,
+                         std::chrono::milliseconds poll_interval)
+    : path_(std::move(path)), on_change_(std::move(on_change)), debounce_(debounce),
+      poll_interval_(poll_interval) {
+  auto armed = ready_.get_future();
+  thread_ = std::jthread([this](std::stop_token st) { run(st); });
+  armed.wait();
+}
+
+FileWatcher::~FileWatcher() {
+  thread_.request_stop();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+void FileWatcher::run(std::stop_token st) {
+  LIZARD_TRACE_THREAD("file_watcher");
+  if (!watch_native(st) && !st.stop_requested()) {
+    spdlog::warn("File change notifications unavailable for {}; polling every {} ms",
+                 path_.string(), poll_interval_.count());
+    watch_polling(st);
+  }
+  ready();
+}
+
+void FileWatcher::ready() {
+  if (!ready_set_) {
+    ready_set_ = true;
+    ready_.set_value();
+  }
+}
+
+#ifdef _WIN32
+
+bool FileWatcher::watch_native(std::stop_token st) {
+  auto dir_path = path_.parent_path().empty() ? std::filesystem::path(L".") : path_.parent_path();
+  std::wstring name = path_.filename().wstring();
+  HANDLE dir = CreateFileW(dir_path.c_str(), FILE_LIST_DIRECTORY,
+                           FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+                           OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED,
+                           nullptr);
+  if (dir == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  HANDLE stop = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+  OVERLAPPED overlapped{};
+  overlapped.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+  alignas(DWORD) std::byte buffer[16 * 1024];
+  auto arm = [&] {
+    ResetEvent(overlapped.hEvent);
+    return ReadDirectoryChangesW(dir, buffer, sizeof(buffer), FALSE,
+                                 FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE |
+                                     FILE_NOTIFY_CHANGE_SIZE,
+                                 nullptr, &overlapped, nullptr) != 0;
+  };
+  bool armed = stop != nullptr && overlapped.hEvent != nullptr && arm();
+  if (armed) {
+    ready();
+    std::stop_callback wake(st, [stop] { SetEvent(stop); });
+    bool pending = false;
+    while (!st.stop_requested()) {
+      HANDLE handles[] = {overlapped.hEvent, stop};
+      DWORD timeout = pending ? static_cast<DWORD>(debounce_.count()) : INFINITE;
+      DWORD waited = WaitForMultipleObjects(2, handles, FALSE, timeout);
+      if (waited == WAIT_TIMEOUT) {
+        pending = false;
+        on_change_();
+        continue;
+      }
+      if (waited != WAIT_OBJECT_0) {
+        break;
+      }
+      DWORD bytes = 0;
+      if (!GetOverlappedResult(dir, &overlapped, &bytes, FALSE)) {
+        break;
+      }
+      // Zero bytes means the buffer overflowed; assume our file was among them.
+      pending = pending || bytes == 0;
+      for (DWORD offset = 0; bytes != 0;) {
+        auto *info = reinterpret_cast<const FILE_NOTIFY_INFORMATION *>(buffer + offset);
+        int length = static_cast<int>(info->FileNameLength / sizeof(WCHAR));
+        if (CompareStringOrdinal(info->FileName, length, name.c_str(),
+                                 static_cast<int>(name.size()), TRUE) == CSTR_EQUAL) {
+          pending = true;
+        }
+        if (info->NextEntryOffset == 0) {
+          break;
+        }
+        offset += info->NextEntryOffset;
+      }
+      if (!arm()) {
+        break;
+      }
+    }
+    CancelIoEx(dir, &overlapped);
+    DWORD ignored = 0;
+    GetOverlappedResult(dir, &overlapped, &ignored, TRUE);
+  }
+  if (overlapped.hEvent != nullptr) {
+    CloseHandle(overlapped.hEvent);
+  }
+  if (stop != nullptr) {
+    CloseHandle(stop);
+  }
+  CloseHandle(dir);
+  return armed;
+}
+
+#elif defined(__linux__)
+
+bool FileWatcher::watch_native(std::stop_token st) {
+  auto dir_path = path_.parent_path().empty() ? std::filesystem::path(".") : path_.parent_path();
+  std::string name = path_.filename().string();
+  int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  // Covers in-place writes, touch, and editors that save by renaming a
+  // temporary over the file.
+  constexpr std::uint32_t kMask = IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE |
+                                  IN_MOVED_FROM | IN_MOVED_TO;
+  int wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (wake < 0 || inotify_add_watch(fd, dir_path.c_str(), kMask) < 0) {
+    if (wake >= 0) {
+      close(wake);
+    }
+    close(fd);
+    return false;
+  }
+  ready();
+  {
+    std::stop_callback stop(st, [wake] {
+      std::uint64_t one = 1;
+      [[maybe_unused]] auto written = write(wake, &one, sizeof(one));
+    });
+    alignas(inotify_event) char buffer[4096];
+    bool pending = false;
+    while (!st.stop_requested()) {
+      pollfd fds[] = {{fd, POLLIN, 0}, {wake, POLLIN, 0}};
+      int ready = poll(fds, 2, pending ? static_cast<int>(debounce_.count()) : -1);
+      if (ready < 0 && errno == EINTR) {
+        continue;
+      }
+      if (ready < 0 || (fds[1].revents & POLLIN) != 0) {
+        break;
+      }
+      if (ready == 0) {
+        pending = false;
+        on_change_();
+        continue;
+      }
+      ssize_t length = 0;
+      while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+        for (ssize_t offset = 0; offset < length;) {
+          auto *event = reinterpret_cast<const inotify_event *>(buffer + offset);
+          if ((event->mask & IN_Q_OVERFLOW) != 0 || (event->len > 0 && name == event->name)) {
+            pending = true;
+          }
+          offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+        }
+      }
+    }
+  }
+  close(wake);
+  close(fd);
+  return true;
+}
+
+#elif defined(LIZARD_WATCH_KQUEUE)
+
+// kqueue reports changes to the directory's entries, not to files inside it,
+// so the file itself is watched too and reopened whenever it is replaced.
+bool FileWatcher::watch_native(std::stop_token st) {
+  auto dir_path = path_.parent_path().empty() ? std::filesystem::path(".") : path_.parent_path();
+  int kq = kqueue();
+  if (kq < 0) {
+    return false;
+  }
+  int dir = open(dir_path.c_str(), O_EVTONLY);
+  if (dir < 0) {
+    close(kq);
+    return false;
+  }
+  constexpr uintptr_t kStopIdent = 1;
+  struct kevent changes[2];
+  EV_SET(&changes[0], static_cast<uintptr_t>(dir), EVFILT_VNODE, EV_ADD | EV_CLEAR,
+         NOTE_WRITE | NOTE_DELETE | NOTE_RENAME, 0, nullptr);
+  EV_SET(&changes[1], kStopIdent, EVFILT_USER, EV_ADD | EV_CLEAR, 0, 0, nullptr);
+  if (kevent(kq, changes, 2, nullptr, 0, nullptr) < 0) {
+    close(dir);
+    close(kq);
+    return false;
+  }
+
+  int file = -1;
+  auto watch_file = [&] {
+    if (file >= 0) {
+      close(file); // also drops its kevent
+    }
+    file = open(path_.c_str(), O_EVTONLY);
+    if (file >= 0) {
+      struct kevent change;
+      EV_SET(&change, static_cast<uintptr_t>(file), EVFILT_VNODE, EV_ADD | EV_CLEAR,
+             NOTE_WRITE | NOTE_EXTEND | NOTE_ATTRIB | NOTE_DELETE | NOTE_RENAME, 0, nullptr);
+      kevent(kq, &change, 1, nullptr, 0, nullptr);
+    }
+  };
+  watch_file();
+  ready();
+
+  {
+    std::stop_callback stop(st, [kq] {
+      struct kevent trigger;
+      EV_SET(&trigger, kStopIdent, EVFILT_USER, 0, NOTE_TRIGGER, 0, nullptr);
+      kevent(kq, &trigger, 1, nullptr, 0, nullptr);
+    });
+    bool pending = false;
+    while (!st.stop_requested()) {
+      auto ms = debounce_.count();
+      timespec timeout{static_cast<time_t>(ms / 1000), static_cast<long>(ms % 1000) * 1000000};
+      struct kevent events[4];
+      int ready = kevent(kq, nullptr, 0, events, 4, pending ? &timeout : nullptr);
+      if (ready < 0 && errno == EINTR) {
+        continue;
+      }
+      if (ready < 0) {
+        break;
+      }
+      if (ready == 0) {
+        pending = false;
+        watch_file();
+        on_change_();
+        continue;
+      }
+      for (int i = 0; i < ready; ++i) {
+        if (events[i].filter == EVFILT_USER) {
+          pending = false;
+          break;
+        }
+        pending = true;
+      }
+    }
+  }
+  if (file >= 0) {
+    close(file);
+  }
+  close(dir);
+  close(kq);
+  return true;
+}
+
+#else
+
+bool FileWatcher::watch_native(std::stop_token) { return false; }
+
+#endif
+
+void FileWatcher::watch_polling(std::stop_token st) {
+  auto stamp = [this]() -> std::optional<std::filesystem::file_time_type> {
+    std::error_code ec;
+    auto time = std::filesystem::last_write_time(path_, ec);
+    if (ec) {
+      return std::nullopt;
+    }
+    return time;
+  };
+  auto last = stamp();
+  ready();
+  std::mutex mutex;
+  std::condition_variable_any cv;
+  std::unique_lock lock(mutex);
+  while (!st.stop_requested()) {
+    cv.wait_for(lock, st, poll_interval_, [] { return false; });
+    if (st.stop_requested()) {
+      break;
+    }
+    auto current = stamp();
+    if (current != last) {
+      last = current;
+      on_change_();
+    }
+  }
+}
+
+} // namespace lizard::app
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <stop_token>
+#include <thread>
+
+namespace lizard::app {
+
+// Calls `on_change` on its own thread when `path` is written, replaced,
+// created or removed. Events are debounced: the callback runs once things
+// have been quiet for `debounce`, so an editor's write-rename-chmod sequence
+// is one reload.
+//
+// The parent directory is watched rather than the file, so atomic-rename
+// saves are seen: inotify on Linux, ReadDirectoryChangesW on Windows and
+// kqueue on macOS and the BSDs, all of which sleep until something happens.
+// Elsewhere, or if the platform refuses, the file's timestamp is polled every
+// `poll_interval` instead. The constructor returns once the watch is in
+// place, so no change made after it is missed.
+class FileWatcher {
+public:
+  FileWatcher(std::filesystem::path path, std::function<void()> on_change,
+              std::chrono::milliseconds debounce = std::chrono::milliseconds(50),
+              std::chrono::milliseconds poll_interval = std::chrono::seconds(1));
+  ~FileWatcher();
+
+  FileWatcher(const FileWatcher &) = delete;
+  FileWatcher &operator=(const FileWatcher &) = delete;
+
+private:
+  void run(std::stop_token st);
+  // Returns false, without calling ready(), if notifications could not be
+  // set up.
+  bool watch_native(std::stop_token st);
+  void watch_polling(std::stop_token st);
+  // Releases the constructor.
+  void ready();
+
+  std::filesystem::path path_;
+  std::function<void()> on_change_;
+  std::chrono::milliseconds debounce_;
+  std::chrono::milliseconds poll_interval_;
+  std::promise<void> ready_;
+  bool ready_set_ = false;
+  std::jthread thread_;
+};
+
+} // namespace lizard::app
@@ -0,0 +1,223 @@
+#include "hotkeys.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <string>
+#include <utility>
+
+#include "util/trace.h"
+
+namespace lizard::app {
+
+namespace {
+
+struct ModifierKeys {
+  std::string_view name;
+  int bit;
+  std::array<int, 2> keycodes; // left, right
+};
+
+#ifdef _WIN32
+
+// Virtual-key codes; the low-level hook reports the sided variants.
+constexpr std::array<ModifierKeys, 4> kModifiers = {{
+    {"ctrl", kCtrl, {0xA2, 0xA3}},
+    {"shift", kShift, {0xA0, 0xA1}},
+    {"alt", kAlt, {0xA4, 0xA5}},
+    {"super", kSuper, {0x5B, 0x5C}},
+}};
+constexpr std::array<int, 12> kFunctionKeys = {0x70, 0x71, 0x72, 0x73, 0x74, 0x75,
+                                               0x76, 0x77, 0x78, 0x79, 0x7A, 0x7B};
+
+#elif defined(__APPLE__)
+
+// kVK_* codes from Carbon's Events.h.
+constexpr std::array<ModifierKeys, 4> kModifiers = {{
+    {"ctrl", kCtrl, {59, 62}},
+    {"shift", kShift, {56, 60}},
+    {"alt", kAlt, {58, 61}},
+    {"super", kSuper, {55, 54}},
+}};
+constexpr std::array<int, 12> kFunctionKeys = {122, 120, 99, 118, 96, 97,
+                                               98,  100, 101, 109, 103, 111};
+
+#else
+
+// X keycodes (evdev codes + 8).
+constexpr std::array<ModifierKeys, 4> kModifiers = {{
+    {"ctrl", kCtrl, {37, 105}},
+    {"shift", kShift, {50, 62}},
+    {"alt", kAlt, {64, 108}},
+    {"super", kSuper, {133, 134}},
+}};
+constexpr std::array<int, 12> kFunctionKeys = {67, 68, 69, 70, 71, 72, 73, 74, 75, 76, 95, 96};
+
+#endif
+
+std::string_view trim(std::string_view text) {
+  while (!text.empty() && std::isspace(static_cast<unsigned char>(text.front()))) {
+    text.remove_prefix(1);
+  }
+  while (!text.empty() && std::isspace(static_cast<unsigned char>(text.back()))) {
+    text.remove_suffix(1);
+  }
+  return text;
+}
+
+int modifier_bit(std::string_view name) {
+  if (name == "control") {
+    name = "ctrl";
+  } else if (name == "option") {
+    name = "alt";
+  } else if (name == "cmd" || name == "win") {
+    name = "super";
+  }
+  for (const auto &modifier : kModifiers) {
+    if (modifier.name == name) {
+      return modifier.bit;
+    }
+  }
+  return 0;
+}
+
+std::optional<int> parse_int(std::string_view text) {
+  int value = 0;
+  auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+  if (ec != std::errc{} || end != text.data() + text.size()) {
+    return std::nullopt;
+  }
+  return value;
+}
+
+std::optional<int> key_code(std::string_view name) {
+  if (name.size() > 1 && name.front() == 'f') {
+    auto n = parse_int(name.substr(1));
+    if (n && *n >= 1 && *n <= static_cast<int>(kFunctionKeys.size())) {
+      return kFunctionKeys[static_cast<std::size_t>(*n - 1)];
+    }
+    return std::nullopt;
+  }
+  auto keycode = parse_int(name);
+  if (keycode && *keycode >= 0 && *keycode < static_cast<int>(HotkeyTable::kSize)) {
+    return keycode;
+  }
+  return std::nullopt;
+}
+
+} // namespace
+
+std::vector<Hotkey> default_hotkeys() {
+  return {{HotkeyAction::ToggleEnabled, kCtrl | kShift, kFunctionKeys[8]},
+          {HotkeyAction::ToggleMute, kCtrl | kShift, kFunctionKeys[9]},
+          {HotkeyAction::Reload, kCtrl | kShift, kFunctionKeys[10]}};
+}
+
+std::optional<Hotkey> parse_chord(HotkeyAction action, std::string_view text) {
+  std::string lower(text);
+  std::transform(lower.begin(), lower.end(), lower.begin(),
+                 [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+  Hotkey hotkey;
+  hotkey.action = action;
+  std::string_view rest = lower;
+  while (true) {
+    auto plus = rest.find('+');
+    auto part = trim(rest.substr(0, plus));
+    if (plus == std::string_view::npos) {
+      auto keycode = key_code(part);
+      if (!keycode) {
+        return std::nullopt;
+      }
+      hotkey.keycode = *keycode;
+      return hotkey;
+    }
+    int bit = modifier_bit(part);
+    if (bit == 0) {
+      return std::nullopt;
+    }
+    hotkey.modifiers |= bit;
+    rest.remove_prefix(plus + 1);
+  }
+}
+
+HotkeyTable::HotkeyTable(const std::vector<Hotkey> &hotkeys) : hotkeys_(hotkeys) {
+  for (std::size_t i = 0; i < kModifiers.size(); ++i) {
+    for (int keycode : kModifiers[i].keycodes) {
+      modifier_keys_[i].set(index(keycode));
+    }
+  }
+  for (const auto &hotkey : hotkeys_) {
+    triggers_.set(index(hotkey.keycode));
+  }
+}
+
+int HotkeyTable::modifiers(const Keys &down) const {
+  int held = 0;
+  for (std::size_t i = 0; i < kModifiers.size(); ++i) {
+    if ((down & modifier_keys_[i]).any()) {
+      held |= kModifiers[i].bit;
+    }
+  }
+  return held;
+}
+
+std::optional<HotkeyAction> HotkeyTable::find(int keycode, int modifiers) const {
+  // Later entries win, as with key_rules.
+  for (auto it = hotkeys_.rbegin(); it != hotkeys_.rend(); ++it) {
+    if (it->keycode == keycode && it->modifiers == modifiers) {
+      return it->action;
+    }
+  }
+  return std::nullopt;
+}
+
+HotkeyMatch HotkeyMatcher::feed(const HotkeyTable &table, int keycode, bool pressed) {
+  auto i = HotkeyTable::index(keycode);
+  bool repeat = pressed && down_[i];
+  down_[i] = pressed;
+  if (!pressed || !table.is_trigger(keycode)) {
+    return {};
+  }
+  auto held = down_;
+  held.reset(i);
+  auto action = table.find(keycode, table.modifiers(held));
+  if (!action) {
+    return {};
+  }
+  return {true, repeat ? std::nullopt : action};
+}
+
+HotkeyDispatcher::HotkeyDispatcher(std::function<void(HotkeyAction)> handler)
+    : handler_(std::move(handler)), worker_([this](std::stop_token st) { run(st); }) {}
+
+HotkeyDispatcher::~HotkeyDispatcher() {
+  worker_.request_stop();
+  ready_.release();
+  worker_.join();
+}
+
+void HotkeyDispatcher::post(HotkeyAction action) {
+  if (head_ - tail_.load(std::memory_order_acquire) >= kCapacity) {
+    return;
+  }
+  ring_[head_ % kCapacity] = action;
+  ++head_;
+  ready_.release();
+}
+
+void HotkeyDispatcher::run(std::stop_token st) {
+  LIZARD_TRACE_THREAD("hotkeys");
+  while (true) {
+    ready_.acquire();
+    if (st.stop_requested()) {
+      return;
+    }
+    auto tail = tail_.load(std::memory_order_relaxed);
+    auto action = ring_[tail % kCapacity];
+    tail_.store(tail + 1, std::memory_order_release);
+    LIZARD_TRACE_ZONE("app::HotkeyDispatcher::action");
+    handler_(action);
+  }
+}
+
+} // namespace lizard::app
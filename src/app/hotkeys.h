@@ -0,0 +1,117 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <semaphore>
+#include <stop_token>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace lizard::app {
+
+enum class HotkeyAction { ToggleEnabled, ToggleMute, Reload };
+
+constexpr std::array<std::string_view, 3> enum_names(HotkeyAction) {
+  return {"toggle_enabled", "toggle_mute", "reload"};
+}
+
+// Bits of Hotkey::modifiers. Left and right keys count as the same modifier.
+enum Modifier : int { kCtrl = 1, kShift = 2, kAlt = 4, kSuper = 8 };
+
+// A chord bound to an action: every modifier in `modifiers`, and no others,
+// held while `keycode` goes down.
+struct Hotkey {
+  HotkeyAction action{};
+  int modifiers = 0;
+  int keycode = 0;
+};
+
+// Ctrl+Shift+F9 toggles reactions, Ctrl+Shift+F10 the sound and
+// Ctrl+Shift+F11 reloads the config.
+std::vector<Hotkey> default_hotkeys();
+
+// Parses a chord such as "ctrl+shift+f9". Modifiers are ctrl, shift, alt and
+// super (also control, option, cmd and win); the final key is f1-f12 or a
+// native keycode (0-255). Case is ignored.
+std::optional<Hotkey> parse_chord(HotkeyAction action, std::string_view text);
+
+// The chords compiled into per-key lookup tables, so the hook tests a key
+// against all of them with a few bit operations.
+class HotkeyTable {
+public:
+  // Hook keycodes fit in a byte on every platform (see KeyTable).
+  static constexpr std::size_t kSize = 256;
+  using Keys = std::bitset<kSize>;
+
+  HotkeyTable() : HotkeyTable(std::vector<Hotkey>{}) {}
+  explicit HotkeyTable(const std::vector<Hotkey> &hotkeys);
+
+  // The modifiers held in `down`.
+  int modifiers(const Keys &down) const;
+  bool is_trigger(int keycode) const { return triggers_[index(keycode)]; }
+  // The action bound to `keycode` with exactly `modifiers` held.
+  std::optional<HotkeyAction> find(int keycode, int modifiers) const;
+
+  static std::size_t index(int keycode) { return static_cast<unsigned>(keycode) & (kSize - 1); }
+
+private:
+  // Keys that count as each modifier bit, in bit order.
+  std::array<Keys, 4> modifier_keys_{};
+  Keys triggers_;
+  std::vector<Hotkey> hotkeys_;
+};
+
+// What the hook should do with a key event.
+struct HotkeyMatch {
+  // The key completed a chord, or is a held chord key repeating. The hook
+  // skips its usual reaction.
+  bool consumed = false;
+  // Set on the press that completes a chord, not on its repeats.
+  std::optional<HotkeyAction> action;
+};
+
+// The automaton's state is the set of keys held down; a table maps it and
+// the next event to a match. Fed from the hook thread only.
+class HotkeyMatcher {
+public:
+  HotkeyMatch feed(const HotkeyTable &table, int keycode, bool pressed);
+
+private:
+  HotkeyTable::Keys down_;
+};
+
+// Runs hotkey actions on a worker thread, in the order posted, so the hook
+// never waits on file I/O, audio or the tray.
+class HotkeyDispatcher {
+public:
+  explicit HotkeyDispatcher(std::function<void(HotkeyAction)> handler);
+  // Finishes the action in progress, drops the rest and joins the worker.
+  ~HotkeyDispatcher();
+
+  HotkeyDispatcher(const HotkeyDispatcher &) = delete;
+  HotkeyDispatcher &operator=(const HotkeyDispatcher &) = delete;
+
+  // Lock-free; for the hook thread, the only producer. Drops the action if
+  // the worker is kCapacity behind.
+  void post(HotkeyAction action);
+
+private:
+  static constexpr std::uint32_t kCapacity = 32;
+
+  void run(std::stop_token st);
+
+  std::array<HotkeyAction, kCapacity> ring_{};
+  std::uint32_t head_ = 0;             // next slot post() writes
+  std::atomic<std::uint32_t> tail_{0}; // next slot the worker reads
+  // One count per posted action, plus one to wake the worker for shutdown.
+  std::counting_semaphore<kCapacity + 1> ready_{0};
+  std::function<void(HotkeyAction)> handler_;
+  std::jthread worker_;
+};
+
+} // namespace lizard::app
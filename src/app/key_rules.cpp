@@ -0,0 +1,104 @@
+#include "key_rules.h"
+
+#include <algorithm>
+#include <initializer_list>
+
+namespace lizard::app {
+
+namespace {
+
+bool in(int keycode, std::initializer_list<int> codes) {
+  return std::find(codes.begin(), codes.end(), keycode) != codes.end();
+}
+
+bool between(int keycode, int first, int last) { return keycode >= first && keycode <= last; }
+
+} // namespace
+
+#ifdef _WIN32
+
+// Virtual-key codes.
+bool key_in_class(int keycode, KeyClass key_class) {
+  switch (key_class) {
+  case KeyClass::Modifiers:
+    return between(keycode, 0x10, 0x12) || between(keycode, 0xA0, 0xA5) ||
+           in(keycode, {0x14, 0x5B, 0x5C});
+  case KeyClass::Letters:
+    return between(keycode, 0x41, 0x5A);
+  case KeyClass::Digits:
+    return between(keycode, 0x30, 0x39) || between(keycode, 0x60, 0x69);
+  case KeyClass::Enter:
+    return keycode == 0x0D;
+  case KeyClass::Space:
+    return keycode == 0x20;
+  }
+  return false;
+}
+
+#elif defined(__APPLE__)
+
+// kVK_* codes from Carbon's Events.h, ANSI layout.
+bool key_in_class(int keycode, KeyClass key_class) {
+  switch (key_class) {
+  case KeyClass::Modifiers:
+    return between(keycode, 54, 63);
+  case KeyClass::Letters:
+    return (between(keycode, 0, 17) && keycode != 10) ||
+           in(keycode, {31, 32, 34, 35, 37, 38, 40, 45, 46});
+  case KeyClass::Digits:
+    return in(keycode, {18, 19, 20, 21, 22, 23, 25, 26, 28, 29}) || between(keycode, 82, 89) ||
+           in(keycode, {91, 92});
+  case KeyClass::Enter:
+    return in(keycode, {36, 76});
+  case KeyClass::Space:
+    return keycode == 49;
+  }
+  return false;
+}
+
+#else
+
+// X keycodes (evdev codes + 8), as the X11 hook reports them.
+bool key_in_class(int keycode, KeyClass key_class) {
+  switch (key_class) {
+  case KeyClass::Modifiers:
+    return in(keycode, {37, 50, 62, 64, 66, 105, 108, 133, 134});
+  case KeyClass::Letters:
+    return between(keycode, 24, 33) || between(keycode, 38, 46) || between(keycode, 52, 58);
+  case KeyClass::Digits:
+    return between(keycode, 10, 19) || between(keycode, 79, 81) || between(keycode, 83, 85) ||
+           between(keycode, 87, 90);
+  case KeyClass::Enter:
+    return in(keycode, {36, 104});
+  case KeyClass::Space:
+    return keycode == 65;
+  }
+  return false;
+}
+
+#endif
+
+KeyTable::KeyTable(const std::vector<KeyRule> &rules) {
+  for (const auto &rule : rules) {
+    KeyReaction reaction;
+    reaction.suppress = rule.suppress;
+    reaction.sample = static_cast<std::int16_t>(rule.sample);
+    reaction.badge_scale = static_cast<float>(rule.badge_scale);
+    if (!rule.emoji.empty()) {
+      emoji_sets_.push_back(rule.emoji);
+      reaction.emoji_set = static_cast<std::uint16_t>(emoji_sets_.size());
+    }
+    for (int keycode = 0; keycode < static_cast<int>(kSize); ++keycode) {
+      bool matched = std::find(rule.keycodes.begin(), rule.keycodes.end(), keycode) !=
+                     rule.keycodes.end();
+      for (auto key_class : rule.classes) {
+        matched = matched || key_in_class(keycode, key_class);
+      }
+      if (matched) {
+        reactions_[static_cast<std::size_t>(keycode)] = reaction;
+      }
+    }
+  }
+}
+
+} // namespace lizard::app
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace lizard::app {
+
+// Groups of keys a rule can name instead of listing keycodes. Membership is
+// decided per platform, since the hook reports native keycodes.
+enum class KeyClass { Modifiers, Letters, Digits, Enter, Space };
+
+constexpr std::array<std::string_view, 5> enum_names(KeyClass) {
+  return {"modifiers", "letters", "digits", "enter", "space"};
+}
+
+// One entry of `key_rules`, as written in the file.
+struct KeyRule {
+  std::vector<int> keycodes;
+  std::vector<KeyClass> classes;
+  bool suppress = false;
+  std::filesystem::path sound;
+  // Index of `sound` in sound_samples, or -1 for the usual weighted pick.
+  // Filled in by validation.
+  int sample = -1;
+  std::vector<std::string> emoji;
+  double badge_scale = 1.0;
+};
+
+// What a key does. Kept small, so the table fits in a few cache lines.
+struct KeyReaction {
+  // Index into sound_samples, or -1 for the usual weighted pick.
+  std::int16_t sample = -1;
+  // 1-based index into KeyTable::emoji_sets(), or 0 for the global emoji.
+  std::uint16_t emoji_set = 0;
+  float badge_scale = 1.0f;
+  bool suppress = false;
+};
+
+// Rules compiled into one reaction per keycode, so a key event costs a
+// single indexed load however many rules there are. Where rules overlap,
+// the later one wins.
+class KeyTable {
+public:
+  // Every platform's keycodes fit in a byte: virtual-key codes on Windows,
+  // X keycodes on Linux and kVK codes on macOS.
+  static constexpr std::size_t kSize = 256;
+
+  KeyTable() = default;
+  explicit KeyTable(const std::vector<KeyRule> &rules);
+
+  // Keycodes outside the table get the default reaction rather than wrapping
+  // onto another key's.
+  const KeyReaction &operator[](int keycode) const {
+    if (keycode < 0 || keycode >= static_cast<int>(kSize)) {
+      return kDefault;
+    }
+    return reactions_[static_cast<std::size_t>(keycode)];
+  }
+  const std::vector<std::vector<std::string>> &emoji_sets() const { return emoji_sets_; }
+
+private:
+  static constexpr KeyReaction kDefault{};
+
+  std::array<KeyReaction, kSize> reactions_{};
+  std::vector<std::vector<std::string>> emoji_sets_;
+};
+
+// Whether `keycode` belongs to `key_class` on this platform.
+bool key_in_class(int keycode, KeyClass key_class);
+
+} // namespace lizard::app
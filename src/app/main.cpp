@@ -6,16 +6,19 @@
 #include <optional>
 #include <thread>
 #include <iostream>
+#include <memory>
 
 #include <cxxopts.hpp>
 #include <spdlog/spdlog.h>
 
 #include "app/config.h"
+#include "app/startup.h"
 #include "audio/engine.h"
 #include "hook/keyboard_hook.h"
 #include "platform/tray.hpp"
 #include "platform/window.hpp"
 #include "util/log.h"
+#include "util/trace.h"
 
 #ifdef _WIN32
 #include <windows.h>
@@ -26,27 +29,86 @@
 #include "glad/glad.h"
 #include "overlay/gl_raii.cpp"
 #include "overlay/overlay.cpp"
+#include "overlay/program_cache.cpp"
 #endif
 
+namespace {
+
+lizard::audio::Backend engine_backend(lizard::app::AudioBackend backend) {
+  using lizard::app::AudioBackend;
+  using lizard::audio::Backend;
+  switch (backend) {
+  case AudioBackend::Wasapi:
+    return Backend::wasapi;
+  case AudioBackend::CoreAudio:
+    return Backend::coreaudio;
+  case AudioBackend::Alsa:
+    return Backend::alsa;
+  case AudioBackend::Null:
+    return Backend::null;
+  case AudioBackend::Miniaudio:
+    break;
+  }
+  return Backend::automatic;
+}
+
+lizard::audio::SampleFormat engine_sample_format(lizard::app::SoundPcmFormat format) {
+  return format == lizard::app::SoundPcmFormat::S16 ? lizard::audio::SampleFormat::s16
+                                                    : lizard::audio::SampleFormat::f32;
+}
+
+lizard::audio::CoalesceMode engine_coalesce_mode(lizard::app::SoundCoalesceMode mode) {
+  using lizard::app::SoundCoalesceMode;
+  using lizard::audio::CoalesceMode;
+  switch (mode) {
+  case SoundCoalesceMode::Off:
+    return CoalesceMode::off;
+  case SoundCoalesceMode::Retrigger:
+    return CoalesceMode::retrigger;
+  case SoundCoalesceMode::Boost:
+    break;
+  }
+  return CoalesceMode::boost;
+}
+
+lizard::audio::AudioProfile engine_profile(lizard::app::AudioProfile profile) {
+  return profile == lizard::app::AudioProfile::LowLatency ? lizard::audio::AudioProfile::low_latency
+                                                          : lizard::audio::AudioProfile::standard;
+}
+
+} // namespace
+
 int main(int argc, char **argv) {
+  lizard::app::StartupTimer startup;
   cxxopts::Options opts("lizard-hook", "Keyboard reactive overlay");
   opts.add_options()("config", "Config path", cxxopts::value<std::string>())(
       "log-level", "Logging level",
       cxxopts::value<std::string>())("log-queue", "Logging queue size", cxxopts::value<int>())(
-      "log-workers", "Logging worker count", cxxopts::value<int>())("help", "Show help");
+      "log-workers", "Logging worker count", cxxopts::value<int>())(
+      "trace", "Write a Chrome/Perfetto trace to this path (requires LIZARD_TRACE build)",
+      cxxopts::value<std::string>())("help", "Show help");
   auto result = opts.parse(argc, argv);
   if (result.count("help")) {
     std::cout << opts.help() << "\n";
     return 0;
   }
 
+#ifdef LIZARD_TRACE
+  if (result.count("trace")) {
+    lizard::util::trace::begin_session(result["trace"].as<std::string>());
+  }
+#endif
+  LIZARD_TRACE_THREAD("main");
+
   std::optional<std::filesystem::path> config_path;
   if (result.count("config")) {
     config_path = result["config"].as<std::string>();
   }
 
+  auto config_phase = startup.phase("config");
   auto exe_dir = std::filesystem::canonical(argv[0]).parent_path();
   lizard::app::Config cfg(exe_dir, config_path);
+  config_phase.end();
 
   auto level =
       result.count("log-level") ? result["log-level"].as<std::string>() : cfg.logging_level();
@@ -55,14 +117,65 @@ int main(int argc, char **argv) {
   auto workers = result.count("log-workers")
                      ? static_cast<std::size_t>(result["log-workers"].as<int>())
                      : static_cast<std::size_t>(cfg.logging_worker_count());
-  lizard::util::init_logging(level, queue, workers, cfg.logging_path());
+  auto logging_phase = startup.phase("logging");
+  lizard::util::init_logging(level, queue, workers, cfg.logging_path(), cfg.logging_overflow());
+  logging_phase.end();
+#ifndef LIZARD_TRACE
+  if (result.count("trace")) {
+    spdlog::warn("--trace ignored: this build was made without LIZARD_TRACE");
+  }
+#endif
+
+  // The hook starts before anything it feeds exists, so keys typed while the
+  // app comes up are queued rather than lost.
+  lizard::app::KeyGate key_gate;
+  auto hook_phase = startup.phase("hook");
+#if defined(__linux__)
+  lizard::platform::init_xlib_threads();
+#endif
+  auto hook = hook::KeyboardHook::create(
+      [&](int key, bool pressed) { key_gate.post(key, pressed); }, cfg);
+  hook->start();
+  hook_phase.end();
 
   lizard::audio::Engine engine(static_cast<std::uint32_t>(cfg.max_concurrent_playbacks()));
-  engine.init(cfg.sound_path(), cfg.volume_percent(), cfg.audio_backend(),
-              static_cast<std::uint32_t>(cfg.max_concurrent_playbacks()));
+  auto apply_audio_config = [&] {
+    std::vector<lizard::audio::SampleSpec> samples;
+    for (auto &sample : cfg.sound_samples()) {
+      samples.push_back({std::move(sample.path), sample.weight});
+    }
+    engine.set_samples(std::move(samples),
+                       static_cast<std::size_t>(cfg.sound_pool_budget_mb()) * 1024u * 1024u,
+                       static_cast<std::size_t>(cfg.sound_stream_threshold_mb()) * 1024u * 1024u);
+    engine.set_sample_format(engine_sample_format(cfg.sound_pcm_format()));
+    engine.set_coalescing(engine_coalesce_mode(cfg.sound_coalesce_mode()),
+                          std::chrono::milliseconds(cfg.sound_coalesce_ms()));
+    engine.set_variation(static_cast<float>(cfg.sound_pitch_variation_cents()),
+                         static_cast<float>(cfg.sound_gain_variation_db()));
+    engine.set_profile(engine_profile(cfg.audio_profile()));
+  };
+  apply_audio_config();
+  // Opening the device and decoding the sounds overlap the overlay's setup.
+  std::jthread audio_init([&] {
+    LIZARD_TRACE_THREAD("audio_init");
+    auto phase = startup.phase("audio");
+    engine.init(cfg.sound_path(), cfg.volume_percent(), engine_backend(cfg.audio_backend()),
+                static_cast<std::uint32_t>(cfg.max_concurrent_playbacks()));
+  });
 
   lizard::overlay::Overlay overlay;
+  auto overlay_phase = startup.phase("overlay");
   overlay.init(cfg, cfg.emoji_atlas());
+  overlay_phase.end();
+  audio_init.join();
+  auto update_caret_tracker = [&] {
+    if (cfg.badge_spawn_strategy() == lizard::app::BadgeSpawnStrategy::NearCaret) {
+      lizard::platform::start_caret_tracker();
+    } else {
+      lizard::platform::stop_caret_tracker();
+    }
+  };
+  update_caret_tracker();
   std::jthread overlay_thread([&](std::stop_token st) { overlay.run(st); });
   std::atomic<bool> fullscreen{false};
   std::atomic<bool> enabled{cfg.enabled()};
@@ -71,32 +184,6 @@ int main(int argc, char **argv) {
   lizard::platform::TrayState tray_state{enabled.load(), muted.load(), fullscreen_pause.load(),
                                          lizard::platform::FpsMode::Auto, 60};
 
-#ifdef _WIN32
-  constexpr int KEY_CTRL_L = 0xA2;
-  constexpr int KEY_CTRL_R = 0xA3;
-  constexpr int KEY_SHIFT_L = 0xA0;
-  constexpr int KEY_SHIFT_R = 0xA1;
-  constexpr int KEY_F9 = 0x78;
-  constexpr int KEY_F10 = 0x79;
-  constexpr int KEY_F11 = 0x7A;
-#elif defined(__APPLE__)
-  constexpr int KEY_CTRL_L = 59;
-  constexpr int KEY_CTRL_R = 62;
-  constexpr int KEY_SHIFT_L = 56;
-  constexpr int KEY_SHIFT_R = 60;
-  constexpr int KEY_F9 = 101;
-  constexpr int KEY_F10 = 109;
-  constexpr int KEY_F11 = 103;
-#else
-  constexpr int KEY_CTRL_L = 37;
-  constexpr int KEY_CTRL_R = 105;
-  constexpr int KEY_SHIFT_L = 50;
-  constexpr int KEY_SHIFT_R = 62;
-  constexpr int KEY_F9 = 75;
-  constexpr int KEY_F10 = 76;
-  constexpr int KEY_F11 = 95;
-#endif
-
   auto update_state = [&] {
     bool fs = fullscreen.load();
     bool paused = (!enabled.load()) || (fullscreen_pause.load() && fs);
@@ -110,12 +197,11 @@ int main(int argc, char **argv) {
 
   update_state();
   std::jthread fullscreen_thread([&](std::stop_token st) {
-    using namespace std::chrono_literals;
-    while (!st.stop_requested()) {
-      fullscreen = lizard::platform::fullscreen_window_present();
+    LIZARD_TRACE_THREAD("fullscreen");
+    lizard::platform::watch_fullscreen(st, [&](bool fs) {
+      fullscreen = fs;
       update_state();
-      std::this_thread::sleep_for(500ms);
-    }
+    });
   });
 
   std::atomic<bool> running{true};
@@ -184,81 +270,61 @@ int main(int argc, char **argv) {
 #endif
       },
       [&]() { running = false; }};
+  auto tray_phase = startup.phase("tray");
   lizard::platform::init_tray(tray_state, tray_callbacks);
+  tray_phase.end();
 
-  bool ctrl_down = false;
-  bool shift_down = false;
-  bool f9_down = false;
-  bool f10_down = false;
-  bool f11_down = false;
-  auto hook = hook::KeyboardHook::create(
-      [&](int key, bool pressed) {
-        if (key == KEY_CTRL_L || key == KEY_CTRL_R) {
-          ctrl_down = pressed;
-        } else if (key == KEY_SHIFT_L || key == KEY_SHIFT_R) {
-          shift_down = pressed;
-        } else if (key == KEY_F9) {
-          if (!pressed) {
-            f9_down = false;
-          } else if (ctrl_down && shift_down) {
-            if (!f9_down) {
-              f9_down = true;
-              enabled = !enabled.load();
-              tray_state.enabled = enabled.load();
-              update_state();
-              lizard::platform::update_tray(tray_state);
-            }
-            f9_down = true;
-            return;
-          } else {
-            f9_down = true;
-          }
-        } else if (key == KEY_F10) {
-          if (!pressed) {
-            f10_down = false;
-          } else if (ctrl_down && shift_down) {
-            if (!f10_down) {
-              f10_down = true;
-              muted = !muted.load();
-              tray_state.muted = muted.load();
-              update_state();
-              lizard::platform::update_tray(tray_state);
-            }
-            f10_down = true;
-            return;
-          } else {
-            f10_down = true;
-          }
-        } else if (key == KEY_F11) {
-          if (!pressed) {
-            f11_down = false;
-          } else if (ctrl_down && shift_down) {
-            if (!f11_down) {
-              f11_down = true;
-              cfg.reload();
-              cfg.reload_cv().notify_all();
-            }
-            f11_down = true;
-            return;
-          } else {
-            f11_down = true;
-          }
-        }
+  // Hotkey actions touch files, audio and the tray, so they run on their own
+  // thread rather than in the hook.
+  auto run_hotkey = [&](lizard::app::HotkeyAction action) {
+    switch (action) {
+    case lizard::app::HotkeyAction::ToggleEnabled:
+      enabled = !enabled.load();
+      tray_state.enabled = enabled.load();
+      break;
+    case lizard::app::HotkeyAction::ToggleMute:
+      muted = !muted.load();
+      tray_state.muted = muted.load();
+      break;
+    case lizard::app::HotkeyAction::Reload:
+      cfg.reload();
+      cfg.reload_cv().notify_all();
+      return;
+    }
+    update_state();
+    lizard::platform::update_tray(tray_state);
+  };
+  auto hotkeys = std::make_unique<lizard::app::HotkeyDispatcher>(run_hotkey);
+  lizard::app::HotkeyMatcher hotkey_matcher;
+  auto replayed = key_gate.open([&](int key, bool pressed, bool stale) {
+    auto match = cfg.match_hotkey(hotkey_matcher, key, pressed);
+    if (match.action) {
+      hotkeys->post(*match.action);
+    }
+    if (match.consumed) {
+      return;
+    }
 
-        if (pressed && enabled.load()) {
-          bool paused = fullscreen_pause.load() && fullscreen.load();
-          if (!paused) {
-            if (!muted.load()) {
-              engine.play();
-            }
-            overlay.enqueue_spawn(0.0f, 0.0f);
+    // Keys typed well before startup finished only update hotkey state.
+    if (pressed && !stale && enabled.load()) {
+      bool paused = fullscreen_pause.load() && fullscreen.load();
+      auto reaction = cfg.key_reaction(key);
+      if (!paused && !reaction.suppress) {
+        if (!muted.load()) {
+          if (reaction.sample < 0) {
+            engine.play();
+          } else {
+            engine.play(static_cast<std::size_t>(reaction.sample));
           }
         }
-      },
-      cfg);
-  hook->start();
+        overlay.enqueue_spawn(reaction, 0.0f, 0.0f);
+      }
+    }
+  });
+  spdlog::info("{}; replayed {} key events", startup.summary(), replayed);
 
   std::jthread reload_thread([&](std::stop_token st) {
+    LIZARD_TRACE_THREAD("reload");
     std::mutex m;
     std::unique_lock lk(m);
     while (!st.stop_requested()) {
@@ -266,9 +332,10 @@ int main(int argc, char **argv) {
       if (st.stop_requested()) {
         break;
       }
-      engine.shutdown();
-      engine.init(cfg.sound_path(), cfg.volume_percent(), cfg.audio_backend());
+      apply_audio_config();
+      engine.init(cfg.sound_path(), cfg.volume_percent(), engine_backend(cfg.audio_backend()));
       overlay.refresh_from_config(cfg);
+      update_caret_tracker();
       bool prev_enabled = tray_state.enabled;
       bool prev_muted = tray_state.muted;
       bool prev_fullscreen_pause = tray_state.fullscreen_pause;
@@ -277,8 +344,9 @@ int main(int argc, char **argv) {
       tray_state.enabled = cfg.enabled();
       tray_state.muted = cfg.mute();
       tray_state.fullscreen_pause = cfg.fullscreen_pause();
-      auto new_mode = cfg.fps_mode() == "fixed" ? lizard::platform::FpsMode::Fixed
-                                                 : lizard::platform::FpsMode::Auto;
+      auto new_mode = cfg.fps_mode() == lizard::app::FpsMode::Fixed
+                          ? lizard::platform::FpsMode::Fixed
+                          : lizard::platform::FpsMode::Auto;
       int new_fixed = cfg.fps_fixed();
       tray_state.fps_mode = new_mode;
       tray_state.fps_fixed = new_fixed;
@@ -304,9 +372,14 @@ int main(int argc, char **argv) {
   fullscreen_thread.request_stop();
   overlay_thread.request_stop();
   hook->stop();
+  hotkeys.reset();
   overlay_thread.join();
+  lizard::platform::stop_caret_tracker();
   overlay.shutdown();
   engine.shutdown();
   lizard::platform::shutdown_tray();
+#ifdef LIZARD_TRACE
+  lizard::util::trace::end_session();
+#endif
   return 0;
 }
@@ -0,0 +1,97 @@
+#include "startup.h"
+
+#include <iterator>
+#include <utility>
+
+#include <spdlog/spdlog.h>
+
+#include "util/binlog.h"
+
+namespace lizard::app {
+
+namespace {
+
+double to_ms(StartupTimer::Clock::duration d) {
+  return std::chrono::duration<double, std::milli>(d).count();
+}
+
+} // namespace
+
+void KeyGate::post(int keycode, bool pressed) {
+  if (!open_.load(std::memory_order_acquire)) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!open_.load(std::memory_order_relaxed)) {
+      if (queued_.size() < kCapacity) {
+        queued_.push_back({keycode, pressed, Clock::now()});
+      } else {
+        ++dropped_;
+        LIZARD_LOG_DEBUG("Dropped key {} received during startup", keycode);
+      }
+      return;
+    }
+  }
+  handler_(keycode, pressed, false);
+}
+
+std::size_t KeyGate::open(Handler handler) {
+  // Swapped with queued_, so both keep kCapacity and post() never allocates.
+  std::vector<Event> batch;
+  batch.reserve(kCapacity);
+  std::size_t replayed = 0;
+  std::size_t dropped = 0;
+  handler_ = std::move(handler);
+  while (true) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (queued_.empty()) {
+        dropped = dropped_;
+        open_.store(true, std::memory_order_release);
+        break;
+      }
+      batch.swap(queued_);
+    }
+    auto now = Clock::now();
+    for (const auto &event : batch) {
+      handler_(event.keycode, event.pressed, now - event.time > kStaleAfter);
+    }
+    replayed += batch.size();
+    batch.clear();
+  }
+  if (dropped > 0) {
+    spdlog::warn("Dropped {} key events received during startup", dropped);
+  }
+  return replayed;
+}
+
+StartupTimer::Scope::Scope(StartupTimer &timer, std::string_view name)
+    : timer_(&timer), name_(name), begin_(Clock::now()) {}
+
+void StartupTimer::Scope::end() {
+  if (!timer_) {
+    return;
+  }
+  auto now = Clock::now();
+  std::lock_guard<std::mutex> lock(timer_->mutex_);
+  timer_->phases_.push_back({name_, begin_ - timer_->start_, now - timer_->start_});
+  timer_ = nullptr;
+}
+
+std::vector<StartupTimer::Phase> StartupTimer::phases() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return phases_;
+}
+
+std::string StartupTimer::summary() const {
+  auto elapsed = Clock::now() - start_;
+  std::string text = fmt::format("Started in {:.1f} ms", to_ms(elapsed));
+  auto out = std::back_inserter(text);
+  const char *separator = ": ";
+  for (const auto &phase : phases()) {
+    fmt::format_to(out, "{}{} {:.1f}-{:.1f} ms", separator, phase.name, to_ms(phase.begin),
+                   to_ms(phase.end));
+    separator = ", ";
+  }
+  return text;
+}
+
+} // namespace lizard::app
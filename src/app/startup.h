@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace lizard::app {
+
+// Lets the keyboard hook start before the rest of the app: events that
+// arrive while the gate is closed are queued and replayed, in order, when it
+// opens.
+class KeyGate {
+public:
+  using Clock = std::chrono::steady_clock;
+  // `stale` is set for replayed events older than kStaleAfter. They should
+  // still update key state, but a burst of sounds and badges for keys typed
+  // well before startup finished is noise.
+  using Handler = std::function<void(int keycode, bool pressed, bool stale)>;
+
+  // Half a minute of fast typing (a press and a release per key).
+  static constexpr std::size_t kCapacity = 512;
+  static constexpr std::chrono::milliseconds kStaleAfter{200};
+
+  KeyGate() { queued_.reserve(kCapacity); }
+
+  // For the hook thread. Forwards to the handler once the gate is open;
+  // until then queues the event, or drops it if kCapacity are queued. Never
+  // allocates.
+  void post(int keycode, bool pressed);
+
+  // Replays the queued events to `handler` on the calling thread, then
+  // forwards new ones directly. The queue is swapped out and replayed without
+  // the lock, so post() never waits on the handler; events posted meanwhile
+  // are queued behind it and replayed in the next pass, and the gate only
+  // opens once a pass finds nothing left. Returns how many were replayed.
+  std::size_t open(Handler handler);
+
+private:
+  struct Event {
+    int keycode;
+    bool pressed;
+    Clock::time_point time;
+  };
+
+  std::atomic<bool> open_{false};
+  std::mutex mutex_;
+  std::vector<Event> queued_;
+  std::size_t dropped_ = 0;
+  Handler handler_;
+};
+
+// Wall time of each startup phase, measured from construction. Phases may
+// run on different threads and overlap.
+class StartupTimer {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Phase {
+    std::string_view name;
+    Clock::duration begin{};
+    Clock::duration end{};
+  };
+
+  // Records a phase when end() is called or the scope exits.
+  class Scope {
+  public:
+    Scope(StartupTimer &timer, std::string_view name);
+    ~Scope() { end(); }
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+    void end();
+
+  private:
+    StartupTimer *timer_;
+    std::string_view name_;
+    Clock::time_point begin_;
+  };
+
+  StartupTimer() : start_(Clock::now()) {}
+
+  // `name` must outlive the timer; pass a string literal.
+  [[nodiscard]] Scope phase(std::string_view name) { return Scope(*this, name); }
+
+  // In the order they finished.
+  std::vector<Phase> phases() const;
+
+  // "Started in 212.4 ms: config 0.0-3.1 ms, audio 6.2-131.0 ms, ...".
+  std::string summary() const;
+
+private:
+  Clock::time_point start_;
+  mutable std::mutex mutex_;
+  std::vector<Phase> phases_;
+};
+
+} // namespace lizard::app
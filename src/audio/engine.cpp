@@ -1,6 +1,7 @@
 #include "engine.h"
 
 #include <algorithm>
+#include <cmath>
 #include <filesystem>
 #include <optional>
 #include <string>
@@ -8,6 +9,8 @@
 #include <mutex>
 
 #include "embedded.h"
+#include "util/binlog.h"
+#include "util/trace.h"
 #include <spdlog/spdlog.h>
 
 #if defined(LIZARD_AUDIO_WASAPI)
@@ -27,191 +30,627 @@
 namespace lizard::audio {
 
 namespace {
-struct DecodedSample {
-  std::vector<float> pcm;
-  ma_uint64 frames = 0;
-  ma_uint32 channels = 0;
-  ma_uint32 sampleRate = 0;
-};
-
-std::optional<DecodedSample> load_flac_file(const std::string &path) {
-  drflac *flac = drflac_open_file(path.c_str(), nullptr);
-  if (flac == nullptr) {
-    spdlog::error("Failed to open FLAC file {}", path);
-    return std::nullopt;
-  }
-
-  DecodedSample sample;
-  sample.frames = flac->totalPCMFrameCount;
-  sample.channels = flac->channels;
-  sample.sampleRate = flac->sampleRate;
-  sample.pcm.resize(sample.frames * sample.channels);
-  drflac_read_pcm_frames_f32(flac, sample.frames, sample.pcm.data());
-  drflac_close(flac);
-  return sample;
-}
-
-std::optional<DecodedSample> load_flac_memory(const unsigned char *data, size_t size) {
-  drflac *flac = drflac_open_memory(data, size, nullptr);
-  if (flac == nullptr) {
-    spdlog::error("Failed to open embedded FLAC data");
-    return std::nullopt;
-  }
-
-  DecodedSample sample;
-  sample.frames = flac->totalPCMFrameCount;
-  sample.channels = flac->channels;
-  sample.sampleRate = flac->sampleRate;
-  sample.pcm.resize(sample.frames * sample.channels);
-  drflac_read_pcm_frames_f32(flac, sample.frames, sample.pcm.data());
-  drflac_close(flac);
-  return sample;
+
+constexpr ma_uint32 kLowLatencyPeriodMs = 3;
+constexpr ma_uint32 kLowLatencyPeriods = 2;
+
+#if defined(LIZARD_EMBEDDED_PCM_F32) || defined(LIZARD_EMBEDDED_PCM_S16)
+// The default sound as decoded by the build. The Pcm only borrows the
+// read-only array and the returned pointer owns nothing, so loading it
+// neither decodes nor allocates.
+std::shared_ptr<const Pcm> embedded_pcm() {
+  static const Pcm pcm = [] {
+    namespace assets = lizard::assets;
+    Pcm embedded;
+    embedded.frames = assets::lizard_processed_clean_no_meta_pcm_frames;
+    embedded.channels = assets::lizard_processed_clean_no_meta_pcm_channels;
+    embedded.sampleRate = assets::lizard_processed_clean_no_meta_pcm_sample_rate;
+    std::size_t count = static_cast<std::size_t>(embedded.frames) * embedded.channels;
+#if defined(LIZARD_EMBEDDED_PCM_S16)
+    embedded.format = SampleFormat::s16;
+    embedded.borrowed16 = {assets::lizard_processed_clean_no_meta_pcm, count};
+#else
+    embedded.borrowed = {assets::lizard_processed_clean_no_meta_pcm, count};
+#endif
+    return embedded;
+  }();
+  return std::shared_ptr<const Pcm>(std::shared_ptr<const Pcm>(), &pcm);
 }
+#endif
+
 } // namespace
 
-void Engine::endpoint_callback(ma_context *, ma_device_type deviceType,
-                               ma_endpoint_notification_type notificationType, void *pUserData) {
-  if (deviceType != ma_device_type_playback ||
-      notificationType != ma_endpoint_notification_type_default_changed) {
-    return;
-  }
+Engine::Engine(std::uint32_t maxPlaybacks) : m_maxPlaybacks(maxPlaybacks) {}
 
-  auto *self = static_cast<Engine *>(pUserData);
-  if (self == nullptr) {
-    return;
+Engine::~Engine() {
+  m_reopenThread.request_stop();
+  if (m_reopenThread.joinable()) {
+    m_reopenThread.join();
   }
-
-  std::lock_guard<std::mutex> lock(self->m_mutex);
-  float currentVol = self->m_volume;
-  self->shutdown();
-  self->init(self->m_soundPath, self->m_volumePercent, self->m_backend, self->m_maxPlaybacks);
-  self->set_volume_locked(currentVol);
+  shutdown();
 }
 
-Engine::Engine(std::uint32_t maxPlaybacks) : m_maxPlaybacks(maxPlaybacks) {}
+bool Engine::init(std::optional<std::filesystem::path> sound_path, int volume_percent,
+                  Backend backend, std::uint32_t maxPlaybacks) {
+  std::lock_guard<std::mutex> initLock(m_initMutex);
+  std::unique_ptr<Output> retired;
+  std::vector<SampleSpec> samples;
+  SampleFormat format{};
+  AudioProfile profile{};
+  std::uint32_t voiceCount = 0;
+  bool reload = false;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (maxPlaybacks > 0) {
+      m_maxPlaybacks = maxPlaybacks;
+    }
+    m_soundPath = sound_path;
+    m_volumePercent = volume_percent;
+    m_backend = backend;
+    // The bank outlives the output, so a device change keeps the decoded
+    // samples. They are only converted again if the new device runs at a
+    // different rate or channel count.
+    reload = m_bankDirty || m_bank.size() == 0 || m_loadedPath != sound_path;
+    if (reload) {
+      retired = std::move(m_output);
+    }
+    samples = m_samples;
+    format = m_sampleFormat;
+    profile = m_profile;
+    voiceCount = m_maxPlaybacks;
+  }
+  if (retired) {
+    close_output(std::move(retired));
+  }
+  if (reload) {
+    load_bank(samples, format, sound_path);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_loadedPath = sound_path;
+    m_bankDirty = false;
+  }
+
+  auto output = open_output(backend, profile, voiceCount);
+  if (!output) {
+    return false;
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    retired = std::exchange(m_output, std::move(output));
+    int clampedPercent = std::clamp(volume_percent, 0, 100);
+    set_volume_locked(static_cast<float>(clampedPercent) / 100.0f);
+  }
+  if (retired) {
+    close_output(std::move(retired));
+  }
 
-Engine::~Engine() { shutdown(); }
+  std::lock_guard<std::mutex> lock(m_reopenMutex);
+  if (!m_reopenThread.joinable()) {
+    m_reopenThread = std::jthread([this](std::stop_token st) { reopen_loop(st); });
+  }
+  return true;
+}
 
-bool Engine::init(std::optional<std::filesystem::path> sound_path, int volume_percent,
-                  std::string_view backend, std::uint32_t maxPlaybacks) {
-  if (maxPlaybacks > 0) {
-    m_maxPlaybacks = maxPlaybacks;
+bool Engine::load_bank(const std::vector<SampleSpec> &samples, SampleFormat format,
+                       const std::optional<std::filesystem::path> &soundPath) {
+  m_bank.set_sample_format(format);
+  bool loaded = false;
+  if (!samples.empty()) {
+    loaded = m_bank.load(samples);
+  }
+  if (!loaded && soundPath && std::filesystem::exists(*soundPath)) {
+    loaded = m_bank.load({SampleSpec{*soundPath, 1.0}});
   }
-  m_soundPath = sound_path;
-  m_volumePercent = volume_percent;
-  m_backend = std::string(backend);
+  if (!loaded) {
+#if defined(LIZARD_EMBEDDED_PCM_F32) || defined(LIZARD_EMBEDDED_PCM_S16)
+    loaded = m_bank.load_pcm(embedded_pcm());
+#else
+    loaded = m_bank.load_memory(lizard::assets::lizard_processed_clean_no_meta_flac,
+                                lizard::assets::lizard_processed_clean_no_meta_flac_len);
+#endif
+  }
+  return loaded;
+}
+
+// Builds a complete output without touching m_mutex; only the bank, which
+// locks itself, is shared with the output currently playing.
+std::unique_ptr<Engine::Output> Engine::open_output(Backend backend,
+                                                    AudioProfile profile,
+                                                    std::uint32_t voiceCount) {
+  auto output = std::make_unique<Output>();
+  output->owner = this;
 
   ma_engine_config engineConfig = ma_engine_config_init();
+  engineConfig.notificationCallback = &Engine::notification_callback;
 
   ma_backend maBackend{};
   bool useBackend = true;
-  if (backend == "wasapi") {
+  switch (backend) {
+  case Backend::null:
+    // No device or context: the engine's clock is driven by render().
+    engineConfig.noDevice = MA_TRUE;
+    engineConfig.channels = kNullChannels;
+    engineConfig.sampleRate = kNullSampleRate;
+    output->headless = true;
+    useBackend = false;
+    break;
+  case Backend::wasapi:
     maBackend = ma_backend_wasapi;
-  } else if (backend == "coreaudio") {
+    break;
+  case Backend::coreaudio:
     maBackend = ma_backend_coreaudio;
-  } else if (backend == "alsa") {
+    break;
+  case Backend::alsa:
     maBackend = ma_backend_alsa;
-  } else {
+    break;
+  case Backend::automatic:
     useBackend = false;
+    break;
   }
 
   ma_result result = MA_SUCCESS;
   if (useBackend) {
     ma_context_config contextConfig = ma_context_config_init();
     const ma_backend backends[] = {maBackend};
-    result = ma_context_init(backends, 1, &contextConfig, &m_context);
+    result = ma_context_init(backends, 1, &contextConfig, &output->context);
     if (result != MA_SUCCESS) {
       spdlog::error("ma_context_init failed: {}", result);
-      return false;
+      return nullptr;
     }
-    m_contextInitialized = true;
-    engineConfig.pContext = &m_context;
-    ma_context_set_endpoint_notification_callback(&m_context, Engine::endpoint_callback, this);
+    output->contextInitialized = true;
+    engineConfig.pContext = &output->context;
+  }
+
+  if (profile == AudioProfile::low_latency && !output->headless &&
+      open_low_latency_device(*output)) {
+    engineConfig.pDevice = &output->device;
   }
 
-  result = ma_engine_init(&engineConfig, &m_engine);
+  result = ma_engine_init(&engineConfig, &output->engine);
+  if (result != MA_SUCCESS && output->deviceInitialized) {
+    spdlog::warn("ma_engine_init failed on the low-latency device ({}); using the default device "
+                 "setup",
+                 result);
+    ma_device_uninit(&output->device);
+    output->deviceInitialized = false;
+    engineConfig.pDevice = nullptr;
+    result = ma_engine_init(&engineConfig, &output->engine);
+  }
   if (result != MA_SUCCESS) {
     spdlog::error("ma_engine_init failed: {}", result);
-    if (m_contextInitialized) {
-      ma_context_uninit(&m_context);
-      m_contextInitialized = false;
-    }
-    return false;
+    close_output(std::move(output));
+    return nullptr;
+  }
+  output->engineInitialized = true;
+
+  std::uint32_t deviceChannels = ma_engine_get_channels(&output->engine);
+  std::uint32_t deviceRate = ma_engine_get_sample_rate(&output->engine);
+  report_device(*output);
+
+  // voices -> group -> limiter -> endpoint, so bursts bend instead of clip.
+  result = output->limiter.init(ma_engine_get_node_graph(&output->engine), deviceChannels,
+                                deviceRate, &m_probe);
+  if (result == MA_SUCCESS) {
+    ma_node_attach_output_bus(output->limiter.node(), 0, ma_engine_get_endpoint(&output->engine),
+                              0);
+    result = ma_sound_group_init(&output->engine, 0, nullptr, &output->group);
   }
+  if (result != MA_SUCCESS) {
+    spdlog::error("Failed to set up the mix bus: {}", result);
+    close_output(std::move(output));
+    return nullptr;
+  }
+  output->groupInitialized = true;
+  ma_node_attach_output_bus(&output->group, 0, output->limiter.node(), 0);
 
-  std::optional<DecodedSample> decoded;
-  if (sound_path && std::filesystem::exists(*sound_path)) {
-    decoded = load_flac_file(sound_path->string());
-  } else {
-    decoded = load_flac_memory(lizard::assets::lizard_processed_clean_no_meta_flac,
-                               lizard::assets::lizard_processed_clean_no_meta_flac_len);
+  if (m_bank.set_output_format(deviceChannels, deviceRate)) {
+    spdlog::info("Audio device runs at {} Hz, {} channels; samples will be converted once",
+                 deviceRate, deviceChannels);
   }
-  if (!decoded) {
+  auto initial = m_bank.size() > 0 ? m_bank.prewarm() : nullptr;
+  bool streamsOnly = m_bank.size() > 0 && m_bank.streamed_count() == m_bank.size();
+  if (!initial && !streamsOnly) {
     spdlog::error("Failed to decode audio sample");
-    ma_engine_uninit(&m_engine);
-    if (m_contextInitialized) {
-      ma_context_uninit(&m_context);
-      m_contextInitialized = false;
+    m_bank.clear();
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_bankDirty = true;
     }
-    return false;
+    close_output(std::move(output));
+    return nullptr;
   }
 
-  m_bufferConfig = ma_audio_buffer_config_init(ma_format_f32, decoded->channels, decoded->frames,
-                                               decoded->pcm.data(), nullptr);
-  result = ma_audio_buffer_init(&m_bufferConfig, &m_buffer);
-  if (result != MA_SUCCESS) {
-    spdlog::error("ma_audio_buffer_init failed: {}", result);
-    ma_engine_uninit(&m_engine);
-    if (m_contextInitialized) {
-      ma_context_uninit(&m_context);
-      m_contextInitialized = false;
+  output->voices.resize(voiceCount);
+  for (auto &voice : output->voices) {
+    if (initial) {
+      bind_voice(*output, voice, initial);
+    }
+    open_streams(voice);
+  }
+  // The rest are decoded in the background; until then play() falls back to
+  // a resident sample.
+  m_bank.prefill();
+  return output;
+}
+
+// A device we opened ourselves is stopped before the engine goes away, since
+// its callback reads from the engine, and released after.
+void Engine::close_output(std::unique_ptr<Output> output) {
+  for (auto &voice : output->voices) {
+    release_voice(voice);
+    for (auto &stream : voice.streams) {
+      if (stream) {
+        m_decoder.remove(stream.get());
+      }
+    }
+  }
+  output->voices.clear();
+  output->newest = nullptr;
+  if (output->groupInitialized) {
+    ma_sound_group_uninit(&output->group);
+    output->groupInitialized = false;
+  }
+  output->limiter.uninit();
+  if (output->deviceInitialized) {
+    ma_device_stop(&output->device);
+  }
+  if (output->engineInitialized) {
+    ma_engine_uninit(&output->engine);
+    output->engineInitialized = false;
+  }
+  if (output->deviceInitialized) {
+    ma_device_uninit(&output->device);
+    output->deviceInitialized = false;
+  }
+  if (output->contextInitialized) {
+    ma_context_uninit(&output->context);
+    output->contextInitialized = false;
+  }
+}
+
+void Engine::shutdown() {
+  std::lock_guard<std::mutex> initLock(m_initMutex);
+  std::unique_ptr<Output> output;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    output = std::move(m_output);
+  }
+  if (output) {
+    close_output(std::move(output));
+  }
+  auto measured = m_probe.stats();
+  if (measured.count > 0) {
+    spdlog::info("Trigger-to-mix latency: {:.2f} ms average, {:.2f} ms worst over {} sounds",
+                 measured.averageMs, measured.maxMs, measured.count);
+  }
+  m_probe.reset();
+}
+
+bool Engine::open_low_latency_device(Output &output) {
+  ma_context *context = output.contextInitialized ? &output.context : nullptr;
+  for (ma_share_mode mode : {ma_share_mode_exclusive, ma_share_mode_shared}) {
+    ma_device_config config = ma_device_config_init(ma_device_type_playback);
+    config.playback.format = ma_format_f32;
+    config.playback.shareMode = mode;
+    config.performanceProfile = ma_performance_profile_low_latency;
+    config.periodSizeInMilliseconds = kLowLatencyPeriodMs;
+    config.periods = kLowLatencyPeriods;
+    config.dataCallback = &Engine::device_callback;
+    config.notificationCallback = &Engine::notification_callback;
+    config.pUserData = &output;
+    ma_result result = ma_device_init(context, &config, &output.device);
+    if (result == MA_SUCCESS) {
+      output.deviceInitialized = true;
+      return true;
+    }
+    spdlog::warn("Low-latency {} device unavailable ({}); {}",
+                 mode == ma_share_mode_exclusive ? "exclusive" : "shared", result,
+                 mode == ma_share_mode_exclusive ? "trying shared mode"
+                                                 : "using the default device setup");
+  }
+  return false;
+}
+
+void Engine::report_device(Output &output) {
+  LatencyReport &report = output.report;
+  if (output.headless) {
+    report.sampleRate = ma_engine_get_sample_rate(&output.engine);
+    spdlog::info("Audio output: null backend, {} Hz, {} channels, mixed on demand",
+                 report.sampleRate, ma_engine_get_channels(&output.engine));
+    return;
+  }
+  const ma_device *device = ma_engine_get_device(&output.engine);
+  if (device == nullptr) {
+    return;
+  }
+  report.exclusive = device->playback.shareMode == ma_share_mode_exclusive;
+  report.periodFrames = device->playback.internalPeriodSizeInFrames;
+  report.periods = device->playback.internalPeriods;
+  report.sampleRate = device->playback.internalSampleRate;
+  if (report.sampleRate > 0) {
+    report.bufferMs = 1000.0 * report.periodFrames * report.periods / report.sampleRate;
+  }
+  spdlog::info("Audio device: {} mode, {} periods of {} frames at {} Hz ({:.1f} ms buffered)",
+               report.exclusive ? "exclusive" : "shared", report.periods, report.periodFrames,
+               report.sampleRate, report.bufferMs);
+}
+
+void Engine::device_callback(ma_device *device, void *output, const void *, ma_uint32 frameCount) {
+  auto *self = static_cast<Output *>(device->pUserData);
+  ma_engine_read_pcm_frames(&self->engine, output, frameCount, nullptr);
+}
+
+// Runs on miniaudio's device thread, which must not tear its own device
+// down, so the reopen is handed to a worker. Both the engine's device and
+// ours point pUserData at the Output (the engine is its first member).
+void Engine::notification_callback(const ma_device_notification *notification) {
+  if (notification->type != ma_device_notification_type_rerouted) {
+    return;
+  }
+  auto *output = static_cast<Output *>(notification->pDevice->pUserData);
+  if (output != nullptr && output->owner != nullptr) {
+    output->owner->request_reopen();
+  }
+}
+
+void Engine::request_reopen() {
+  {
+    std::lock_guard<std::mutex> lock(m_reopenMutex);
+    m_reopenPending = true;
+  }
+  m_reopenCv.notify_one();
+}
+
+void Engine::reopen_loop(std::stop_token st) {
+  LIZARD_TRACE_THREAD("audio_reopen");
+  std::unique_lock<std::mutex> lock(m_reopenMutex);
+  while (m_reopenCv.wait(lock, st, [this] { return m_reopenPending; })) {
+    m_reopenPending = false;
+    lock.unlock();
+    std::optional<std::filesystem::path> soundPath;
+    Backend backend{};
+    int volumePercent = 0;
+    {
+      std::lock_guard<std::mutex> engineLock(m_mutex);
+      soundPath = m_soundPath;
+      backend = m_backend;
+      volumePercent = m_volumePercent;
     }
+    spdlog::info("Audio device rerouted; reopening output");
+    init(soundPath, volumePercent, backend);
+    lock.lock();
+  }
+}
+
+void Engine::set_samples(std::vector<SampleSpec> samples, std::size_t poolBudgetBytes,
+                         std::size_t streamThresholdBytes) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (samples != m_samples || streamThresholdBytes != m_streamThreshold) {
+    m_samples = std::move(samples);
+    m_streamThreshold = streamThresholdBytes;
+    m_bank.set_stream_threshold(streamThresholdBytes);
+    m_bankDirty = true;
+  }
+  m_bank.set_budget(poolBudgetBytes);
+}
+
+void Engine::set_coalescing(CoalesceMode mode, std::chrono::milliseconds window) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_coalesceMode = mode;
+  m_coalesceWindow = window;
+}
+
+void Engine::set_variation(float pitchCents, float gainDb) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_pitchCents = std::max(pitchCents, 0.0f);
+  m_gainDb = std::max(gainDb, 0.0f);
+}
+
+void Engine::set_profile(AudioProfile profile) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_profile = profile;
+}
+
+LatencyReport Engine::latency() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  LatencyReport report = m_output ? m_output->report : LatencyReport{};
+  report.triggerToMix = m_probe.stats();
+  return report;
+}
+
+// m_output is only replaced with both locks held, so the init lock alone
+// keeps it alive here while play() carries on under m_mutex.
+std::uint64_t Engine::render(float *out, std::uint32_t frames) {
+  std::lock_guard<std::mutex> initLock(m_initMutex);
+  if (!m_output || !m_output->headless) {
+    return 0;
+  }
+  ma_uint64 rendered = 0;
+  if (ma_engine_read_pcm_frames(&m_output->engine, out, frames, &rendered) != MA_SUCCESS) {
+    return 0;
+  }
+  return rendered;
+}
+
+void Engine::set_sample_format(SampleFormat format) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (format != m_sampleFormat) {
+    m_sampleFormat = format;
+    m_bankDirty = true;
+  }
+}
+
+// Points `voice` at `pcm`. Voices are rebuilt only when the channel count or
+// rate differs from what their sound was initialised with; otherwise the
+// source is pointed at the new sample in place, which also rewinds it and
+// applies the variation. That is safe for a voice the mixer is still reading:
+// the source hands the switch to the audio thread. play() and init() set the
+// volume afterwards.
+bool Engine::bind_voice(Output &output, Voice &voice, std::shared_ptr<const Pcm> pcm,
+                        float cents, float gain) {
+  if (voice.initialized && voice.pcm && voice.pcm->channels == pcm->channels &&
+      voice.pcm->sampleRate == pcm->sampleRate) {
+    voice.source.set(pcm, cents, gain);
+    voice.pcm = std::move(pcm);
+    return true;
+  }
+  release_voice(voice);
+  ma_result result = voice.source.init(pcm, cents, gain);
+  if (result != MA_SUCCESS) {
+    spdlog::error("ma_data_source_init failed: {}", result);
     return false;
   }
+  result = ma_sound_init_from_data_source(&output.engine, voice.source.source(), 0,
+                                          output.mix_group(), &voice.sound);
+  if (result != MA_SUCCESS) {
+    spdlog::error("ma_sound_init_from_data_source failed: {}", result);
+    voice.source.uninit();
+    return false;
+  }
+  voice.pcm = std::move(pcm);
+  voice.initialized = true;
+  return true;
+}
 
-  m_voices.resize(m_maxPlaybacks);
-  for (auto &voice : m_voices) {
-    ma_sound_init_from_data_source(&m_engine, &m_buffer, 0, nullptr, &voice.sound);
+// Registered with the decode thread straight away, so each stream has its
+// first frames decoded before any trigger reaches it.
+void Engine::open_streams(Voice &voice) {
+  if (m_bank.streamed_count() == 0) {
+    return;
   }
-  int clampedPercent = std::clamp(volume_percent, 0, 100);
-  set_volume_locked(static_cast<float>(clampedPercent) / 100.0f);
+  voice.streams.resize(m_bank.size());
+  for (std::size_t sample = 0; sample < voice.streams.size(); ++sample) {
+    if (!m_bank.streamed(sample)) {
+      continue;
+    }
+    auto bytes = m_bank.encoded(sample);
+    voice.streams[sample] = FlacStream::open(bytes.data(), bytes.size());
+    if (!voice.streams[sample]) {
+      spdlog::error("Failed to open stream for sample {}", sample);
+      continue;
+    }
+    m_decoder.add(voice.streams[sample].get());
+  }
+}
+
+// Streamed voices keep their decoder between triggers of the same sample; a
+// retrigger is just a seek, which the stream hands to the decode thread.
+bool Engine::bind_stream(Output &output, Voice &voice, std::size_t sample) {
+  if (voice.initialized && voice.stream && voice.streamSample == sample) {
+    return true;
+  }
+  FlacStream *stream = sample < voice.streams.size() ? voice.streams[sample].get() : nullptr;
+  if (!stream) {
+    return false;
+  }
+  release_voice(voice);
+  ma_result result = ma_sound_init_from_data_source(&output.engine, stream->source(), 0,
+                                                    output.mix_group(), &voice.sound);
+  if (result != MA_SUCCESS) {
+    spdlog::error("ma_sound_init_from_data_source failed: {}", result);
+    return false;
+  }
+  voice.stream = stream;
+  voice.streamSample = sample;
+  voice.initialized = true;
   return true;
 }
 
-void Engine::shutdown() {
-  for (auto &voice : m_voices) {
+// Leaves the voice's streams open and registered; close_output() drops them.
+void Engine::release_voice(Voice &voice) {
+  if (voice.initialized) {
     ma_sound_uninit(&voice.sound);
+    voice.source.uninit();
+    voice.initialized = false;
   }
-  m_voices.clear();
-  ma_audio_buffer_uninit(&m_buffer);
-  ma_engine_uninit(&m_engine);
-  if (m_contextInitialized) {
-    ma_context_uninit(&m_context);
-    m_contextInitialized = false;
+  voice.stream = nullptr;
+  voice.pcm.reset();
+}
+
+// Folds a trigger into the newest voice if it started within the window.
+// The window is anchored at that voice's start, so a held key allocates at
+// most one voice per window however fast it repeats.
+bool Engine::coalesce(Output &output, std::chrono::steady_clock::time_point now) {
+  constexpr float kBoostStep = 1.26f; // +2 dB
+  constexpr float kMaxBoost = 2.0f;   // +6 dB; the limiter handles the rest
+  constexpr ma_uint64 kRetriggerFadeMs = 5;
+
+  Voice *voice = output.newest;
+  if (m_coalesceMode == CoalesceMode::off || voice == nullptr || !voice->initialized ||
+      now - voice->start >= m_coalesceWindow || !ma_sound_is_playing(&voice->sound)) {
+    return false;
+  }
+  if (m_coalesceMode == CoalesceMode::boost) {
+    voice->gain = std::min(voice->gain * kBoostStep, kMaxBoost);
+    ma_sound_set_volume(&voice->sound, m_volume * voice->gain);
+  } else {
+    ma_sound_seek_to_pcm_frame(&voice->sound, 0);
+    ma_sound_set_fade_in_milliseconds(&voice->sound, 0.0f, 1.0f, kRetriggerFadeMs);
   }
+  return true;
 }
 
-void Engine::play() {
+void Engine::play() { trigger(std::nullopt); }
+
+void Engine::play(std::size_t sample) { trigger(sample); }
+
+void Engine::trigger(std::optional<std::size_t> spec) {
+  LIZARD_TRACE_ZONE("audio::Engine::play");
   std::lock_guard<std::mutex> lock(m_mutex);
+  if (!m_output || m_output->voices.empty() || m_bank.size() == 0) {
+    LIZARD_LOG_DEBUG("Trigger skipped: no audio output or samples");
+    return;
+  }
+  Output &output = *m_output;
+  if (coalesce(output, std::chrono::steady_clock::now())) {
+    return;
+  }
+  std::size_t sample = spec ? m_bank.pick(*spec) : m_bank.pick();
+  bool streamed = m_bank.streamed(sample);
+  std::shared_ptr<const Pcm> pcm;
+  if (!streamed) {
+    pcm = m_bank.try_acquire(sample);
+    if (!pcm) {
+      LIZARD_LOG_DEBUG("Trigger skipped: nothing decoded yet for sample {}", sample);
+      return;
+    }
+  }
   auto now = std::chrono::steady_clock::now();
 
   Voice *target = nullptr;
-  for (auto &voice : m_voices) {
-    if (!ma_sound_is_playing(&voice.sound)) {
+  for (auto &voice : output.voices) {
+    if (!voice.initialized || !ma_sound_is_playing(&voice.sound)) {
       target = &voice;
       break;
     }
   }
 
   if (target == nullptr) {
-    target = &*std::min_element(m_voices.begin(), m_voices.end(),
+    target = &*std::min_element(output.voices.begin(), output.voices.end(),
                                 [](const Voice &a, const Voice &b) { return a.start < b.start; });
     ma_sound_stop(&target->sound);
   }
 
+  float cents = 0.0f;
+  float gain = 1.0f;
+  if (!streamed && (m_pitchCents > 0.0f || m_gainDb > 0.0f)) {
+    std::uniform_real_distribution<float> centsDist(-m_pitchCents, m_pitchCents);
+    std::uniform_real_distribution<float> dbDist(-m_gainDb, m_gainDb);
+    cents = centsDist(m_rng);
+    gain = std::pow(10.0f, dbDist(m_rng) / 20.0f);
+  }
+  bool bound = streamed ? bind_stream(output, *target, sample)
+                        : bind_voice(output, *target, std::move(pcm), cents, gain);
+  if (!bound) {
+    LIZARD_LOG_DEBUG("Trigger skipped: voice for sample {} did not bind", sample);
+    return;
+  }
+  target->gain = 1.0f;
+  ma_sound_set_volume(&target->sound, m_volume);
   ma_sound_seek_to_pcm_frame(&target->sound, 0);
   ma_sound_start(&target->sound);
+  m_probe.trigger();
   target->start = now;
+  output.newest = target;
 }
 
 void Engine::set_volume(float vol) {
@@ -222,8 +661,13 @@ void Engine::set_volume(float vol) {
 void Engine::set_volume_locked(float vol) {
   m_volume = std::clamp(vol, 0.0f, 1.0f);
   m_volumePercent = static_cast<int>(m_volume * 100.0f);
-  for (auto &voice : m_voices) {
-    ma_sound_set_volume(&voice.sound, m_volume);
+  if (!m_output) {
+    return;
+  }
+  for (auto &voice : m_output->voices) {
+    if (voice.initialized) {
+      ma_sound_set_volume(&voice.sound, m_volume * voice.gain);
+    }
   }
 }
 
@@ -1,59 +1,196 @@
 #pragma once
 
 #include <chrono>
+#include <condition_variable>
 #include <cstdint>
 #include <filesystem>
+#include <memory>
 #include <optional>
+#include <random>
 #include <string_view>
 #include <string>
+#include <thread>
 #include <vector>
 #include <mutex>
 
-struct ma_engine;
-struct ma_context;
-struct ma_audio_buffer_config;
-struct ma_audio_buffer;
-struct ma_sound;
-enum ma_device_type;
-typedef unsigned int ma_endpoint_notification_type; // forward declaration placeholder
+#include "flac_stream.h"
+#include "latency.h"
+#include "limiter.h"
+#include "miniaudio.h"
+#include "pcm_source.h"
+#include "sound_bank.h"
 
 namespace lizard::audio {
 
+// What play() does when the newest voice started less than the coalescing
+// window ago, e.g. under key auto-repeat.
+enum class CoalesceMode {
+  off,       // always take a voice
+  retrigger, // restart the newest voice with a short fade-in
+  boost,     // leave it playing and raise its gain a step
+};
+
+// How the output device is opened. low_latency asks for the shortest period
+// the backend supports and exclusive mode where it has one, stepping back to
+// shared mode and then to miniaudio's defaults if the device refuses.
+enum class AudioProfile { standard, low_latency };
+
+// Which device API miniaudio uses. automatic lets miniaudio pick; null opens
+// no device at all.
+enum class Backend { automatic, wasapi, coreaudio, alsa, null };
+
+// What the device negotiated, plus how long triggers waited for the mixer.
+// Keypress-to-speaker latency is roughly triggerToMix + bufferMs.
+struct LatencyReport {
+  bool exclusive = false;
+  std::uint32_t periodFrames = 0;
+  std::uint32_t periods = 0;
+  std::uint32_t sampleRate = 0;
+  double bufferMs = 0.0;
+  LatencyProbe::Stats triggerToMix;
+};
+
 class Engine {
 public:
+  // Output format of the "null" backend.
+  static constexpr std::uint32_t kNullChannels = 2;
+  static constexpr std::uint32_t kNullSampleRate = 48000;
+
   Engine(std::uint32_t maxPlaybacks = 16);
   ~Engine();
 
+  // Opens an output device and swaps it in for the current one, if any. The
+  // new device is built without holding the lock play() takes, so key events
+  // keep playing on the old device until a pointer swap. Changing the samples
+  // is the exception: the old device is closed first, since its streams read
+  // from the bank being replaced. When the default device changes, the engine
+  // re-runs this on a background thread.
+  //
+  // Backend::null opens no device at all: the full mix graph is built but
+  // only advances when render() pulls from it.
   bool init(std::optional<std::filesystem::path> sound_path = std::nullopt,
-            int volume_percent = 100, std::string_view backend = "miniaudio",
+            int volume_percent = 100, Backend backend = Backend::automatic,
             std::uint32_t maxPlaybacks = 0);
   void shutdown();
   void play();
+  // Plays the sample at `sample` in the list given to set_samples(), or a
+  // weighted pick if that one could not be loaded.
+  void play(std::size_t sample);
   void set_volume(float vol);
+  // Weighted samples to pick from on each play(), taking precedence over the
+  // single `sound_path` passed to init(). Samples that would decode to more
+  // than `streamThresholdBytes` are streamed. Applied by the next init().
+  void set_samples(std::vector<SampleSpec> samples,
+                   std::size_t poolBudgetBytes = SoundBank::kDefaultBudgetBytes,
+                   std::size_t streamThresholdBytes = SoundBank::kDefaultStreamThresholdBytes);
+  // Resident format for decoded samples. Applied by the next init().
+  void set_sample_format(SampleFormat format);
+  void set_coalescing(CoalesceMode mode, std::chrono::milliseconds window);
+  // Each trigger of a resident sample picks a pitch offset uniformly within
+  // ±`pitchCents` and a gain within ±`gainDb`, so repeats don't sound
+  // mechanical. Streamed samples play unvaried.
+  void set_variation(float pitchCents, float gainDb);
+  // Applied by the next init().
+  void set_profile(AudioProfile profile);
+  LatencyReport latency() const;
+  // Null backend only: mixes the next `frames` interleaved f32 frames into
+  // `out` on the calling thread, exactly as a device callback would, and
+  // advances the engine's clock by that much. Returns the frames rendered,
+  // or 0 if the current output has a device. Serialised with init() but not
+  // with play(), so triggers can be fired from another thread.
+  std::uint64_t render(float *out, std::uint32_t frames);
 
 private:
   void set_volume_locked(float vol);
+  void trigger(std::optional<std::size_t> spec);
 
   struct Voice {
+    PcmSource source;
     ma_sound sound{};
+    std::shared_ptr<const Pcm> pcm;
+    // One decoder per streamed sample, indexed like the bank and opened with
+    // the output, so a trigger only has to pick one. `stream` is the one
+    // bound to `sound`, if any.
+    std::vector<std::unique_ptr<FlacStream>> streams;
+    FlacStream *stream{nullptr};
+    std::size_t streamSample{0};
+    float gain{1.0f};
+    bool initialized{false};
     std::chrono::steady_clock::time_point start{};
   };
 
-  ma_engine m_engine{};
-  ma_context m_context{};
-  bool m_contextInitialized{false};
-  ma_audio_buffer_config m_bufferConfig{};
-  ma_audio_buffer m_buffer{};
-  std::vector<Voice> m_voices;
+  // Everything tied to one output device. It is heap-allocated and never
+  // moved, since miniaudio objects inside it point at each other.
+  struct Output {
+    // Must stay the first member: the device's pUserData points at it.
+    ma_engine engine{};
+    Engine *owner{nullptr};
+    bool engineInitialized{false};
+    ma_context context{};
+    bool contextInitialized{false};
+    ma_device device{};
+    bool deviceInitialized{false};
+    bool headless{false};
+    LimiterNode limiter;
+    ma_sound_group group{};
+    bool groupInitialized{false};
+    std::vector<Voice> voices;
+    Voice *newest{nullptr};
+    LatencyReport report{};
+
+    ma_sound_group *mix_group() { return groupInitialized ? &group : nullptr; }
+  };
+
+  bool load_bank(const std::vector<SampleSpec> &samples, SampleFormat format,
+                 const std::optional<std::filesystem::path> &soundPath);
+  std::unique_ptr<Output> open_output(Backend backend, AudioProfile profile,
+                                      std::uint32_t voiceCount);
+  void close_output(std::unique_ptr<Output> output);
+  bool open_low_latency_device(Output &output);
+  void report_device(Output &output);
+  bool bind_voice(Output &output, Voice &voice, std::shared_ptr<const Pcm> pcm,
+                  float cents = 0.0f, float gain = 1.0f);
+  void open_streams(Voice &voice);
+  bool bind_stream(Output &output, Voice &voice, std::size_t sample);
+  void release_voice(Voice &voice);
+  bool coalesce(Output &output, std::chrono::steady_clock::time_point now);
+  void request_reopen();
+  void reopen_loop(std::stop_token st);
+
+  std::unique_ptr<Output> m_output;
+  AudioProfile m_profile{AudioProfile::standard};
+  LatencyProbe m_probe;
+  SoundBank m_bank;
+  StreamDecoder m_decoder;
+  std::vector<SampleSpec> m_samples;
+  SampleFormat m_sampleFormat{SampleFormat::f32};
+  std::size_t m_streamThreshold{SoundBank::kDefaultStreamThresholdBytes};
+  std::optional<std::filesystem::path> m_loadedPath{};
+  bool m_bankDirty{true};
+  CoalesceMode m_coalesceMode{CoalesceMode::off};
+  std::chrono::milliseconds m_coalesceWindow{0};
+  float m_pitchCents{0.0f};
+  float m_gainDb{0.0f};
+  std::mt19937 m_rng{std::random_device{}()};
   std::uint32_t m_maxPlaybacks = 0;
   float m_volume{1.0f};
   std::optional<std::filesystem::path> m_soundPath{};
   int m_volumePercent{100};
-  std::string m_backend{"miniaudio"};
-  std::mutex m_mutex;
+  Backend m_backend{Backend::automatic};
+  // Guards the members above (the bank and decoder also lock themselves).
+  // play() holds it, so nothing slow runs under it.
+  mutable std::mutex m_mutex;
+  // Serialises init() and shutdown() against each other.
+  std::mutex m_initMutex;
+
+  std::mutex m_reopenMutex;
+  std::condition_variable_any m_reopenCv;
+  bool m_reopenPending{false};
+  std::jthread m_reopenThread;
 
-  static void endpoint_callback(ma_context *pContext, ma_device_type deviceType,
-                                ma_endpoint_notification_type notificationType, void *pUserData);
+  static void device_callback(ma_device *device, void *output, const void *input,
+                              ma_uint32 frameCount);
+  static void notification_callback(const ma_device_notification *notification);
 };
 
 } // namespace lizard::audio
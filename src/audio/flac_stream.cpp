@@ -0,0 +1,269 @@
+#include "flac_stream.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include <spdlog/spdlog.h>
+
+#include "dr_flac.h"
+#include "util/trace.h"
+
+namespace lizard::audio {
+
+namespace {
+
+constexpr ma_uint32 kChunkFrames = 4096;
+constexpr auto kPollInterval = std::chrono::milliseconds(5);
+
+drflac *decoder(void *flac) { return static_cast<drflac *>(flac); }
+
+ma_data_source_vtable make_vtable(
+    ma_result (*onRead)(ma_data_source *, void *, ma_uint64, ma_uint64 *),
+    ma_result (*onSeek)(ma_data_source *, ma_uint64),
+    ma_result (*onGetDataFormat)(ma_data_source *, ma_format *, ma_uint32 *, ma_uint32 *,
+                                 ma_channel *, std::size_t),
+    ma_result (*onGetCursor)(ma_data_source *, ma_uint64 *),
+    ma_result (*onGetLength)(ma_data_source *, ma_uint64 *)) {
+  ma_data_source_vtable vtable{};
+  vtable.onRead = onRead;
+  vtable.onSeek = onSeek;
+  vtable.onGetDataFormat = onGetDataFormat;
+  vtable.onGetCursor = onGetCursor;
+  vtable.onGetLength = onGetLength;
+  return vtable;
+}
+
+} // namespace
+
+std::unique_ptr<FlacStream> FlacStream::open(const unsigned char *data, std::size_t size) {
+  drflac *flac = drflac_open_memory(data, size, nullptr);
+  if (flac == nullptr) {
+    return nullptr;
+  }
+  std::unique_ptr<FlacStream> stream(new FlacStream());
+  stream->m_flac = flac;
+  stream->m_sampleRate = flac->sampleRate;
+  stream->m_totalFrames = flac->totalPCMFrameCount;
+
+  ma_result result =
+      ma_pcm_rb_init(ma_format_f32, flac->channels, kRingFrames, nullptr, nullptr, &stream->m_ring);
+  if (result != MA_SUCCESS) {
+    spdlog::error("ma_pcm_rb_init failed: {}", result);
+    return nullptr;
+  }
+  stream->m_channels = flac->channels;
+
+  static const ma_data_source_vtable vtable =
+      make_vtable(&FlacStream::on_read, &FlacStream::on_seek, &FlacStream::on_get_data_format,
+                  &FlacStream::on_get_cursor, &FlacStream::on_get_length);
+  ma_data_source_config config = ma_data_source_config_init();
+  config.vtable = &vtable;
+  result = ma_data_source_init(&config, &stream->m_source.base);
+  if (result != MA_SUCCESS) {
+    spdlog::error("ma_data_source_init failed: {}", result);
+    return nullptr;
+  }
+  stream->m_source.owner = stream.get();
+  return stream;
+}
+
+FlacStream::~FlacStream() {
+  if (m_source.owner) {
+    ma_data_source_uninit(&m_source.base);
+  }
+  if (m_channels != 0) {
+    ma_pcm_rb_uninit(&m_ring);
+  }
+  if (m_flac) {
+    drflac_close(decoder(m_flac));
+  }
+}
+
+bool FlacStream::fill() {
+  std::uint32_t gen = m_wantGen.load(std::memory_order_acquire);
+  bool progressed = false;
+  if (gen != m_producerGen) {
+    // Stop writing for the old position and let the consumer drain.
+    m_producerGen = gen;
+    m_positioned = false;
+    m_ackGen.store(gen, std::memory_order_release);
+    progressed = true;
+  }
+  if (!m_positioned) {
+    if (m_drainedGen.load(std::memory_order_acquire) != gen) {
+      return progressed;
+    }
+    drflac_seek_to_pcm_frame(decoder(m_flac), m_seekTarget.load(std::memory_order_relaxed));
+    m_positioned = true;
+    m_atEof = false;
+  }
+  if (m_atEof) {
+    return progressed;
+  }
+
+  ma_uint32 budget = kChunkFrames;
+  while (budget > 0) {
+    ma_uint32 frames = std::min(budget, ma_pcm_rb_available_write(&m_ring));
+    if (frames == 0) {
+      break;
+    }
+    void *buffer = nullptr;
+    if (ma_pcm_rb_acquire_write(&m_ring, &frames, &buffer) != MA_SUCCESS || frames == 0) {
+      break;
+    }
+    auto decoded = static_cast<ma_uint32>(
+        drflac_read_pcm_frames_f32(decoder(m_flac), frames, static_cast<float *>(buffer)));
+    ma_pcm_rb_commit_write(&m_ring, decoded);
+    budget -= decoded;
+    progressed = progressed || decoded > 0;
+    if (decoded < frames) {
+      m_atEof = true;
+      m_eofGen.store(gen, std::memory_order_release);
+      break;
+    }
+  }
+  return progressed;
+}
+
+ma_result FlacStream::read(float *out, ma_uint64 frames, ma_uint64 *framesRead) {
+  std::uint32_t gen = m_wantGen.load(std::memory_order_relaxed);
+  if (m_drainedGen.load(std::memory_order_relaxed) != gen &&
+      m_ackGen.load(std::memory_order_acquire) == gen) {
+    // The producer has stopped writing stale frames; throw them away.
+    ma_pcm_rb_seek_read(&m_ring, ma_pcm_rb_available_read(&m_ring));
+    m_drainedGen.store(gen, std::memory_order_release);
+  }
+
+  ma_uint64 done = 0;
+  if (m_drainedGen.load(std::memory_order_relaxed) == gen) {
+    while (done < frames) {
+      auto want = static_cast<ma_uint32>(std::min<ma_uint64>(frames - done, kRingFrames));
+      void *buffer = nullptr;
+      if (ma_pcm_rb_acquire_read(&m_ring, &want, &buffer) != MA_SUCCESS || want == 0) {
+        break;
+      }
+      std::memcpy(out + done * m_channels, buffer, std::size_t(want) * m_channels * sizeof(float));
+      ma_pcm_rb_commit_read(&m_ring, want);
+      done += want;
+    }
+    if (done > 0) {
+      m_consumed = true;
+      m_cursor += done;
+    }
+    if (done < frames && m_eofGen.load(std::memory_order_acquire) == gen &&
+        ma_pcm_rb_available_read(&m_ring) == 0) {
+      *framesRead = done;
+      if (done > 0) {
+        return MA_SUCCESS;
+      }
+      restart_at_end();
+      return MA_AT_END;
+    }
+  }
+
+  // Underrun or a seek still in flight: pad with silence rather than stall.
+  std::fill(out + done * m_channels, out + frames * m_channels, 0.0f);
+  *framesRead = frames;
+  return MA_SUCCESS;
+}
+
+// The ring is empty and the producer is done with this generation, so it can
+// be moved straight back to the start. The next trigger then finds the first
+// frames already decoded and its seek to 0 is free.
+void FlacStream::restart_at_end() {
+  std::uint32_t next = m_wantGen.load(std::memory_order_relaxed) + 1;
+  m_seekTarget.store(0, std::memory_order_relaxed);
+  m_cursor = 0;
+  m_consumed = false;
+  m_drainedGen.store(next, std::memory_order_relaxed);
+  m_wantGen.store(next, std::memory_order_release);
+}
+
+ma_result FlacStream::seek(ma_uint64 frame) {
+  if (!m_consumed && frame == m_seekTarget.load(std::memory_order_relaxed)) {
+    return MA_SUCCESS;
+  }
+  m_seekTarget.store(frame, std::memory_order_relaxed);
+  m_cursor = frame;
+  m_consumed = false;
+  m_wantGen.store(m_wantGen.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  return MA_SUCCESS;
+}
+
+ma_result FlacStream::on_read(ma_data_source *ds, void *out, ma_uint64 frames, ma_uint64 *read) {
+  return static_cast<Source *>(ds)->owner->read(static_cast<float *>(out), frames, read);
+}
+
+ma_result FlacStream::on_seek(ma_data_source *ds, ma_uint64 frame) {
+  return static_cast<Source *>(ds)->owner->seek(frame);
+}
+
+ma_result FlacStream::on_get_data_format(ma_data_source *ds, ma_format *format,
+                                         ma_uint32 *channels, ma_uint32 *sampleRate, ma_channel *,
+                                         std::size_t) {
+  auto *self = static_cast<Source *>(ds)->owner;
+  *format = ma_format_f32;
+  *channels = self->m_channels;
+  *sampleRate = self->m_sampleRate;
+  return MA_SUCCESS;
+}
+
+ma_result FlacStream::on_get_cursor(ma_data_source *ds, ma_uint64 *cursor) {
+  *cursor = static_cast<Source *>(ds)->owner->m_cursor;
+  return MA_SUCCESS;
+}
+
+ma_result FlacStream::on_get_length(ma_data_source *ds, ma_uint64 *length) {
+  *length = static_cast<Source *>(ds)->owner->m_totalFrames;
+  return MA_SUCCESS;
+}
+
+StreamDecoder::~StreamDecoder() {
+  if (m_thread.joinable()) {
+    m_thread.request_stop();
+    m_thread.join();
+  }
+}
+
+void StreamDecoder::add(FlacStream *stream) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_streams.push_back(stream);
+    if (!m_thread.joinable()) {
+      m_thread = std::jthread([this](std::stop_token st) { run(st); });
+    }
+  }
+  m_cv.notify_one();
+}
+
+void StreamDecoder::remove(FlacStream *stream) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_streams.erase(std::remove(m_streams.begin(), m_streams.end(), stream), m_streams.end());
+}
+
+void StreamDecoder::run(std::stop_token st) {
+  LIZARD_TRACE_THREAD("audio_stream");
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (!st.stop_requested()) {
+    bool progressed = false;
+    {
+      LIZARD_TRACE_ZONE("audio::StreamDecoder::fill");
+      for (auto *stream : m_streams) {
+        progressed = stream->fill() || progressed;
+      }
+    }
+    if (progressed) {
+      // Give add()/remove() a chance between passes.
+      lock.unlock();
+      std::this_thread::yield();
+      lock.lock();
+    } else if (m_streams.empty()) {
+      m_cv.wait(lock, st, [this] { return !m_streams.empty(); });
+    } else {
+      m_cv.wait_for(lock, st, kPollInterval, [] { return false; });
+    }
+  }
+}
+
+} // namespace lizard::audio
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "miniaudio.h"
+
+namespace lizard::audio {
+
+// A miniaudio data source that plays a FLAC file without decoding it up front.
+// Each voice owns one stream with its own dr_flac decoder over the shared,
+// memory-mapped file. The decode thread (producer) keeps a ring buffer topped
+// up; the audio thread (consumer) only copies out of it and never blocks.
+//
+// Seeks are requested by the consumer and handed to the producer through
+// generation counters: the producer acknowledges and stops writing, the
+// consumer discards what is left in the ring, and only then does the producer
+// reposition the decoder. Until new frames arrive the voice outputs silence.
+class FlacStream {
+public:
+  // Roughly a third of a second at 48 kHz; enough to ride out scheduling hiccups.
+  static constexpr ma_uint32 kRingFrames = 16384;
+
+  // `data` must stay mapped for the lifetime of the stream.
+  static std::unique_ptr<FlacStream> open(const unsigned char *data, std::size_t size);
+  ~FlacStream();
+
+  FlacStream(const FlacStream &) = delete;
+  FlacStream &operator=(const FlacStream &) = delete;
+
+  ma_data_source *source() { return &m_source.base; }
+  std::uint32_t channels() const { return m_channels; }
+  std::uint32_t sample_rate() const { return m_sampleRate; }
+
+  // Producer step, called from the decode thread only. Returns true if it
+  // made progress and should be called again straight away.
+  bool fill();
+
+private:
+  struct Source {
+    ma_data_source_base base;
+    FlacStream *owner;
+  };
+
+  FlacStream() = default;
+
+  // Consumer side, called from the audio thread through the vtable.
+  ma_result read(float *out, ma_uint64 frames, ma_uint64 *framesRead);
+  ma_result seek(ma_uint64 frame);
+  void restart_at_end();
+
+  static ma_result on_read(ma_data_source *ds, void *out, ma_uint64 frames, ma_uint64 *read);
+  static ma_result on_seek(ma_data_source *ds, ma_uint64 frame);
+  static ma_result on_get_data_format(ma_data_source *ds, ma_format *format, ma_uint32 *channels,
+                                      ma_uint32 *sampleRate, ma_channel *channelMap,
+                                      std::size_t channelMapCap);
+  static ma_result on_get_cursor(ma_data_source *ds, ma_uint64 *cursor);
+  static ma_result on_get_length(ma_data_source *ds, ma_uint64 *length);
+
+  Source m_source{};
+  void *m_flac = nullptr; // drflac, which dr_flac only declares as an anonymous struct
+  ma_pcm_rb m_ring{};
+  std::uint32_t m_channels = 0;
+  std::uint32_t m_sampleRate = 0;
+  ma_uint64 m_totalFrames = 0;
+
+  // Consumer -> producer.
+  std::atomic<std::uint32_t> m_wantGen{0};
+  std::atomic<std::uint32_t> m_drainedGen{0};
+  std::atomic<ma_uint64> m_seekTarget{0};
+  // Producer -> consumer.
+  std::atomic<std::uint32_t> m_ackGen{0};
+  std::atomic<std::uint32_t> m_eofGen{UINT32_MAX};
+
+  // Consumer-owned.
+  ma_uint64 m_cursor = 0;
+  bool m_consumed = false;
+  // Producer-owned.
+  std::uint32_t m_producerGen = 0;
+  bool m_positioned = true;
+  bool m_atEof = false;
+};
+
+// Runs fill() for every registered stream on one background thread. The
+// thread starts with the first stream and polls at a short interval while any
+// are registered, so the audio thread never has to signal it.
+class StreamDecoder {
+public:
+  StreamDecoder() = default;
+  ~StreamDecoder();
+
+  void add(FlacStream *stream);
+  // Returns once the decode thread is no longer touching `stream`.
+  void remove(FlacStream *stream);
+
+private:
+  void run(std::stop_token st);
+
+  std::mutex m_mutex;
+  std::condition_variable_any m_cv;
+  std::vector<FlacStream *> m_streams;
+  std::jthread m_thread;
+};
+
+} // namespace lizard::audio
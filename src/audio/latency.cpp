@@ -0,0 +1,42 @@
+#include "latency.h"
+
+namespace lizard::audio {
+
+void LatencyProbe::trigger() {
+  std::int64_t expected = 0;
+  m_pending.compare_exchange_strong(expected, now_ns(), std::memory_order_relaxed);
+}
+
+void LatencyProbe::mixed() {
+  std::int64_t stamp = m_pending.exchange(0, std::memory_order_relaxed);
+  if (stamp == 0) {
+    return;
+  }
+  std::int64_t waited = now_ns() - stamp;
+  m_totalNs.fetch_add(waited, std::memory_order_relaxed);
+  std::int64_t worst = m_maxNs.load(std::memory_order_relaxed);
+  while (waited > worst &&
+         !m_maxNs.compare_exchange_weak(worst, waited, std::memory_order_relaxed)) {
+  }
+  m_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+LatencyProbe::Stats LatencyProbe::stats() const {
+  Stats stats;
+  stats.count = m_count.load(std::memory_order_relaxed);
+  if (stats.count > 0) {
+    stats.averageMs = static_cast<double>(m_totalNs.load(std::memory_order_relaxed)) / 1e6 /
+                      static_cast<double>(stats.count);
+    stats.maxMs = static_cast<double>(m_maxNs.load(std::memory_order_relaxed)) / 1e6;
+  }
+  return stats;
+}
+
+void LatencyProbe::reset() {
+  m_pending.store(0, std::memory_order_relaxed);
+  m_count.store(0, std::memory_order_relaxed);
+  m_totalNs.store(0, std::memory_order_relaxed);
+  m_maxNs.store(0, std::memory_order_relaxed);
+}
+
+} // namespace lizard::audio
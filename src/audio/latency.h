@@ -0,0 +1,41 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace lizard::audio {
+
+// Measures how long a trigger waits for the mixer. play() stamps the time and
+// the next mix pass on the audio thread records the delay; add the device
+// buffer to that for the full keypress-to-speaker figure. Lock-free, so it is
+// safe to call from the audio callback.
+class LatencyProbe {
+public:
+  struct Stats {
+    std::uint64_t count = 0;
+    double averageMs = 0.0;
+    double maxMs = 0.0;
+  };
+
+  // Only the oldest unmixed trigger is timed; later ones until the next mix
+  // pass would measure the same period.
+  void trigger();
+  void mixed();
+  Stats stats() const;
+  void reset();
+
+private:
+  static std::int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  std::atomic<std::int64_t> m_pending{0};
+  std::atomic<std::uint64_t> m_count{0};
+  std::atomic<std::int64_t> m_totalNs{0};
+  std::atomic<std::int64_t> m_maxNs{0};
+};
+
+} // namespace lizard::audio
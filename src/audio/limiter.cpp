@@ -0,0 +1,93 @@
+#include "limiter.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace lizard::audio {
+
+namespace {
+
+constexpr float kAttackSeconds = 0.001f;
+constexpr float kReleaseSeconds = 0.08f;
+
+// One-pole smoothing coefficient reaching ~63% of a step in `seconds`.
+float coefficient(float seconds, std::uint32_t sampleRate) {
+  return 1.0f - std::exp(-1.0f / (seconds * static_cast<float>(sampleRate)));
+}
+
+float soft_clip(float x) {
+  constexpr float knee = SoftLimiter::kThreshold;
+  float magnitude = std::fabs(x);
+  if (magnitude <= knee) {
+    return x;
+  }
+  float bent = knee + (1.0f - knee) * std::tanh((magnitude - knee) / (1.0f - knee));
+  return std::copysign(bent, x);
+}
+
+} // namespace
+
+void SoftLimiter::configure(std::uint32_t channels, std::uint32_t sampleRate) {
+  m_channels = std::max<std::uint32_t>(channels, 1);
+  m_attack = coefficient(kAttackSeconds, std::max<std::uint32_t>(sampleRate, 1));
+  m_release = coefficient(kReleaseSeconds, std::max<std::uint32_t>(sampleRate, 1));
+  m_gain = 1.0f;
+}
+
+void SoftLimiter::process(const float *in, float *out, std::uint32_t frames) {
+  for (std::uint32_t frame = 0; frame < frames; ++frame) {
+    const float *src = in + static_cast<std::size_t>(frame) * m_channels;
+    float *dst = out + static_cast<std::size_t>(frame) * m_channels;
+    float peak = 0.0f;
+    for (std::uint32_t ch = 0; ch < m_channels; ++ch) {
+      peak = std::max(peak, std::fabs(src[ch]));
+    }
+    float target = peak > kThreshold ? kThreshold / peak : 1.0f;
+    m_gain += (target - m_gain) * (target < m_gain ? m_attack : m_release);
+    for (std::uint32_t ch = 0; ch < m_channels; ++ch) {
+      dst[ch] = soft_clip(src[ch] * m_gain);
+    }
+  }
+}
+
+ma_result LimiterNode::init(ma_node_graph *graph, std::uint32_t channels,
+                            std::uint32_t sampleRate, LatencyProbe *probe) {
+  uninit();
+  static ma_node_vtable vtable = [] {
+    ma_node_vtable v{};
+    v.onProcess = &LimiterNode::on_process;
+    v.inputBusCount = 1;
+    v.outputBusCount = 1;
+    return v;
+  }();
+  m_channels = channels;
+  m_probe = probe;
+  m_limiter.configure(channels, sampleRate);
+  ma_node_config config = ma_node_config_init();
+  config.vtable = &vtable;
+  config.pInputChannels = &m_channels;
+  config.pOutputChannels = &m_channels;
+  ma_result result = ma_node_init(graph, &config, nullptr, &m_base);
+  m_initialized = result == MA_SUCCESS;
+  return result;
+}
+
+void LimiterNode::uninit() {
+  if (m_initialized) {
+    ma_node_uninit(&m_base, nullptr);
+    m_initialized = false;
+  }
+}
+
+void LimiterNode::on_process(ma_node *node, const float **in, ma_uint32 *frameCountIn,
+                             float **out, ma_uint32 *frameCountOut) {
+  auto *self = reinterpret_cast<LimiterNode *>(node);
+  if (self->m_probe) {
+    self->m_probe->mixed();
+  }
+  ma_uint32 frames = std::min(*frameCountIn, *frameCountOut);
+  self->m_limiter.process(in[0], out[0], frames);
+  *frameCountOut = frames;
+}
+
+} // namespace lizard::audio
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+
+#include "latency.h"
+#include "miniaudio.h"
+
+namespace lizard::audio {
+
+// Channel-linked peak limiter followed by a soft clipper. Below the
+// threshold it is transparent; above it the gain rides down within about a
+// millisecond and recovers over ~80 ms, and whatever the envelope misses is
+// bent smoothly under full scale instead of clipping hard.
+class SoftLimiter {
+public:
+  static constexpr float kThreshold = 0.89f; // about -1 dBFS
+
+  void configure(std::uint32_t channels, std::uint32_t sampleRate);
+  void reset() { m_gain = 1.0f; }
+  // `in` and `out` may alias.
+  void process(const float *in, float *out, std::uint32_t frames);
+
+  float gain() const { return m_gain; }
+
+private:
+  std::uint32_t m_channels = 2;
+  float m_attack = 1.0f;
+  float m_release = 1.0f;
+  float m_gain = 1.0f;
+};
+
+// SoftLimiter as a miniaudio node, sitting between the voices' group and the
+// engine endpoint. Every mix pass goes through it, so it also ticks `probe`.
+class LimiterNode {
+public:
+  ma_result init(ma_node_graph *graph, std::uint32_t channels, std::uint32_t sampleRate,
+                 LatencyProbe *probe = nullptr);
+  void uninit();
+  ma_node *node() { return &m_base; }
+
+private:
+  static void on_process(ma_node *node, const float **in, ma_uint32 *frameCountIn, float **out,
+                         ma_uint32 *frameCountOut);
+
+  // Must stay the first member: miniaudio hands back a pointer to it.
+  ma_node_base m_base{};
+  SoftLimiter m_limiter;
+  LatencyProbe *m_probe = nullptr;
+  std::uint32_t m_channels = 0;
+  bool m_initialized = false;
+};
+
+} // namespace lizard::audio
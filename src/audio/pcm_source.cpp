@@ -0,0 +1,207 @@
+#include "pcm_source.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LIZARD_WIDEN_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define LIZARD_WIDEN_NEON
+#include <arm_neon.h>
+#endif
+
+namespace lizard::audio {
+
+namespace {
+
+constexpr float kS16Scale = 1.0f / 32768.0f;
+constexpr float kFractionScale = 1.0f / 4294967296.0f;
+
+float to_float(float sample) { return sample; }
+float to_float(std::int16_t sample) { return static_cast<float>(sample) * kS16Scale; }
+
+PcmSource *self(ma_data_source *ds) { return reinterpret_cast<PcmSource *>(ds); }
+
+} // namespace
+
+void widen_s16(const std::int16_t *in, float *out, std::size_t count) {
+  std::size_t i = 0;
+#if defined(LIZARD_WIDEN_SSE2)
+  const __m128 scale = _mm_set1_ps(kS16Scale);
+  for (; i + 8 <= count; i += 8) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+    // Interleave each sample with itself, then shift the copy back down to
+    // sign-extend into 32 bits.
+    __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+    __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+    _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+    _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+  }
+#elif defined(LIZARD_WIDEN_NEON)
+  for (; i + 8 <= count; i += 8) {
+    int16x8_t v = vld1q_s16(in + i);
+    float32x4_t lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(v)));
+    float32x4_t hi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(v)));
+    vst1q_f32(out + i, vmulq_n_f32(lo, kS16Scale));
+    vst1q_f32(out + i + 4, vmulq_n_f32(hi, kS16Scale));
+  }
+#endif
+  for (; i < count; ++i) {
+    out[i] = static_cast<float>(in[i]) * kS16Scale;
+  }
+}
+
+ma_result PcmSource::init(std::shared_ptr<const Pcm> pcm, float cents, float gain) {
+  uninit();
+  static const ma_data_source_vtable vtable = [] {
+    ma_data_source_vtable v{};
+    v.onRead = &PcmSource::on_read;
+    v.onSeek = &PcmSource::on_seek;
+    v.onGetDataFormat = &PcmSource::on_get_data_format;
+    v.onGetCursor = &PcmSource::on_get_cursor;
+    v.onGetLength = &PcmSource::on_get_length;
+    return v;
+  }();
+  ma_data_source_config config = ma_data_source_config_init();
+  config.vtable = &vtable;
+  ma_result result = ma_data_source_init(&config, &m_base);
+  if (result != MA_SUCCESS) {
+    return result;
+  }
+  m_initialized = true;
+  m_back = 0;
+  m_front = 1;
+  m_middle.store(2, std::memory_order_relaxed);
+  m_slots[m_front].pcm = std::move(pcm);
+  m_pcm = m_slots[m_front].pcm.get();
+  m_position = 0;
+  m_step = step_for(cents);
+  m_gain = gain;
+  return MA_SUCCESS;
+}
+
+void PcmSource::uninit() {
+  if (m_initialized) {
+    ma_data_source_uninit(&m_base);
+    m_initialized = false;
+  }
+  m_slots = {};
+  m_pcm = nullptr;
+  m_position = 0;
+}
+
+void PcmSource::set(std::shared_ptr<const Pcm> pcm, float cents, float gain) {
+  m_slots[m_back] = {std::move(pcm), step_for(cents), gain};
+  m_back = m_middle.exchange(m_back | kFresh, std::memory_order_acq_rel) & ~kFresh;
+  // What comes back is either the audio thread's previous sample or one it
+  // never took; neither is read any more.
+  m_slots[m_back].pcm.reset();
+}
+
+ma_uint64 PcmSource::step_for(float cents) {
+  double ratio = std::exp2(static_cast<double>(cents) / 1200.0);
+  return std::max<ma_uint64>(static_cast<ma_uint64>(ratio * static_cast<double>(kUnityStep)), 1);
+}
+
+void PcmSource::take_pending() {
+  if ((m_middle.load(std::memory_order_relaxed) & kFresh) == 0) {
+    return;
+  }
+  m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & ~kFresh;
+  const Slot &slot = m_slots[m_front];
+  m_pcm = slot.pcm.get();
+  m_position = 0;
+  m_step = slot.step;
+  m_gain = slot.gain;
+}
+
+ma_result PcmSource::read(float *out, ma_uint64 frames, ma_uint64 *framesRead) {
+  take_pending();
+  const Pcm &pcm = *m_pcm;
+  ma_uint64 count = 0;
+  if (m_step != kUnityStep || m_gain != 1.0f) {
+    count = pcm.format == SampleFormat::s16 ? read_varied(pcm.s16().data(), out, frames)
+                                            : read_varied(pcm.f32().data(), out, frames);
+  } else {
+    ma_uint64 cursor = m_position >> 32;
+    count = std::min(frames, pcm.frames - std::min(cursor, pcm.frames));
+    std::size_t offset = static_cast<std::size_t>(cursor) * pcm.channels;
+    std::size_t samples = static_cast<std::size_t>(count) * pcm.channels;
+    if (pcm.format == SampleFormat::s16) {
+      widen_s16(pcm.s16().data() + offset, out, samples);
+    } else if (count > 0) {
+      std::memcpy(out, pcm.f32().data() + offset, samples * sizeof(float));
+    }
+    m_position += count << 32;
+  }
+  *framesRead = count;
+  return count == 0 ? MA_AT_END : MA_SUCCESS;
+}
+
+// Linear interpolation between neighbouring frames; the last frame is held
+// for the final fraction rather than reading past the end.
+template <typename T>
+ma_uint64 PcmSource::read_varied(const T *in, float *out, ma_uint64 frames) {
+  const Pcm &pcm = *m_pcm;
+  const std::uint32_t channels = pcm.channels;
+  const ma_uint64 end = pcm.frames << 32;
+  const ma_uint64 last = pcm.frames > 0 ? pcm.frames - 1 : 0;
+  ma_uint64 count = 0;
+  for (; count < frames && m_position < end; ++count, m_position += m_step) {
+    ma_uint64 index = m_position >> 32;
+    float t = static_cast<float>(m_position & 0xffffffffu) * kFractionScale;
+    const T *a = in + static_cast<std::size_t>(index) * channels;
+    const T *b = in + static_cast<std::size_t>(std::min(index + 1, last)) * channels;
+    float *dst = out + static_cast<std::size_t>(count) * channels;
+    for (std::uint32_t ch = 0; ch < channels; ++ch) {
+      float x = to_float(a[ch]);
+      dst[ch] = (x + (to_float(b[ch]) - x) * t) * m_gain;
+    }
+  }
+  return count;
+}
+
+ma_result PcmSource::on_read(ma_data_source *ds, void *out, ma_uint64 frames, ma_uint64 *read) {
+  return self(ds)->read(static_cast<float *>(out), frames, read);
+}
+
+ma_result PcmSource::on_seek(ma_data_source *ds, ma_uint64 frame) {
+  auto *source = self(ds);
+  source->take_pending();
+  ma_uint64 length = 0;
+  on_get_length(ds, &length);
+  if (frame > length) {
+    return MA_INVALID_ARGS;
+  }
+  source->m_position = frame * source->m_step;
+  return MA_SUCCESS;
+}
+
+ma_result PcmSource::on_get_data_format(ma_data_source *ds, ma_format *format,
+                                        ma_uint32 *channels, ma_uint32 *sampleRate, ma_channel *,
+                                        std::size_t) {
+  const Pcm &pcm = *self(ds)->m_pcm;
+  *format = ma_format_f32;
+  *channels = pcm.channels;
+  *sampleRate = pcm.sampleRate;
+  return MA_SUCCESS;
+}
+
+ma_result PcmSource::on_get_cursor(ma_data_source *ds, ma_uint64 *cursor) {
+  auto *source = self(ds);
+  source->take_pending();
+  *cursor = source->m_position / source->m_step;
+  return MA_SUCCESS;
+}
+
+ma_result PcmSource::on_get_length(ma_data_source *ds, ma_uint64 *length) {
+  auto *source = self(ds);
+  source->take_pending();
+  *length = ((source->m_pcm->frames << 32) + source->m_step - 1) / source->m_step;
+  return MA_SUCCESS;
+}
+
+} // namespace lizard::audio
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "miniaudio.h"
+#include "sound_bank.h"
+
+namespace lizard::audio {
+
+// A miniaudio data source over a resident Pcm that always produces f32, so the
+// engine never inserts a format converter. s16 samples are widened in read()
+// with widen_s16(); f32 samples are copied straight through.
+//
+// It is also the voice's mixer stage for per-trigger variation: a pitch offset
+// steps through the shared PCM at a fractional rate with linear
+// interpolation, and the gain is folded into the same pass. That costs about
+// the same per voice as the plain copy, where ma_sound_set_pitch() would run
+// miniaudio's filtered resampler on each voice. Cursor, length and seek
+// positions are in output frames.
+//
+// Like the miniaudio objects it sits next to in a voice, it has explicit
+// init()/uninit() and must not be moved while initialised. The data source
+// callbacks run on the audio thread; init() and uninit() only while no sound
+// reads the source, set() from one other thread at any time.
+class PcmSource {
+public:
+  PcmSource() = default;
+  // For the voice list growing before init(); an uninitialised source has no
+  // state worth carrying over.
+  PcmSource(PcmSource &&) noexcept {}
+
+  // Plays `pcm` `cents` sharp (negative: flat) at `gain`.
+  ma_result init(std::shared_ptr<const Pcm> pcm, float cents = 0.0f, float gain = 1.0f);
+  void uninit();
+  // Switches to `pcm`, which must have the same channel count and rate, and
+  // rewinds with the given variation. The audio thread may be mid-read, so
+  // the switch is handed over and takes effect at its next read or seek; the
+  // sample it was reading is kept alive until then.
+  void set(std::shared_ptr<const Pcm> pcm, float cents = 0.0f, float gain = 1.0f);
+
+  ma_data_source *source() { return &m_base; }
+
+private:
+  // Playback position and step are 32.32 fixed point, in source frames.
+  static constexpr ma_uint64 kUnityStep = ma_uint64(1) << 32;
+
+  static ma_uint64 step_for(float cents);
+
+  // Audio thread: adopts the sample set() handed over, if there is one.
+  void take_pending();
+  ma_result read(float *out, ma_uint64 frames, ma_uint64 *framesRead);
+  template <typename T> ma_uint64 read_varied(const T *in, float *out, ma_uint64 frames);
+
+  static ma_result on_read(ma_data_source *ds, void *out, ma_uint64 frames, ma_uint64 *read);
+  static ma_result on_seek(ma_data_source *ds, ma_uint64 frame);
+  static ma_result on_get_data_format(ma_data_source *ds, ma_format *format, ma_uint32 *channels,
+                                      ma_uint32 *sampleRate, ma_channel *channelMap,
+                                      std::size_t channelMapCap);
+  static ma_result on_get_cursor(ma_data_source *ds, ma_uint64 *cursor);
+  static ma_result on_get_length(ma_data_source *ds, ma_uint64 *length);
+
+  // Must stay the first member: miniaudio hands back a pointer to it.
+  ma_data_source_base m_base{};
+  // What set() hands to the audio thread.
+  struct Slot {
+    std::shared_ptr<const Pcm> pcm;
+    ma_uint64 step = kUnityStep;
+    float gain = 1.0f;
+  };
+  // Triple buffer: set() owns m_slots[m_back], the audio thread owns
+  // m_slots[m_front], and m_middle holds the third slot's index, with kFresh
+  // set while it carries a switch the audio thread has not taken.
+  static constexpr unsigned kFresh = 4;
+  std::array<Slot, 3> m_slots;
+  unsigned m_back = 0;
+  unsigned m_front = 1;
+  std::atomic<unsigned> m_middle{2};
+  // Audio-thread state.
+  const Pcm *m_pcm = nullptr;
+  ma_uint64 m_position = 0;
+  ma_uint64 m_step = kUnityStep;
+  float m_gain = 1.0f;
+  bool m_initialized = false;
+};
+
+// Converts `count` s16 samples to f32 in [-1, 1), scaling by 1/32768 like
+// miniaudio does. Uses SSE2 or NEON when available.
+void widen_s16(const std::int16_t *in, float *out, std::size_t count);
+
+} // namespace lizard::audio
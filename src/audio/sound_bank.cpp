@@ -0,0 +1,653 @@
+#include "sound_bank.h"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <string>
+#include <utility>
+
+#include <spdlog/spdlog.h>
+
+#include "dr_flac.h"
+#include "miniaudio.h"
+#include "util/binlog.h"
+#include "util/trace.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace lizard::audio {
+
+std::optional<MappedFile> MappedFile::open(const std::filesystem::path &path) {
+  MappedFile mapped;
+#ifdef _WIN32
+  HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return std::nullopt;
+  }
+  LARGE_INTEGER size{};
+  if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+    CloseHandle(file);
+    return std::nullopt;
+  }
+  HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!mapping) {
+    CloseHandle(file);
+    return std::nullopt;
+  }
+  void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (!view) {
+    CloseHandle(mapping);
+    CloseHandle(file);
+    return std::nullopt;
+  }
+  mapped.m_file = file;
+  mapped.m_mapping = mapping;
+  mapped.m_data = static_cast<const unsigned char *>(view);
+  mapped.m_size = static_cast<std::size_t>(size.QuadPart);
+#else
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return std::nullopt;
+  }
+  struct stat st {};
+  if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+    ::close(fd);
+    return std::nullopt;
+  }
+  void *view = mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (view == MAP_FAILED) {
+    return std::nullopt;
+  }
+  mapped.m_data = static_cast<const unsigned char *>(view);
+  mapped.m_size = static_cast<std::size_t>(st.st_size);
+#endif
+  return mapped;
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept { *this = std::move(other); }
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+  if (this != &other) {
+    reset();
+    m_data = std::exchange(other.m_data, nullptr);
+    m_size = std::exchange(other.m_size, 0);
+#ifdef _WIN32
+    m_file = std::exchange(other.m_file, nullptr);
+    m_mapping = std::exchange(other.m_mapping, nullptr);
+#endif
+  }
+  return *this;
+}
+
+MappedFile::~MappedFile() { reset(); }
+
+void MappedFile::reset() {
+#ifdef _WIN32
+  if (m_data) {
+    UnmapViewOfFile(m_data);
+  }
+  if (m_mapping) {
+    CloseHandle(m_mapping);
+  }
+  if (m_file) {
+    CloseHandle(m_file);
+  }
+  m_file = nullptr;
+  m_mapping = nullptr;
+#else
+  if (m_data) {
+    munmap(const_cast<unsigned char *>(m_data), m_size);
+  }
+#endif
+  m_data = nullptr;
+  m_size = 0;
+}
+
+AliasTable::AliasTable(const std::vector<double> &weights) {
+  const std::size_t n = weights.size();
+  if (n == 0) {
+    return;
+  }
+  double total = std::accumulate(weights.begin(), weights.end(), 0.0);
+  m_prob.assign(n, 1.0);
+  m_alias.resize(n);
+  std::iota(m_alias.begin(), m_alias.end(), 0u);
+  if (total <= 0.0) {
+    return;
+  }
+
+  std::vector<double> scaled(n);
+  std::vector<std::uint32_t> small;
+  std::vector<std::uint32_t> large;
+  for (std::size_t i = 0; i < n; ++i) {
+    scaled[i] = weights[i] * static_cast<double>(n) / total;
+    (scaled[i] < 1.0 ? small : large).push_back(static_cast<std::uint32_t>(i));
+  }
+  while (!small.empty() && !large.empty()) {
+    std::uint32_t s = small.back();
+    small.pop_back();
+    std::uint32_t l = large.back();
+    m_prob[s] = scaled[s];
+    m_alias[s] = l;
+    scaled[l] = (scaled[l] + scaled[s]) - 1.0;
+    if (scaled[l] < 1.0) {
+      large.pop_back();
+      small.push_back(l);
+    }
+  }
+  // Whatever remains is 1 up to rounding error.
+  for (std::uint32_t i : large) {
+    m_prob[i] = 1.0;
+  }
+  for (std::uint32_t i : small) {
+    m_prob[i] = 1.0;
+  }
+}
+
+std::size_t AliasTable::pick(std::mt19937 &rng) const {
+  std::uniform_int_distribution<std::size_t> column(0, m_prob.size() - 1);
+  std::uniform_real_distribution<double> coin(0.0, 1.0);
+  std::size_t i = column(rng);
+  return coin(rng) < m_prob[i] ? i : m_alias[i];
+}
+
+std::optional<Pcm> decode_flac(const unsigned char *data, std::size_t size,
+                               SampleFormat format) {
+  LIZARD_TRACE_ZONE("audio::decode_flac");
+  drflac *flac = drflac_open_memory(data, size, nullptr);
+  if (flac == nullptr) {
+    return std::nullopt;
+  }
+  Pcm pcm;
+  pcm.format = format;
+  pcm.frames = flac->totalPCMFrameCount;
+  pcm.channels = flac->channels;
+  pcm.sampleRate = flac->sampleRate;
+  if (format == SampleFormat::s16) {
+    pcm.samples16.resize(pcm.frames * pcm.channels);
+    pcm.frames = drflac_read_pcm_frames_s16(flac, pcm.frames, pcm.samples16.data());
+    pcm.samples16.resize(pcm.frames * pcm.channels);
+  } else {
+    pcm.samples.resize(pcm.frames * pcm.channels);
+    pcm.frames = drflac_read_pcm_frames_f32(flac, pcm.frames, pcm.samples.data());
+    pcm.samples.resize(pcm.frames * pcm.channels);
+  }
+  drflac_close(flac);
+  return pcm;
+}
+
+namespace {
+
+template <typename T>
+std::uint64_t run_converter(ma_data_converter &converter, std::span<const T> in,
+                            std::uint32_t channelsIn, std::vector<T> &out,
+                            std::uint32_t channelsOut) {
+  // Trailing silence flushes the samples still held by the low-pass filter.
+  const std::vector<T> silence(
+      static_cast<std::size_t>(ma_data_converter_get_input_latency(&converter)) * channelsIn, T{});
+  std::uint64_t produced = 0;
+  for (std::span<const T> chunk : {in, std::span<const T>(silence)}) {
+    std::uint64_t offset = 0;
+    std::uint64_t frames = chunk.size() / channelsIn;
+    while (offset < frames) {
+      std::uint64_t room = out.size() / channelsOut - produced;
+      if (room == 0) {
+        out.resize(out.size() + 4096 * channelsOut);
+        room = 4096;
+      }
+      ma_uint64 frameCountIn = frames - offset;
+      ma_uint64 frameCountOut = room;
+      if (ma_data_converter_process_pcm_frames(&converter, chunk.data() + offset * channelsIn,
+                                               &frameCountIn, out.data() + produced * channelsOut,
+                                               &frameCountOut) != MA_SUCCESS ||
+          (frameCountIn == 0 && frameCountOut == 0)) {
+        return produced;
+      }
+      offset += frameCountIn;
+      produced += frameCountOut;
+    }
+  }
+  return produced;
+}
+
+} // namespace
+
+std::optional<Pcm> convert_pcm(const Pcm &pcm, std::uint32_t channels, std::uint32_t sampleRate) {
+  LIZARD_TRACE_ZONE("audio::convert_pcm");
+  ma_format format = pcm.format == SampleFormat::s16 ? ma_format_s16 : ma_format_f32;
+  ma_data_converter_config config = ma_data_converter_config_init(
+      format, format, pcm.channels, channels, pcm.sampleRate, sampleRate);
+  config.resampling.algorithm = ma_resample_algorithm_linear;
+  config.resampling.linear.lpfOrder = MA_MAX_FILTER_ORDER;
+  ma_data_converter converter;
+  if (ma_data_converter_init(&config, nullptr, &converter) != MA_SUCCESS) {
+    return std::nullopt;
+  }
+  ma_uint64 expected = 0;
+  ma_data_converter_get_expected_output_frame_count(&converter, pcm.frames, &expected);
+  expected += ma_data_converter_get_output_latency(&converter);
+
+  Pcm out;
+  out.format = pcm.format;
+  out.channels = channels;
+  out.sampleRate = sampleRate;
+  if (pcm.format == SampleFormat::s16) {
+    out.samples16.resize(static_cast<std::size_t>(expected) * channels);
+    out.frames = run_converter(converter, pcm.s16(), pcm.channels, out.samples16, channels);
+    out.samples16.resize(static_cast<std::size_t>(out.frames) * channels);
+  } else {
+    out.samples.resize(static_cast<std::size_t>(expected) * channels);
+    out.frames = run_converter(converter, pcm.f32(), pcm.channels, out.samples, channels);
+    out.samples.resize(static_cast<std::size_t>(out.frames) * channels);
+  }
+  ma_data_converter_uninit(&converter, nullptr);
+  return out;
+}
+
+std::optional<std::size_t> decoded_size(const unsigned char *data, std::size_t size) {
+  drflac *flac = drflac_open_memory(data, size, nullptr);
+  if (flac == nullptr) {
+    return std::nullopt;
+  }
+  auto bytes = static_cast<std::size_t>(flac->totalPCMFrameCount * flac->channels * sizeof(float));
+  drflac_close(flac);
+  return bytes;
+}
+
+SoundBank::SoundBank(std::size_t budgetBytes, std::chrono::milliseconds evictionGrace)
+    : m_budget(budgetBytes), m_evictionGrace(evictionGrace) {}
+
+bool SoundBank::load(const std::vector<SampleSpec> &samples) {
+  std::size_t threshold = 0;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    threshold = m_streamThreshold;
+  }
+  std::vector<Entry> entries;
+  entries.reserve(samples.size());
+  std::vector<std::size_t> bySpec(samples.size(), std::numeric_limits<std::size_t>::max());
+  for (std::size_t i = 0; i < samples.size(); ++i) {
+    const auto &spec = samples[i];
+    if (!(spec.weight > 0.0)) {
+      spdlog::warn("Skipping sample {} with non-positive weight {}", spec.path.string(),
+                   spec.weight);
+      continue;
+    }
+    auto file = MappedFile::open(spec.path);
+    if (!file) {
+      spdlog::warn("Failed to map sample {}", spec.path.string());
+      continue;
+    }
+    auto bytes = decoded_size(file->data(), file->size());
+    if (!bytes) {
+      spdlog::warn("Sample {} is not a readable FLAC file", spec.path.string());
+      continue;
+    }
+    Entry entry;
+    entry.data = file->data();
+    entry.size = file->size();
+    entry.streamed = *bytes > threshold;
+    if (entry.streamed) {
+      spdlog::info("Streaming sample {} ({} MiB decoded)", spec.path.string(),
+                   *bytes / (1024 * 1024));
+    }
+    entry.file = std::make_shared<const MappedFile>(std::move(*file));
+    entry.weight = spec.weight;
+    bySpec[i] = entries.size();
+    entries.push_back(std::move(entry));
+  }
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_entries = std::move(entries);
+  m_bySpec = std::move(bySpec);
+  rebuild_locked();
+  return !m_entries.empty();
+}
+
+bool SoundBank::load_memory(const unsigned char *data, std::size_t size) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_entries.clear();
+  m_bySpec.clear();
+  if (data && size > 0) {
+    Entry entry;
+    entry.data = data;
+    entry.size = size;
+    m_entries.push_back(std::move(entry));
+  }
+  rebuild_locked();
+  return !m_entries.empty();
+}
+
+bool SoundBank::load_pcm(std::shared_ptr<const Pcm> pcm) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_entries.clear();
+  m_bySpec.clear();
+  if (pcm && pcm->frames > 0) {
+    Entry entry;
+    entry.predecoded = std::move(pcm);
+    m_entries.push_back(std::move(entry));
+  }
+  rebuild_locked();
+  return !m_entries.empty();
+}
+
+void SoundBank::clear() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_entries.clear();
+  m_bySpec.clear();
+  rebuild_locked();
+}
+
+void SoundBank::set_budget(std::size_t budgetBytes) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_budget = budgetBytes;
+}
+
+void SoundBank::set_stream_threshold(std::size_t decodedBytes) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_streamThreshold = decodedBytes;
+}
+
+void SoundBank::set_sample_format(SampleFormat format) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_format = format;
+}
+
+bool SoundBank::set_output_format(std::uint32_t channels, std::uint32_t sampleRate) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (channels == m_outChannels && sampleRate == m_outRate) {
+    return false;
+  }
+  m_outChannels = channels;
+  m_outRate = sampleRate;
+  reset_pool_locked();
+  return true;
+}
+
+void SoundBank::rebuild_locked() {
+  std::vector<double> weights;
+  weights.reserve(m_entries.size());
+  for (const auto &entry : m_entries) {
+    weights.push_back(entry.weight);
+  }
+  m_alias = AliasTable(weights);
+  reset_pool_locked();
+  // Each entry is queued at most once, so try_acquire() never allocates.
+  m_pending.reserve(m_entries.size());
+}
+
+void SoundBank::reset_pool_locked() {
+  for (auto &entry : m_entries) {
+    entry.pcm.reset();
+    entry.queued = false;
+    entry.wanted = false;
+  }
+  m_resident = 0;
+  m_pending.clear();
+  ++m_generation;
+}
+
+std::size_t SoundBank::size() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_entries.size();
+}
+
+std::size_t SoundBank::resident_bytes() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_resident;
+}
+
+std::size_t SoundBank::streamed_count() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return static_cast<std::size_t>(std::count_if(
+      m_entries.begin(), m_entries.end(), [](const Entry &entry) { return entry.streamed; }));
+}
+
+bool SoundBank::streamed(std::size_t index) const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return index < m_entries.size() && m_entries[index].streamed;
+}
+
+std::span<const unsigned char> SoundBank::encoded(std::size_t index) const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (index >= m_entries.size()) {
+    return {};
+  }
+  return {m_entries[index].data, m_entries[index].size};
+}
+
+std::size_t SoundBank::pick() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_alias.pick(m_rng);
+}
+
+std::size_t SoundBank::pick(std::size_t spec) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (spec < m_bySpec.size() && m_bySpec[spec] < m_entries.size()) {
+    return m_bySpec[spec];
+  }
+  return m_alias.pick(m_rng);
+}
+
+SoundBank::Job SoundBank::job_locked(std::size_t index) const {
+  const auto &entry = m_entries[index];
+  Job job;
+  job.index = index;
+  job.generation = m_generation;
+  job.file = entry.file;
+  job.data = entry.data;
+  job.size = entry.size;
+  job.predecoded = entry.predecoded;
+  job.format = m_format;
+  job.outChannels = m_outChannels;
+  job.outRate = m_outRate;
+  return job;
+}
+
+std::shared_ptr<const Pcm> SoundBank::decode(const Job &job) {
+  std::optional<Pcm> decoded;
+  if (const Pcm *predecoded = job.predecoded.get()) {
+    if (job.outRate == 0 ||
+        (predecoded->channels == job.outChannels && predecoded->sampleRate == job.outRate)) {
+      return job.predecoded;
+    }
+    decoded = convert_pcm(*predecoded, job.outChannels, job.outRate);
+    if (!decoded) {
+      spdlog::error("Failed to convert sample {}", job.index);
+      return nullptr;
+    }
+  } else {
+    decoded = decode_flac(job.data, job.size, job.format);
+    if (!decoded) {
+      spdlog::error("Failed to decode sample {}", job.index);
+      return nullptr;
+    }
+    if (job.outRate != 0 &&
+        (decoded->channels != job.outChannels || decoded->sampleRate != job.outRate)) {
+      auto converted = convert_pcm(*decoded, job.outChannels, job.outRate);
+      if (!converted) {
+        spdlog::warn("Failed to convert sample {}; the mixer will resample it", job.index);
+      } else {
+        decoded = std::move(converted);
+      }
+    }
+  }
+  return std::make_shared<const Pcm>(std::move(*decoded));
+}
+
+std::shared_ptr<const Pcm> SoundBank::publish_locked(const Job &job,
+                                                     std::shared_ptr<const Pcm> pcm) {
+  if (job.generation != m_generation) {
+    return pcm;
+  }
+  auto &entry = m_entries[job.index];
+  if (entry.pcm) {
+    return entry.pcm;
+  }
+  evict_locked(pcm->bytes());
+  m_resident += pcm->bytes();
+  entry.pcm = pcm;
+  return pcm;
+}
+
+std::shared_ptr<const Pcm> SoundBank::acquire(std::size_t index) {
+  Job job;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (index >= m_entries.size() || m_entries[index].streamed) {
+      return nullptr;
+    }
+    auto &entry = m_entries[index];
+    entry.lastUsed = std::chrono::steady_clock::now();
+    if (entry.pcm) {
+      return entry.pcm;
+    }
+    job = job_locked(index);
+  }
+  auto pcm = decode(job);
+  if (!pcm) {
+    return nullptr;
+  }
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return publish_locked(job, std::move(pcm));
+}
+
+std::shared_ptr<const Pcm> SoundBank::try_acquire(std::size_t index) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (index >= m_entries.size() || m_entries[index].streamed) {
+    return nullptr;
+  }
+  auto now = std::chrono::steady_clock::now();
+  auto &entry = m_entries[index];
+  if (entry.pcm) {
+    entry.lastUsed = now;
+    return entry.pcm;
+  }
+  queue_locked(index, true);
+  Entry *fallback = nullptr;
+  for (auto &other : m_entries) {
+    if (other.pcm && (!fallback || other.lastUsed > fallback->lastUsed)) {
+      fallback = &other;
+    }
+  }
+  if (!fallback) {
+    return nullptr;
+  }
+  LIZARD_LOG_DEBUG("Sample {} not decoded yet; playing sample {} instead", index,
+                   static_cast<std::size_t>(fallback - m_entries.data()));
+  fallback->lastUsed = now;
+  return fallback->pcm;
+}
+
+std::shared_ptr<const Pcm> SoundBank::prewarm() {
+  std::optional<std::size_t> best;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (std::size_t i = 0; i < m_entries.size(); ++i) {
+      if (!m_entries[i].streamed && (!best || m_entries[i].weight > m_entries[*best].weight)) {
+        best = i;
+      }
+    }
+  }
+  return best ? acquire(*best) : nullptr;
+}
+
+void SoundBank::prefill() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::vector<std::size_t> order;
+  for (std::size_t i = 0; i < m_entries.size(); ++i) {
+    if (!m_entries[i].streamed && !m_entries[i].pcm) {
+      order.push_back(i);
+    }
+  }
+  std::stable_sort(order.begin(), order.end(), [this](std::size_t a, std::size_t b) {
+    return m_entries[a].weight > m_entries[b].weight;
+  });
+  for (std::size_t index : order) {
+    queue_locked(index, false);
+  }
+}
+
+// Samples a trigger is waiting for go to the front of the queue. The thread
+// is normally started by prefill() at init, not here on the trigger path.
+void SoundBank::queue_locked(std::size_t index, bool wanted) {
+  auto &entry = m_entries[index];
+  if (entry.queued) {
+    if (wanted && !entry.wanted) {
+      auto it = std::find(m_pending.begin(), m_pending.end(), index);
+      std::rotate(m_pending.begin(), it, it + 1);
+    }
+  } else if (wanted) {
+    m_pending.insert(m_pending.begin(), index);
+  } else {
+    m_pending.push_back(index);
+  }
+  entry.queued = true;
+  entry.wanted = entry.wanted || wanted;
+  if (!m_decodeThread.joinable()) {
+    m_decodeThread = std::jthread([this](std::stop_token st) { decode_loop(st); });
+  }
+  m_decodeCv.notify_one();
+}
+
+void SoundBank::decode_loop(std::stop_token st) {
+  LIZARD_TRACE_THREAD("audio_decode");
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (m_decodeCv.wait(lock, st, [this] { return !m_pending.empty(); })) {
+    std::size_t index = m_pending.front();
+    m_pending.erase(m_pending.begin());
+    auto &entry = m_entries[index];
+    entry.queued = false;
+    bool wanted = std::exchange(entry.wanted, false);
+    if (entry.pcm) {
+      continue;
+    }
+    Job job = job_locked(index);
+    lock.unlock();
+    auto pcm = decode(job);
+    lock.lock();
+    if (!pcm || job.generation != m_generation) {
+      continue;
+    }
+    // Prefill stops at the budget; only a sample a trigger asked for evicts.
+    if (!wanted && !m_entries[index].pcm && m_resident + pcm->bytes() > m_budget) {
+      continue;
+    }
+    publish_locked(job, std::move(pcm));
+  }
+}
+
+void SoundBank::evict_locked(std::size_t incomingBytes) {
+  auto now = std::chrono::steady_clock::now();
+  while (m_resident + incomingBytes > m_budget) {
+    // A voice that was just retriggered may still be inside the mixer's
+    // current period, so recently used samples are left alone for a grace
+    // period even once no voice holds them.
+    Entry *victim = nullptr;
+    for (auto &entry : m_entries) {
+      if (!entry.pcm || entry.pcm.use_count() > 1 || now - entry.lastUsed < m_evictionGrace) {
+        continue;
+      }
+      if (!victim || entry.lastUsed < victim->lastUsed) {
+        victim = &entry;
+      }
+    }
+    if (!victim) {
+      spdlog::debug("PCM pool over budget ({} + {} > {} bytes); all samples in use",
+                    m_resident, incomingBytes, m_budget);
+      return;
+    }
+    m_resident -= victim->pcm->bytes();
+    victim->pcm.reset();
+  }
+}
+
+} // namespace lizard::audio
@@ -0,0 +1,232 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <span>
+#include <thread>
+#include <vector>
+
+namespace lizard::audio {
+
+struct SampleSpec {
+  std::filesystem::path path;
+  double weight = 1.0;
+
+  bool operator==(const SampleSpec &) const = default;
+};
+
+// Resident sample format. s16 halves the pool's footprint; PcmSource widens
+// it back to f32 as the mixer reads it.
+enum class SampleFormat { f32, s16 };
+
+// Decoded, interleaved PCM for one sample. Only the vector matching `format`
+// is populated, unless the samples live in read-only memory the Pcm does not
+// own (the build-time decoded default sound); then the matching `borrowed`
+// span is set instead. Readers go through f32() and s16().
+struct Pcm {
+  SampleFormat format = SampleFormat::f32;
+  std::vector<float> samples;
+  std::vector<std::int16_t> samples16;
+  std::span<const float> borrowed;
+  std::span<const std::int16_t> borrowed16;
+  std::uint64_t frames = 0;
+  std::uint32_t channels = 0;
+  std::uint32_t sampleRate = 0;
+
+  std::span<const float> f32() const { return borrowed.empty() ? samples : borrowed; }
+  std::span<const std::int16_t> s16() const {
+    return borrowed16.empty() ? samples16 : borrowed16;
+  }
+  // Heap bytes only; borrowed samples cost the pool nothing.
+  std::size_t bytes() const {
+    return samples.size() * sizeof(float) + samples16.size() * sizeof(std::int16_t);
+  }
+};
+
+// Read-only memory mapping of a whole file. Pages are only faulted in as the
+// decoder touches them, so an idle bank costs address space, not memory.
+class MappedFile {
+public:
+  static std::optional<MappedFile> open(const std::filesystem::path &path);
+
+  MappedFile(MappedFile &&other) noexcept;
+  MappedFile &operator=(MappedFile &&other) noexcept;
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  ~MappedFile();
+
+  const unsigned char *data() const { return m_data; }
+  std::size_t size() const { return m_size; }
+
+private:
+  MappedFile() = default;
+  void reset();
+
+  const unsigned char *m_data = nullptr;
+  std::size_t m_size = 0;
+#ifdef _WIN32
+  void *m_file = nullptr;
+  void *m_mapping = nullptr;
+#endif
+};
+
+// Walker/Vose alias table: O(n) to build, O(1) per weighted pick.
+class AliasTable {
+public:
+  AliasTable() = default;
+  explicit AliasTable(const std::vector<double> &weights);
+
+  std::size_t pick(std::mt19937 &rng) const;
+  std::size_t size() const { return m_prob.size(); }
+
+private:
+  std::vector<double> m_prob;
+  std::vector<std::uint32_t> m_alias;
+};
+
+// Weighted set of compressed samples, decoded into a shared PCM pool. The
+// trigger path never decodes: a sample that is not resident is queued for the
+// bank's decode thread and another resident sample plays in its place. When
+// the pool exceeds its budget the least recently used samples that no voice is
+// playing are dropped and decoded again on demand.
+// Samples whose decoded size exceeds the stream threshold are never decoded
+// here; voices stream them straight from the mapping instead (see FlacStream).
+class SoundBank {
+public:
+  static constexpr std::size_t kDefaultBudgetBytes = 24u * 1024u * 1024u;
+  static constexpr std::size_t kDefaultStreamThresholdBytes = 8u * 1024u * 1024u;
+
+  explicit SoundBank(std::size_t budgetBytes = kDefaultBudgetBytes,
+                     std::chrono::milliseconds evictionGrace = std::chrono::milliseconds(500));
+
+  // Replaces the bank with `samples`; unreadable files and non-positive
+  // weights are skipped with a warning. Returns false if nothing is usable.
+  bool load(const std::vector<SampleSpec> &samples);
+  // Replaces the bank with one sample backed by caller-owned memory.
+  bool load_memory(const unsigned char *data, std::size_t size);
+  // Replaces the bank with one sample that is already decoded. acquire()
+  // hands it out as is while it matches the output format, so nothing is
+  // decoded or copied; otherwise it is converted once like any other sample.
+  // Its format wins over set_sample_format().
+  bool load_pcm(std::shared_ptr<const Pcm> pcm);
+  void clear();
+  void set_budget(std::size_t budgetBytes);
+  // Applies to samples added by later load() calls.
+  void set_stream_threshold(std::size_t decodedBytes);
+  // Applies to samples decoded from now on.
+  void set_sample_format(SampleFormat format);
+  // Samples are converted to this layout and rate once, as they are decoded,
+  // so voices mix without a real-time resampler. A change drops the decoded
+  // pool. Returns true if the format changed.
+  bool set_output_format(std::uint32_t channels, std::uint32_t sampleRate);
+
+  std::size_t size() const;
+  std::size_t resident_bytes() const;
+  std::size_t streamed_count() const;
+  bool streamed(std::size_t index) const;
+  // The compressed bytes of `index`, valid until the next load() or clear().
+  std::span<const unsigned char> encoded(std::size_t index) const;
+
+  // O(1) weighted choice of a sample index. Requires a non-empty bank.
+  std::size_t pick();
+  // The entry that samples[`spec`] of the last load() became, or a weighted
+  // choice if that sample was skipped. Requires a non-empty bank.
+  std::size_t pick(std::size_t spec);
+  // Decoded PCM for `index`, decoding it on the calling thread first if
+  // needed; the bank stays unlocked while it does. Voices keep the returned
+  // pointer for as long as they play it, which pins it in the pool. Returns
+  // nullptr for streamed samples.
+  std::shared_ptr<const Pcm> acquire(std::size_t index);
+  // acquire() for the trigger path, which never decodes. If `index` is not
+  // resident it is queued for the decode thread and the most recently used
+  // resident sample is returned instead, or nullptr if there is none.
+  std::shared_ptr<const Pcm> try_acquire(std::size_t index);
+  // Decodes the most likely resident sample up front so the first play() is
+  // not the one that pays for decoding. Returns it, or nullptr if there is
+  // none.
+  std::shared_ptr<const Pcm> prewarm();
+  // Queues every resident sample, heaviest first, for the decode thread to
+  // load while it fits the budget, so later picks rarely miss.
+  void prefill();
+
+private:
+  struct Entry {
+    // Shared so a decode in flight keeps the mapping alive across a load().
+    std::shared_ptr<const MappedFile> file;
+    const unsigned char *data = nullptr;
+    std::size_t size = 0;
+    double weight = 1.0;
+    bool streamed = false;
+    // Set for load_pcm() samples, which are never decoded.
+    std::shared_ptr<const Pcm> predecoded;
+    std::shared_ptr<const Pcm> pcm;
+    std::chrono::steady_clock::time_point lastUsed{};
+    // Waiting in m_pending; `wanted` once a trigger has asked for it.
+    bool queued = false;
+    bool wanted = false;
+  };
+
+  // What decoding one entry needs, copied out so it can run unlocked.
+  struct Job {
+    std::size_t index = 0;
+    std::uint64_t generation = 0;
+    std::shared_ptr<const MappedFile> file;
+    const unsigned char *data = nullptr;
+    std::size_t size = 0;
+    std::shared_ptr<const Pcm> predecoded;
+    SampleFormat format = SampleFormat::f32;
+    std::uint32_t outChannels = 0;
+    std::uint32_t outRate = 0;
+  };
+
+  void rebuild_locked();
+  void reset_pool_locked();
+  void evict_locked(std::size_t incomingBytes);
+  Job job_locked(std::size_t index) const;
+  static std::shared_ptr<const Pcm> decode(const Job &job);
+  // Adds `pcm` to the pool unless the bank changed since `job` was taken or
+  // another thread got there first. Returns what the entry now holds.
+  std::shared_ptr<const Pcm> publish_locked(const Job &job, std::shared_ptr<const Pcm> pcm);
+  void queue_locked(std::size_t index, bool wanted);
+  void decode_loop(std::stop_token st);
+
+  mutable std::mutex m_mutex;
+  std::vector<Entry> m_entries;
+  // Position in m_entries of each SampleSpec passed to load(), or npos.
+  std::vector<std::size_t> m_bySpec;
+  AliasTable m_alias;
+  std::mt19937 m_rng{std::random_device{}()};
+  std::size_t m_budget;
+  std::size_t m_streamThreshold = kDefaultStreamThresholdBytes;
+  SampleFormat m_format = SampleFormat::f32;
+  std::uint32_t m_outChannels = 0;
+  std::uint32_t m_outRate = 0;
+  std::size_t m_resident = 0;
+  std::chrono::milliseconds m_evictionGrace;
+  // Bumped whenever the entries or the output format change, so a decode
+  // that finishes afterwards is thrown away.
+  std::uint64_t m_generation = 0;
+  std::vector<std::size_t> m_pending;
+  std::condition_variable_any m_decodeCv;
+  // Last, so it stops before the members it uses are destroyed.
+  std::jthread m_decodeThread;
+};
+
+// Decodes a complete FLAC stream from memory.
+std::optional<Pcm> decode_flac(const unsigned char *data, std::size_t size,
+                               SampleFormat format = SampleFormat::f32);
+// Converts `pcm` to `channels` and `sampleRate` with miniaudio's linear
+// resampler at its highest low-pass filter order. Too slow for the mixer, but
+// it only runs once per sample.
+std::optional<Pcm> convert_pcm(const Pcm &pcm, std::uint32_t channels, std::uint32_t sampleRate);
+// Size of the f32 PCM a FLAC stream decodes to, read from its header only.
+std::optional<std::size_t> decoded_size(const unsigned char *data, std::size_t size);
+
+} // namespace lizard::audio
@@ -0,0 +1,124 @@
+// Config reader latency while the file is reloaded back to back.
+//
+// Reader threads call getters in a tight loop, as the keyboard hook and the
+// overlay do, and time every call. The run is repeated with a writer calling
+// reload() continuously. Parsing happens outside the lock readers take, so
+// the reload storm should move the tail only by the cost of a pointer swap.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "app/config.h"
+
+using lizard::app::Config;
+
+namespace {
+
+constexpr int kReaders = 4;
+constexpr auto kDuration = std::chrono::seconds(2);
+
+struct Percentiles {
+  double p50 = 0.0;
+  double p99 = 0.0;
+  double p999 = 0.0;
+  double max = 0.0;
+  std::size_t calls = 0;
+  std::size_t reloads = 0;
+};
+
+// A config of realistic size, so each parse takes a while.
+void write_config(const std::filesystem::path &path) {
+  std::ofstream out(path);
+  out << R"({"enabled":true,"volume_percent":70,"exclude_processes":[)";
+  for (int i = 0; i < 200; ++i) {
+    out << (i ? "," : "") << "\"process_" << i << ".exe\"";
+  }
+  out << R"(],"emoji":[)";
+  for (int i = 0; i < 200; ++i) {
+    out << (i ? "," : "") << "\"\\ud83e\\udd8e\"";
+  }
+  out << "]}";
+}
+
+Percentiles measure(Config &cfg, bool storm) {
+  std::atomic<bool> stop{false};
+  std::vector<std::vector<double>> samples(kReaders);
+  std::vector<std::thread> readers;
+  for (int r = 0; r < kReaders; ++r) {
+    readers.emplace_back([&, r] {
+      auto &mine = samples[static_cast<std::size_t>(r)];
+      mine.reserve(1 << 22);
+      volatile int sink = 0;
+      while (!stop.load(std::memory_order_relaxed)) {
+        auto start = std::chrono::steady_clock::now();
+        sink = sink + (cfg.enabled() ? 1 : 0) + cfg.volume_percent();
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        mine.push_back(std::chrono::duration<double, std::nano>(elapsed).count());
+      }
+    });
+  }
+  std::size_t reloads = 0;
+  std::thread writer;
+  if (storm) {
+    writer = std::thread([&] {
+      while (!stop.load(std::memory_order_relaxed)) {
+        cfg.reload();
+        ++reloads;
+      }
+    });
+  }
+  std::this_thread::sleep_for(kDuration);
+  stop = true;
+  for (auto &reader : readers) {
+    reader.join();
+  }
+  if (writer.joinable()) {
+    writer.join();
+  }
+
+  std::vector<double> all;
+  for (auto &mine : samples) {
+    all.insert(all.end(), mine.begin(), mine.end());
+  }
+  std::sort(all.begin(), all.end());
+  Percentiles result;
+  result.calls = all.size();
+  result.reloads = reloads;
+  if (!all.empty()) {
+    auto at = [&](double q) { return all[static_cast<std::size_t>(q * (all.size() - 1))]; };
+    result.p50 = at(0.5);
+    result.p99 = at(0.99);
+    result.p999 = at(0.999);
+    result.max = all.back();
+  }
+  return result;
+}
+
+} // namespace
+
+int main() {
+  auto dir = std::filesystem::temp_directory_path() / "lizard_config_bench";
+  std::filesystem::create_directories(dir);
+  auto path = dir / "lizard.json";
+  write_config(path);
+
+  Config cfg(dir, path);
+  std::printf("%d readers, %lld s per run\n", kReaders,
+              static_cast<long long>(kDuration.count()));
+  std::printf("%-8s %8s %12s %10s %10s %10s %10s\n", "run", "reloads", "calls", "p50 ns",
+              "p99 ns", "p99.9 ns", "max ns");
+  for (bool storm : {false, true}) {
+    Percentiles p = measure(cfg, storm);
+    std::printf("%-8s %8zu %12zu %10.0f %10.0f %10.0f %10.0f\n", storm ? "storm" : "quiet",
+                p.reloads, p.calls, p.p50, p.p99, p.p999, p.max);
+  }
+  std::filesystem::remove_all(dir);
+  return 0;
+}
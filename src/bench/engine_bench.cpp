@@ -0,0 +1,102 @@
+// Callback cost of the full mix graph, measured headless on the null backend.
+//
+// Each run opens an Engine with the default sound on the null backend, fires
+// play() in a synthetic trigger pattern and times every render() of one 10 ms
+// period, which is the work a device callback would do. The saturated
+// pattern retriggers every voice each period, so all of them are always
+// mixing; voices per core is how many of those one core could keep up with
+// in real time.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "audio/engine.h"
+
+using lizard::audio::Engine;
+
+namespace {
+
+constexpr std::uint32_t kPeriodFrames = Engine::kNullSampleRate / 100;
+constexpr int kPeriods = 5000;
+
+struct Pattern {
+  const char *name;
+  // Triggers to fire before rendering period `period` with `voices` voices.
+  int (*triggers)(int period, int voices);
+  // Every voice mixes every period, so the cost divides evenly among them.
+  bool saturated = false;
+};
+
+const Pattern kPatterns[] = {
+    // About 12 keys a second.
+    {"typing", [](int period, int) { return period % 8 == 0 ? 1 : 0; }},
+    // Key auto-repeat: one trigger every period.
+    {"repeat", [](int, int) { return 1; }},
+    // Every voice at once, four times a second.
+    {"chord", [](int period, int voices) { return period % 25 == 0 ? voices : 0; }},
+    {"saturated", [](int, int voices) { return voices; }, true},
+};
+
+struct Result {
+  double averageNs = 0.0;
+  double p99Ns = 0.0;
+  double maxNs = 0.0;
+};
+
+Result run(const Pattern &pattern, int voices) {
+  Engine engine(static_cast<std::uint32_t>(voices));
+  if (!engine.init(std::nullopt, 100, lizard::audio::Backend::null)) {
+    std::fprintf(stderr, "engine_bench: null backend failed to open\n");
+    return {};
+  }
+  std::vector<float> period(kPeriodFrames * Engine::kNullChannels);
+  std::vector<double> samples;
+  samples.reserve(kPeriods);
+  for (int i = 0; i < kPeriods; ++i) {
+    for (int t = pattern.triggers(i, voices); t > 0; --t) {
+      engine.play();
+    }
+    auto start = std::chrono::steady_clock::now();
+    engine.render(period.data(), kPeriodFrames);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    samples.push_back(std::chrono::duration<double, std::nano>(elapsed).count());
+  }
+  engine.shutdown();
+
+  Result result;
+  for (double ns : samples) {
+    result.averageNs += ns;
+  }
+  result.averageNs /= static_cast<double>(samples.size());
+  std::sort(samples.begin(), samples.end());
+  result.p99Ns = samples[samples.size() * 99 / 100];
+  result.maxNs = samples.back();
+  return result;
+}
+
+} // namespace
+
+int main() {
+  constexpr double kPeriodNs = 1e9 * kPeriodFrames / Engine::kNullSampleRate;
+  std::printf("%u-frame periods at %u Hz (%.0f us of audio each)\n", kPeriodFrames,
+              Engine::kNullSampleRate, kPeriodNs / 1000.0);
+  std::printf("%-10s %-7s %12s %12s %12s %14s\n", "pattern", "voices", "avg us", "p99 us",
+              "max us", "voices/core");
+  for (const Pattern &pattern : kPatterns) {
+    for (int voices : {1, 8, 32, 64}) {
+      Result r = run(pattern, voices);
+      if (pattern.saturated && r.averageNs > 0.0) {
+        std::printf("%-10s %-7d %12.1f %12.1f %12.1f %14.0f\n", pattern.name, voices,
+                    r.averageNs / 1000.0, r.p99Ns / 1000.0, r.maxNs / 1000.0,
+                    voices * kPeriodNs / r.averageNs);
+      } else {
+        std::printf("%-10s %-7d %12.1f %12.1f %12.1f %14s\n", pattern.name, voices,
+                    r.averageNs / 1000.0, r.p99Ns / 1000.0, r.maxNs / 1000.0, "-");
+      }
+    }
+  }
+  return 0;
+}
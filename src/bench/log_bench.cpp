@@ -0,0 +1,79 @@
+// Cost of a debug log line on the calling thread, as the keyboard hook pays
+// it.
+//
+// Logging goes through init_logging() to the async rotating file, at debug
+// level and then at info level (so the line is filtered out). Each run logs
+// in bursts of typing speed or faster, with a pause between bursts for the
+// background threads to catch up, and times every call. spdlog::debug()
+// formats on the caller; LIZARD_LOG_DEBUG() only copies its arguments into
+// the thread's ring.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "util/binlog.h"
+#include "util/log.h"
+
+namespace {
+
+constexpr int kBursts = 1000;
+constexpr int kPerBurst = 200;
+constexpr auto kPause = std::chrono::milliseconds(2);
+
+struct Percentiles {
+  double p50 = 0.0;
+  double p99 = 0.0;
+  double max = 0.0;
+};
+
+template <typename Call> Percentiles measure(Call call) {
+  std::vector<double> samples;
+  samples.reserve(static_cast<std::size_t>(kBursts) * kPerBurst);
+  for (int burst = 0; burst < kBursts; ++burst) {
+    for (int i = 0; i < kPerBurst; ++i) {
+      auto start = std::chrono::steady_clock::now();
+      call(burst * kPerBurst + i);
+      auto elapsed = std::chrono::steady_clock::now() - start;
+      samples.push_back(std::chrono::duration<double, std::nano>(elapsed).count());
+    }
+    std::this_thread::sleep_for(kPause);
+  }
+  std::sort(samples.begin(), samples.end());
+  auto at = [&](double q) { return samples[static_cast<std::size_t>(q * (samples.size() - 1))]; };
+  return {at(0.5), at(0.99), samples.back()};
+}
+
+} // namespace
+
+int main() {
+  auto dir = std::filesystem::temp_directory_path() / "lizard_log_bench";
+  std::filesystem::create_directories(dir);
+  std::string key = "KeyA";
+
+  std::printf("%d bursts of %d calls\n", kBursts, kPerBurst);
+  std::printf("%-8s %-18s %10s %10s %10s\n", "level", "call", "p50 ns", "p99 ns", "max ns");
+  for (const char *level : {"debug", "info"}) {
+    lizard::util::init_logging(level, 8192, 1, dir / "lizard.log");
+    auto spdlog_run = measure([&](int n) {
+      spdlog::debug("key {} code {} down={} at {:.3f}", key, n & 0xFF, true, n * 0.001);
+    });
+    auto binlog_run = measure([&](int n) {
+      LIZARD_LOG_DEBUG("key {} code {} down={} at {:.3f}", key, n & 0xFF, true, n * 0.001);
+    });
+    lizard::util::binlog::flush();
+    std::printf("%-8s %-18s %10.0f %10.0f %10.0f\n", level, "spdlog::debug", spdlog_run.p50,
+                spdlog_run.p99, spdlog_run.max);
+    std::printf("%-8s %-18s %10.0f %10.0f %10.0f\n", level, "LIZARD_LOG_DEBUG", binlog_run.p50,
+                binlog_run.p99, binlog_run.max);
+  }
+  spdlog::shutdown();
+  std::filesystem::remove_all(dir);
+  return 0;
+}
@@ -24,6 +24,10 @@
 
 #include <spdlog/spdlog.h>
 
+#include "platform/linux/xcb_query.hpp"
+#include "util/binlog.h"
+#include "util/trace.h"
+
 namespace hook {
 
 #ifdef LIZARD_TEST
@@ -74,6 +78,9 @@ public:
 
 private:
   void run(std::stop_token st, std::promise<bool> started) {
+    LIZARD_TRACE_THREAD("hook");
+    // Keys are handled, and triggers logged, on this thread.
+    lizard::util::binlog::register_thread();
     Display *dpy = XOpenDisplay(nullptr);
     if (!dpy) {
       spdlog::error("XOpenDisplay failed: {}", errno);
@@ -119,6 +126,7 @@ private:
             if (ev.xcookie.type == GenericEvent && ev.xcookie.extension == xi_opcode &&
                 XGetEventData(dpy, &ev.xcookie)) {
               if (ev.xcookie.evtype == XI_RawKeyPress || ev.xcookie.evtype == XI_RawKeyRelease) {
+                LIZARD_TRACE_ZONE("hook::xi2_event");
                 auto *raw = static_cast<XIRawEvent *>(ev.xcookie.data);
                 bool pressed = ev.xcookie.evtype == XI_RawKeyPress;
                 std::string proc = process_name_fn_(dpy);
@@ -156,6 +164,7 @@ private:
         auto handler = [](XPointer ctx, XRecordInterceptData *data) {
           auto *self = reinterpret_cast<LinuxKeyboardHook *>(ctx);
           if (data->category == XRecordFromServer) {
+            LIZARD_TRACE_ZONE("hook::xrecord_event");
             const xEvent *ev = reinterpret_cast<const xEvent *>(data->data);
             bool pressed = ev->u.u.type == KeyPress;
             unsigned int key = ev->u.u.detail;
@@ -222,33 +231,27 @@ private:
     if (!dpy) {
       return name;
     }
-    Atom active = XInternAtom(dpy, "_NET_ACTIVE_WINDOW", True);
-    Atom pid_atom = XInternAtom(dpy, "_NET_WM_PID", True);
-    if (active == None || pid_atom == None) {
+    // Runs per key event on the hook thread, so it goes through the shared XCB
+    // query connection: cached atoms and two round-trips instead of four.
+    namespace xq = lizard::platform::xcb;
+    const auto *q = xq::query_connection();
+    xcb_atom_t pid_atom = xq::atom("_NET_WM_PID");
+    if (!q || pid_atom == XCB_ATOM_NONE) {
       return name;
     }
-    Atom type;
-    int format;
-    unsigned long nitems, bytes;
-    unsigned char *prop = nullptr;
-    if (XGetWindowProperty(dpy, DefaultRootWindow(dpy), active, 0, ~0L, False, AnyPropertyType,
-                           &type, &format, &nitems, &bytes, &prop) == Success &&
-        prop) {
-      Window win = *(Window *)prop;
-      XFree(prop);
-      prop = nullptr;
-      if (XGetWindowProperty(dpy, win, pid_atom, 0, 1, False, XA_CARDINAL, &type, &format, &nitems,
-                             &bytes, &prop) == Success &&
-          prop) {
-        pid_t pid = *(pid_t *)prop;
-        XFree(prop);
-        char link[64];
-        std::snprintf(link, sizeof(link), "/proc/%d/exe", pid);
-        std::error_code ec;
-        auto p = std::filesystem::read_symlink(link, ec);
-        if (!ec) {
-          name = p.filename().string();
-        }
+    xcb_window_t win = xq::active_window(*q);
+    if (win == XCB_WINDOW_NONE) {
+      return name;
+    }
+    auto reply = xq::take_reply(q->conn, xcb_get_property_reply,
+                                xcb_get_property(q->conn, 0, win, pid_atom, XCB_ATOM_CARDINAL, 0, 1));
+    if (auto pid = xq::first_card32(reply.get())) {
+      char link[64];
+      std::snprintf(link, sizeof(link), "/proc/%u/exe", *pid);
+      std::error_code ec;
+      auto p = std::filesystem::read_symlink(link, ec);
+      if (!ec) {
+        name = p.filename().string();
       }
     }
     return name;
@@ -13,6 +13,9 @@
 
 #include <spdlog/spdlog.h>
 
+#include "util/binlog.h"
+#include "util/trace.h"
+
 namespace hook {
 
 namespace {
@@ -61,6 +64,7 @@ private:
                                 void *refcon) {
     auto *self = static_cast<MacKeyboardHook *>(refcon);
     if (type == kCGEventKeyDown || type == kCGEventKeyUp) {
+      LIZARD_TRACE_ZONE("hook::TapCallback");
       int key = static_cast<int>(CGEventGetIntegerValueField(event, kCGKeyboardEventKeycode));
       bool pressed = type == kCGEventKeyDown;
       bool injected = false;
@@ -80,6 +84,9 @@ private:
   }
 
   void run(std::stop_token, std::promise<bool> started) {
+    LIZARD_TRACE_THREAD("hook");
+    // Keys are handled, and triggers logged, on this thread.
+    lizard::util::binlog::register_thread();
     CGEventMask mask = CGEventMaskBit(kCGEventKeyDown) | CGEventMaskBit(kCGEventKeyUp);
     tap_ = cg_event_tap_create_(kCGSessionEventTap, kCGHeadInsertEventTap, 0, mask, &TapCallback,
                                 this);
@@ -13,6 +13,9 @@
 
 #include <spdlog/spdlog.h>
 
+#include "util/binlog.h"
+#include "util/trace.h"
+
 namespace hook {
 
 namespace {
@@ -55,6 +58,7 @@ public:
 private:
   static LRESULT CALLBACK HookProc(int code, WPARAM wParam, LPARAM lParam) {
     if (code == HC_ACTION && instance_) {
+      LIZARD_TRACE_ZONE("hook::HookProc");
       const auto *info = reinterpret_cast<KBDLLHOOKSTRUCT *>(lParam);
       bool pressed = wParam == WM_KEYDOWN || wParam == WM_SYSKEYDOWN;
       bool injected = (info->flags & (LLKHF_INJECTED | LLKHF_LOWER_IL_INJECTED)) != 0;
@@ -68,6 +72,9 @@ private:
   }
 
   void run(std::stop_token st, std::promise<bool> started) {
+    LIZARD_TRACE_THREAD("hook");
+    // Keys are handled, and triggers logged, on this thread.
+    lizard::util::binlog::register_thread();
     thread_id_ = GetCurrentThreadId();
     hook_ = set_hook_(WH_KEYBOARD_LL, &HookProc, nullptr, 0);
     if (!hook_) {
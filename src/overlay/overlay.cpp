@@ -22,6 +22,8 @@ void stbi_image_free(void *);
 #include <cstdint>
 #include <filesystem>
 #include <fstream>
+#include <future>
+#include <memory>
 #include <optional>
 #include <random>
 #include <cmath>
@@ -41,6 +43,7 @@ void stbi_image_free(void *);
 #elif defined(__linux__)
 #include <X11/Xlib.h>
 #include <X11/extensions/Xrandr.h>
+#include "platform/linux/xcb_query.hpp"
 #elif defined(__APPLE__)
 #include <CoreGraphics/CoreGraphics.h>
 #include <CoreFoundation/CoreFoundation.h>
@@ -53,6 +56,8 @@ void stbi_image_free(void *);
 
 #include "app/config.h"
 #include "overlay/gl_raii.h"
+#include "overlay/program_cache.h"
+#include "util/trace.h"
 #include <spdlog/spdlog.h>
 
 #ifdef LIZARD_TEST
@@ -151,23 +156,13 @@ std::vector<MonitorBounds> query_system_monitors() {
     }
   }
 #elif defined(__linux__)
-  platform::init_xlib_threads();
-  if (Display *dpy = XOpenDisplay(nullptr)) {
-    ::Window root = DefaultRootWindow(dpy);
-    int nmon = 0;
-    if (XRRMonitorInfo *info = XRRGetMonitors(dpy, root, True, &nmon)) {
-      for (int i = 0; i < nmon; ++i) {
-        monitors.push_back(MonitorBounds{static_cast<float>(info[i].x), static_cast<float>(info[i].y),
-                                         static_cast<float>(info[i].x + info[i].width),
-                                         static_cast<float>(info[i].y + info[i].height)});
-      }
-      XRRFreeMonitors(info);
-    } else {
-      int screen = DefaultScreen(dpy);
-      monitors.push_back(MonitorBounds{0.0f, 0.0f, static_cast<float>(DisplayWidth(dpy, screen)),
-                                       static_cast<float>(DisplayHeight(dpy, screen))});
+  if (const auto *q = platform::xcb::query_connection()) {
+    auto rects = platform::xcb::collect_monitors(*q, platform::xcb::request_monitors(*q));
+    for (const auto &r : rects) {
+      monitors.push_back(MonitorBounds{static_cast<float>(r.x), static_cast<float>(r.y),
+                                       static_cast<float>(r.x + r.w),
+                                       static_cast<float>(r.y + r.h)});
     }
-    XCloseDisplay(dpy);
   }
 #endif
   return monitors;
@@ -235,52 +230,26 @@ std::optional<MonitorBounds> query_system_foreground_monitor() {
   }
   return std::nullopt;
 #elif defined(__linux__)
-  platform::init_xlib_threads();
-  Display *dpy = XOpenDisplay(nullptr);
-  if (!dpy) {
-    return std::nullopt;
-  }
-  ::Window root = DefaultRootWindow(dpy);
-  Atom active_atom = XInternAtom(dpy, "_NET_ACTIVE_WINDOW", False);
-  if (active_atom == None) {
-    XCloseDisplay(dpy);
-    return std::nullopt;
-  }
-  Atom actual_type = None;
-  int actual_format = 0;
-  unsigned long nitems = 0;
-  unsigned long bytes = 0;
-  unsigned char *data = nullptr;
-  if (XGetWindowProperty(dpy, root, active_atom, 0, ~0L, False, XA_WINDOW, &actual_type, &actual_format,
-                         &nitems, &bytes, &data) != Success || !data || nitems == 0) {
-    if (data) {
-      XFree(data);
-    }
-    XCloseDisplay(dpy);
+  namespace xq = platform::xcb;
+  const auto *q = xq::query_connection();
+  if (!q) {
     return std::nullopt;
   }
-  ::Window active = reinterpret_cast<::Window *>(data)[0];
-  XFree(data);
+  // The monitor list does not depend on the active window, so request it first
+  // and let it travel alongside the active-window lookups.
+  auto monitors_cookie = xq::request_monitors(*q);
+  auto active = xq::active_window_rect();
+  auto rects = xq::collect_monitors(*q, monitors_cookie);
   if (!active) {
-    XCloseDisplay(dpy);
-    return std::nullopt;
-  }
-  XWindowAttributes attrs{};
-  if (!XGetWindowAttributes(dpy, active, &attrs)) {
-    XCloseDisplay(dpy);
     return std::nullopt;
   }
-  int abs_x = attrs.x;
-  int abs_y = attrs.y;
-  ::Window child;
-  if (XTranslateCoordinates(dpy, active, root, 0, 0, &abs_x, &abs_y, &child) == False) {
-    abs_x = attrs.x;
-    abs_y = attrs.y;
+  double center_x = active->rect.x + active->rect.w * 0.5;
+  double center_y = active->rect.y + active->rect.h * 0.5;
+  std::vector<MonitorBounds> monitors;
+  for (const auto &r : rects) {
+    monitors.push_back(MonitorBounds{static_cast<float>(r.x), static_cast<float>(r.y),
+                                     static_cast<float>(r.x + r.w), static_cast<float>(r.y + r.h)});
   }
-  double center_x = abs_x + attrs.width * 0.5;
-  double center_y = abs_y + attrs.height * 0.5;
-  XCloseDisplay(dpy);
-  auto monitors = query_system_monitors();
   for (const auto &m : monitors) {
     if (center_x >= m.left && center_x <= m.right && center_y >= m.top && center_y <= m.bottom) {
       return m;
@@ -323,10 +292,11 @@ static std::optional<MonitorBounds> foreground_monitor(const std::vector<Monitor
   return std::nullopt;
 }
 
-enum class BadgeSpawnStrategy {
-  RandomScreen,
-  NearCaret,
-};
+using app::BadgeSpawnStrategy;
+
+constexpr platform::FpsMode to_platform(app::FpsMode mode) {
+  return mode == app::FpsMode::Fixed ? platform::FpsMode::Fixed : platform::FpsMode::Auto;
+}
 
 class Overlay {
 public:
@@ -336,6 +306,8 @@ public:
   void spawn_badge(float x, float y);
   void enqueue_spawn(int sprite, float x, float y);
   void enqueue_spawn(float x, float y);
+  // Spawns with a key's emoji set and badge scale.
+  void enqueue_spawn(const app::KeyReaction &reaction, float x, float y);
   void run(std::stop_token st);
   void stop();
   void refresh_from_config(const app::Config &cfg);
@@ -352,7 +324,8 @@ public:
 private:
   friend struct ::OverlayTestAccess;
   int select_sprite();
-  int select_sprite_locked();
+  // `emoji_set` is a KeyReaction::emoji_set; 0 picks from the global emoji.
+  int select_sprite_locked(std::uint16_t emoji_set = 0);
   void update(float dt);
   void render();
   void update_frame_interval();
@@ -362,11 +335,24 @@ private:
     std::vector<Sprite> sprites;
     std::unordered_map<std::string, int> lookup;
     std::optional<std::filesystem::path> normalized_path;
+    // Premultiplied RGBA, released once uploaded.
+    std::unique_ptr<unsigned char, void (*)(void *)> pixels{nullptr, &stbi_image_free};
+    int width = 0;
+    int height = 0;
   };
+  // Decodes the image and reads its sprite table. Touches no GL or member
+  // state, so init() runs it on a worker while the window comes up.
+  static std::optional<AtlasData>
+  decode_atlas(const std::optional<std::filesystem::path> &emoji_path);
+  // Needs the GL context.
+  void upload_atlas(AtlasData &atlas);
   std::optional<AtlasData> load_atlas_from_path(const std::optional<std::filesystem::path> &emoji_path);
+  // Geometry, instance buffer and badge program; needs the GL context.
+  bool init_gl();
   void build_selector(const std::vector<std::string> &emoji,
                       const std::unordered_map<std::string, double> &emoji_weighted);
-  void spawn_badge_locked(int sprite, float x, float y);
+  void build_emoji_sets(const std::vector<std::vector<std::string>> &emoji_sets);
+  void spawn_badge_locked(int sprite, float x, float y, float scale = 1.0f);
   static std::optional<std::filesystem::path>
   normalize_path(const std::optional<std::filesystem::path> &path);
 
@@ -374,18 +360,21 @@ private:
     std::optional<int> sprite;
     float x;
     float y;
+    std::uint16_t emoji_set = 0;
+    float scale = 1.0f;
   };
 
   struct PendingConfig {
-    std::string spawn_strategy;
+    BadgeSpawnStrategy spawn_strategy = BadgeSpawnStrategy::RandomScreen;
     int badge_min_px = 60;
     int badge_max_px = 108;
     int badges_per_second_max = 12;
-    std::string fps_mode;
+    app::FpsMode fps_mode = app::FpsMode::Auto;
     int fps_fixed = 60;
     std::optional<std::filesystem::path> emoji_atlas;
     std::vector<std::string> emoji;
     std::unordered_map<std::string, double> emoji_weighted;
+    std::vector<std::vector<std::string>> emoji_sets;
   };
 
   platform::Window m_window{};
@@ -403,6 +392,8 @@ private:
   std::unordered_map<std::string, int> m_sprite_lookup;
   std::vector<int> m_selector_indices;
   std::discrete_distribution<> m_selector;
+  // Sprite indices for each key_rules emoji list.
+  std::vector<std::vector<int>> m_emoji_sets;
   std::mt19937 m_rng{std::random_device{}()};
   std::deque<std::chrono::steady_clock::time_point> m_spawn_times;
   int m_badges_per_second_max = 12;
@@ -471,17 +462,10 @@ void Overlay::update_frame_interval() {
 }
 
 bool Overlay::init(const app::Config &cfg, std::optional<std::filesystem::path> emoji_path) {
-  auto strategy = cfg.badge_spawn_strategy();
-  if (strategy == "near_caret") {
-    m_spawn_strategy = BadgeSpawnStrategy::NearCaret;
-  } else {
-    m_spawn_strategy = BadgeSpawnStrategy::RandomScreen;
-  }
-  if (cfg.fps_mode() == "fixed") {
-    m_fps_mode = platform::FpsMode::Fixed;
+  m_spawn_strategy = cfg.badge_spawn_strategy();
+  m_fps_mode = to_platform(cfg.fps_mode());
+  if (m_fps_mode == platform::FpsMode::Fixed) {
     m_fps_fixed = cfg.fps_fixed();
-  } else {
-    m_fps_mode = platform::FpsMode::Auto;
   }
   m_badge_min_px = cfg.badge_min_px();
   m_badge_max_px = cfg.badge_max_px();
@@ -490,6 +474,7 @@ bool Overlay::init(const app::Config &cfg, std::optional<std::filesystem::path>
 
   auto emoji = cfg.emoji();
   auto emoji_weighted = cfg.emoji_weighted();
+  auto emoji_sets = cfg.key_emoji_sets();
   auto normalized_path = normalize_path(emoji_path);
   std::optional<AtlasData> atlas;
 #ifdef LIZARD_TEST
@@ -498,6 +483,10 @@ bool Overlay::init(const app::Config &cfg, std::optional<std::filesystem::path>
     return false;
   }
 #else
+  // The PNG decode overlaps window creation and shader compilation; only the
+  // upload waits for it.
+  auto decoded = std::async(std::launch::async,
+                            [normalized_path] { return decode_atlas(normalized_path); });
   platform::WindowDesc desc{};
 #ifdef _WIN32
   desc.x = GetSystemMetrics(SM_XVIRTUALSCREEN);
@@ -562,11 +551,15 @@ bool Overlay::init(const app::Config &cfg, std::optional<std::filesystem::path>
   if (!m_window.native) {
     return false;
   }
+  if (!init_gl()) {
+    return false;
+  }
 
-  atlas = load_atlas_from_path(normalized_path);
+  atlas = decoded.get();
   if (!atlas) {
     return false;
   }
+  upload_atlas(*atlas);
 #endif
 
   {
@@ -575,6 +568,7 @@ bool Overlay::init(const app::Config &cfg, std::optional<std::filesystem::path>
     m_sprites = std::move(atlas->sprites);
     m_current_emoji_path = std::move(atlas->normalized_path);
     build_selector(emoji, emoji_weighted);
+    build_emoji_sets(emoji_sets);
   }
 
   m_badge_capacity = 150;
@@ -585,6 +579,14 @@ bool Overlay::init(const app::Config &cfg, std::optional<std::filesystem::path>
     spawn_badge(0.0f, 0.0f);
   }
 
+#ifndef LIZARD_TEST
+  platform::clear_current_context(m_window);
+#endif
+  m_running = true;
+  return true;
+}
+
+bool Overlay::init_gl() {
 #ifndef LIZARD_TEST
   // Geometry
   const float verts[] = {-0.5f, -0.5f, 0.0f, 0.0f, 0.5f,  -0.5f, 1.0f, 0.0f,
@@ -652,6 +654,25 @@ bool Overlay::init(const app::Config &cfg, std::optional<std::filesystem::path>
       void main(){
         color = texture(uTex, uv) * alpha;
       })GLSL";
+
+  // A cached binary for this driver skips compiling and linking entirely.
+  std::optional<std::filesystem::path> cache_file;
+  std::uint64_t cache_key = 0;
+  auto cache_dir = app::Config::user_cache_dir();
+  if (!cache_dir.empty() && program_binaries_supported()) {
+    cache_key = current_program_key(vs, fs);
+    cache_file = program_cache_path(cache_dir / "shaders", cache_key);
+    if (auto binary = read_program_binary(*cache_file, cache_key)) {
+      m_program.create();
+      if (load_program_binary(m_program.id, *binary)) {
+        spdlog::debug("Loaded badge program from {}", cache_file->string());
+        return true;
+      }
+      spdlog::info("Driver rejected cached badge program {}; compiling", cache_file->string());
+      m_program.reset();
+    }
+  }
+
   GLuint vsId = glCreateShader(GL_VERTEX_SHADER);
   glShaderSource(vsId, 1, &vs, nullptr);
 
@@ -685,6 +706,9 @@ bool Overlay::init(const app::Config &cfg, std::optional<std::filesystem::path>
   m_program.create();
   glAttachShader(m_program.id, vsId);
   glAttachShader(m_program.id, fsId);
+  if (cache_file) {
+    glProgramParameteri(m_program.id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  }
 
   auto link_program = [](GLuint prog) -> bool {
     glLinkProgram(prog);
@@ -712,10 +736,12 @@ bool Overlay::init(const app::Config &cfg, std::optional<std::filesystem::path>
   glDeleteShader(vsId);
   glDeleteShader(fsId);
 
-  platform::clear_current_context(m_window);
-
+  if (cache_file) {
+    if (auto binary = get_program_binary(m_program.id)) {
+      write_program_binary(*cache_file, cache_key, *binary);
+    }
+  }
 #endif
-  m_running = true;
   return true;
 }
 
@@ -729,7 +755,32 @@ Overlay::normalize_path(const std::optional<std::filesystem::path> &path) {
 
 std::optional<Overlay::AtlasData>
 Overlay::load_atlas_from_path(const std::optional<std::filesystem::path> &emoji_path) {
+  auto atlas = decode_atlas(emoji_path);
+  if (atlas) {
+    upload_atlas(*atlas);
+  }
+  return atlas;
+}
+
+void Overlay::upload_atlas(AtlasData &atlas) {
+#ifndef LIZARD_TEST
+  if (!m_texture.id) {
+    m_texture.create();
+  }
+  glBindTexture(GL_TEXTURE_2D, m_texture.id);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, atlas.width, atlas.height, 0, GL_RGBA,
+               GL_UNSIGNED_BYTE, atlas.pixels.get());
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+#endif
+  atlas.pixels.reset();
+}
+
+std::optional<Overlay::AtlasData>
+Overlay::decode_atlas(const std::optional<std::filesystem::path> &emoji_path) {
+  LIZARD_TRACE_ZONE("overlay::decode_atlas");
   auto normalized = normalize_path(emoji_path);
+  AtlasData data;
   std::unordered_map<std::string, int> lookup;
   std::vector<Sprite> sprites;
 
@@ -775,14 +826,9 @@ Overlay::load_atlas_from_path(const std::optional<std::filesystem::path> &emoji_
     p[1] = static_cast<unsigned char>(p[1] * a / 255);
     p[2] = static_cast<unsigned char>(p[2] * a / 255);
   }
-  if (!m_texture.id) {
-    m_texture.create();
-  }
-  glBindTexture(GL_TEXTURE_2D, m_texture.id);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  stbi_image_free(pixels);
+  data.pixels.reset(pixels);
+  data.width = w;
+  data.height = h;
 #endif
 
   std::ifstream atlas_file;
@@ -845,7 +891,6 @@ Overlay::load_atlas_from_path(const std::optional<std::filesystem::path> &emoji_
     lookup["🦎"] = 0;
   }
 
-  AtlasData data;
   data.sprites = std::move(sprites);
   data.lookup = std::move(lookup);
   data.normalized_path = normalized;
@@ -892,6 +937,19 @@ void Overlay::build_selector(const std::vector<std::string> &emoji,
   m_selector = std::discrete_distribution<>(weights.begin(), weights.end());
 }
 
+void Overlay::build_emoji_sets(const std::vector<std::vector<std::string>> &emoji_sets) {
+  m_emoji_sets.clear();
+  for (const auto &symbols : emoji_sets) {
+    auto &indices = m_emoji_sets.emplace_back();
+    for (const auto &symbol : symbols) {
+      auto it = m_sprite_lookup.find(symbol);
+      if (it != m_sprite_lookup.end()) {
+        indices.push_back(it->second);
+      }
+    }
+  }
+}
+
 void Overlay::refresh_from_config(const app::Config &cfg) {
   PendingConfig pending;
   pending.spawn_strategy = cfg.badge_spawn_strategy();
@@ -903,6 +961,7 @@ void Overlay::refresh_from_config(const app::Config &cfg) {
   pending.emoji_atlas = normalize_path(cfg.emoji_atlas());
   pending.emoji = cfg.emoji();
   pending.emoji_weighted = cfg.emoji_weighted();
+  pending.emoji_sets = cfg.key_emoji_sets();
 
   {
     std::lock_guard<std::mutex> lock(m_pending_mutex);
@@ -942,25 +1001,20 @@ void Overlay::apply_pending_config() {
       m_sprites = std::move(atlas->sprites);
       m_current_emoji_path = std::move(atlas->normalized_path);
     }
-    if (pending.spawn_strategy == "near_caret") {
-      m_spawn_strategy = BadgeSpawnStrategy::NearCaret;
-    } else {
-      m_spawn_strategy = BadgeSpawnStrategy::RandomScreen;
-    }
+    m_spawn_strategy = pending.spawn_strategy;
 
     m_badge_min_px = pending.badge_min_px;
     m_badge_max_px = pending.badge_max_px;
     m_badges_per_second_max = pending.badges_per_second_max;
 
     build_selector(pending.emoji, pending.emoji_weighted);
+    build_emoji_sets(pending.emoji_sets);
   }
 
-  if (pending.fps_mode == "fixed") {
+  if (pending.fps_mode == app::FpsMode::Fixed) {
     set_fps_fixed(pending.fps_fixed);
-    set_fps_mode(platform::FpsMode::Fixed);
-  } else {
-    set_fps_mode(platform::FpsMode::Auto);
   }
+  set_fps_mode(to_platform(pending.fps_mode));
 }
 
 void Overlay::shutdown() {
@@ -1003,7 +1057,18 @@ void Overlay::enqueue_spawn(int sprite, float x, float y) {
   m_spawn_queue.push(SpawnRequest{std::make_optional(sprite), x, y});
 }
 
-int Overlay::select_sprite_locked() {
+void Overlay::enqueue_spawn(const app::KeyReaction &reaction, float x, float y) {
+  std::lock_guard<std::mutex> lock(m_spawn_queue_mutex);
+  m_spawn_queue.push(SpawnRequest{std::nullopt, x, y, reaction.emoji_set, reaction.badge_scale});
+}
+
+int Overlay::select_sprite_locked(std::uint16_t emoji_set) {
+  std::size_t set_index = emoji_set;
+  if (set_index > 0 && set_index <= m_emoji_sets.size() && !m_emoji_sets[set_index - 1].empty()) {
+    const auto &set = m_emoji_sets[set_index - 1];
+    std::uniform_int_distribution<std::size_t> pick(0, set.size() - 1);
+    return set[pick(m_rng)];
+  }
   if (m_selector_indices.empty()) {
     return 0;
   }
@@ -1011,7 +1076,7 @@ int Overlay::select_sprite_locked() {
   return m_selector_indices[idx];
 }
 
-void Overlay::spawn_badge_locked(int sprite, float x, float y) {
+void Overlay::spawn_badge_locked(int sprite, float x, float y, float scale) {
   if (m_badge_suppressed) {
     if (m_badges.size() < static_cast<std::size_t>(m_badge_capacity * 0.8f)) {
       m_badge_suppressed = false;
@@ -1132,8 +1197,8 @@ void Overlay::spawn_badge_locked(int sprite, float x, float y) {
 
   std::uniform_real_distribution<float> diaDist(static_cast<float>(m_badge_min_px),
                                                 static_cast<float>(m_badge_max_px));
-  float diameter = diaDist(m_rng);
-  float scale = (diameter * 2.0f) / m_view_height;
+  float diameter = diaDist(m_rng) * scale;
+  float size = (diameter * 2.0f) / m_view_height;
 
   std::uniform_real_distribution<float> rotDist(-5.0f, 5.0f);
   float rotation = rotDist(m_rng) * 3.14159265f / 180.0f;
@@ -1145,24 +1210,23 @@ void Overlay::spawn_badge_locked(int sprite, float x, float y) {
   float fade_in = fadeInDist(m_rng);
   float fade_out = fadeOutDist(m_rng);
 
-  m_badges.emplace_back(Badge{px, py, vx, vy, phase, scale, 0.0f, rotation, 0.0f, lifetime, fade_in,
+  m_badges.emplace_back(Badge{px, py, vx, vy, phase, size, 0.0f, rotation, 0.0f, lifetime, fade_in,
                               fade_out, sprite});
   m_spawn_times.push_back(now);
 }
 
 void Overlay::process_spawn_queue() {
+  LIZARD_TRACE_ZONE("overlay::process_spawn_queue");
   std::queue<SpawnRequest> local;
   {
     std::lock_guard<std::mutex> lock(m_spawn_queue_mutex);
     std::swap(local, m_spawn_queue);
   }
+  std::lock_guard<std::mutex> lock(m_spawn_config_mutex);
   while (!local.empty()) {
     auto &request = local.front();
-    if (request.sprite.has_value()) {
-      spawn_badge(request.sprite.value(), request.x, request.y);
-    } else {
-      spawn_badge(request.x, request.y);
-    }
+    int sprite = request.sprite ? *request.sprite : select_sprite_locked(request.emoji_set);
+    spawn_badge_locked(sprite, request.x, request.y, request.scale);
     local.pop();
   }
 }
@@ -1170,6 +1234,7 @@ void Overlay::process_spawn_queue() {
 void Overlay::stop() { m_running = false; }
 
 void Overlay::update(float dt) {
+  LIZARD_TRACE_ZONE("overlay::update");
   auto cubicOut = [](float t) { return 1.0f - std::pow(1.0f - t, 3.0f); };
   for (auto &b : m_badges) {
     b.time += dt;
@@ -1198,6 +1263,7 @@ void Overlay::update(float dt) {
 
 void Overlay::render() {
 #ifndef LIZARD_TEST
+  LIZARD_TRACE_ZONE("overlay::render");
   glClearColor(0, 0, 0, 0);
   glClear(GL_COLOR_BUFFER_BIT);
 
@@ -1235,6 +1301,7 @@ void Overlay::render() {
 
 void Overlay::run(std::stop_token st) {
 #ifndef LIZARD_TEST
+  LIZARD_TRACE_THREAD("overlay");
   platform::make_context_current(m_window);
   using clock = std::chrono::steady_clock;
   auto last = clock::now();
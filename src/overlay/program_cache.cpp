@@ -0,0 +1,108 @@
+#include "overlay/program_cache.h"
+
+#include <array>
+#include <cstring>
+
+#include <spdlog/spdlog.h>
+
+#include "util/blob_file.h"
+
+namespace lizard::overlay {
+
+namespace {
+
+// The payload is the binary format followed by the binary. Bump the version
+// whenever that changes.
+constexpr std::array<char, 4> kMagic = {'L', 'Z', 'P', 'B'};
+constexpr std::uint32_t kVersion = 2;
+
+} // namespace
+
+std::uint64_t program_key(std::string_view vendor, std::string_view renderer,
+                          std::string_view version, std::string_view vertex,
+                          std::string_view fragment) {
+  using util::fnv1a;
+  // The separators keep ("ab", "c") and ("a", "bc") apart.
+  std::uint64_t hash = fnv1a(vendor);
+  for (auto part : {renderer, version, vertex, fragment}) {
+    hash = fnv1a(part, fnv1a(std::string_view("\0", 1), hash));
+  }
+  return hash;
+}
+
+std::filesystem::path program_cache_path(const std::filesystem::path &dir, std::uint64_t key) {
+  return dir / fmt::format("program-{:016x}.bin", key);
+}
+
+std::optional<ProgramBinary> read_program_binary(const std::filesystem::path &path,
+                                                 std::uint64_t key) {
+  auto payload = util::read_blob(path, {kMagic, kVersion, key});
+  ProgramBinary binary;
+  if (!payload || payload->size() <= sizeof(binary.format)) {
+    return std::nullopt;
+  }
+  std::memcpy(&binary.format, payload->data(), sizeof(binary.format));
+  binary.data = payload->substr(sizeof(binary.format));
+  return binary;
+}
+
+bool write_program_binary(const std::filesystem::path &path, std::uint64_t key,
+                          const ProgramBinary &binary) {
+  std::string payload(reinterpret_cast<const char *>(&binary.format), sizeof(binary.format));
+  payload += binary.data;
+  return util::write_blob(path, {kMagic, kVersion, key}, payload);
+}
+
+#ifndef LIZARD_TEST
+namespace {
+
+std::string_view gl_string(GLenum name) {
+  const auto *text = reinterpret_cast<const char *>(glGetString(name));
+  return text ? std::string_view(text) : std::string_view();
+}
+
+} // namespace
+
+bool program_binaries_supported() {
+  if (!GLAD_GL_ARB_get_program_binary) {
+    return false;
+  }
+  GLint formats = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+  return formats > 0;
+}
+
+std::uint64_t current_program_key(std::string_view vertex, std::string_view fragment) {
+  return program_key(gl_string(GL_VENDOR), gl_string(GL_RENDERER), gl_string(GL_VERSION), vertex,
+                     fragment);
+}
+
+bool load_program_binary(GLuint program, const ProgramBinary &binary) {
+  glProgramBinary(program, binary.format, binary.data.data(),
+                  static_cast<GLsizei>(binary.data.size()));
+  GLint status = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &status);
+  return status == GL_TRUE;
+}
+
+std::optional<ProgramBinary> get_program_binary(GLuint program) {
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0) {
+    return std::nullopt;
+  }
+  ProgramBinary binary;
+  binary.data.resize(static_cast<std::size_t>(length));
+  GLsizei written = 0;
+  GLenum format = 0;
+  glGetProgramBinary(program, length, &written, &format, binary.data.data());
+  if (written <= 0) {
+    return std::nullopt;
+  }
+  binary.data.resize(static_cast<std::size_t>(written));
+  binary.format = format;
+  return binary;
+}
+#endif
+
+} // namespace lizard::overlay
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "overlay/gl_raii.h"
+
+// Linked GL programs saved with glGetProgramBinary, so later starts skip
+// compiling and linking. A binary only suits the driver and sources it came
+// from, so both are hashed into the key; a missing, stale or damaged file is
+// a miss and the caller compiles from source.
+namespace lizard::overlay {
+
+struct ProgramBinary {
+  std::uint32_t format = 0;
+  std::string data;
+};
+
+std::uint64_t program_key(std::string_view vendor, std::string_view renderer,
+                          std::string_view version, std::string_view vertex,
+                          std::string_view fragment);
+std::filesystem::path program_cache_path(const std::filesystem::path &dir, std::uint64_t key);
+
+std::optional<ProgramBinary> read_program_binary(const std::filesystem::path &path,
+                                                 std::uint64_t key);
+// Stored as a util blob file (util/blob_file.h).
+bool write_program_binary(const std::filesystem::path &path, std::uint64_t key,
+                          const ProgramBinary &binary);
+
+#ifndef LIZARD_TEST
+// Whether the current context can save and load program binaries.
+bool program_binaries_supported();
+// program_key() for the current context's driver.
+std::uint64_t current_program_key(std::string_view vertex, std::string_view fragment);
+// Links `program` from `binary`; false if the driver rejects it.
+bool load_program_binary(GLuint program, const ProgramBinary &binary);
+// Needs GL_PROGRAM_BINARY_RETRIEVABLE_HINT set before linking.
+std::optional<ProgramBinary> get_program_binary(GLuint program);
+#endif
+
+} // namespace lizard::overlay
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <utility>
+
+namespace lizard::platform {
+
+// Screen-space caret rectangle in physical pixels.
+struct CaretRect {
+  std::int32_t x = 0;
+  std::int32_t y = 0;
+  std::int32_t w = 0;
+  std::int32_t h = 0;
+};
+
+// Latest caret published by one writer (the tracker thread) and read by any
+// number of readers (the spawn path). A sequence lock: readers never block or
+// allocate, and a read that overlaps a write is simply retried. Two writers
+// could interleave and let a reader accept a torn rect, so events that arrive
+// on other threads are handed to the tracker thread rather than published.
+class CaretCache {
+public:
+  void publish(const CaretRect &rect) { write(rect, true); }
+  void clear() { write(CaretRect{}, false); }
+
+  std::optional<CaretRect> load() const {
+    for (;;) {
+      std::uint32_t before = seq_.load(std::memory_order_acquire);
+      if (before & 1u) {
+        continue;
+      }
+      CaretRect rect{x_.load(std::memory_order_relaxed), y_.load(std::memory_order_relaxed),
+                     w_.load(std::memory_order_relaxed), h_.load(std::memory_order_relaxed)};
+      bool valid = valid_.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (seq_.load(std::memory_order_relaxed) == before) {
+        return valid ? std::optional<CaretRect>(rect) : std::nullopt;
+      }
+    }
+  }
+
+private:
+  void write(const CaretRect &rect, bool valid) {
+    std::uint32_t seq = seq_.load(std::memory_order_relaxed);
+    seq_.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    x_.store(rect.x, std::memory_order_relaxed);
+    y_.store(rect.y, std::memory_order_relaxed);
+    w_.store(rect.w, std::memory_order_relaxed);
+    h_.store(rect.h, std::memory_order_relaxed);
+    valid_.store(valid, std::memory_order_relaxed);
+    seq_.store(seq + 2, std::memory_order_release);
+  }
+
+  std::atomic<std::uint32_t> seq_{0};
+  std::atomic<std::int32_t> x_{0};
+  std::atomic<std::int32_t> y_{0};
+  std::atomic<std::int32_t> w_{0};
+  std::atomic<std::int32_t> h_{0};
+  std::atomic<bool> valid_{false};
+};
+
+// The tracker's cache while start_caret_tracker() is in effect, otherwise
+// nullptr. Implemented next to each platform's tracker.
+const CaretCache *active_caret_cache();
+
+// The spawn point for a caret: horizontally centred, on its baseline.
+inline std::pair<float, float> caret_anchor(const CaretRect &rect) {
+  return {static_cast<float>(rect.x) + static_cast<float>(rect.w) * 0.5f,
+          static_cast<float>(rect.y + rect.h)};
+}
+
+} // namespace lizard::platform
@@ -0,0 +1,277 @@
+#include "../caret_tracker.hpp"
+#include "../window.hpp"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <spdlog/spdlog.h>
+
+#ifdef LIZARD_HAVE_ATSPI
+#include <dbus/dbus.h>
+#endif
+
+#include "util/trace.h"
+
+namespace lizard::platform {
+
+namespace {
+
+CaretCache g_cache;
+std::atomic<bool> g_running{false};
+std::mutex g_control_mutex;
+std::jthread g_thread;
+
+#ifdef LIZARD_HAVE_ATSPI
+
+constexpr int kCallTimeoutMs = 250;
+constexpr const char *kCaretMatch =
+    "type='signal',interface='org.a11y.atspi.Event.Object',member='TextCaretMoved'";
+constexpr const char *kFocusMatch = "type='signal',interface='org.a11y.atspi.Event.Object',"
+                                    "member='StateChanged',arg0='focused'";
+
+struct MessageDeleter {
+  void operator()(DBusMessage *msg) const { dbus_message_unref(msg); }
+};
+using Message = std::unique_ptr<DBusMessage, MessageDeleter>;
+
+Message call(DBusConnection *conn, DBusMessage *request) {
+  Message owned(request);
+  DBusError err;
+  dbus_error_init(&err);
+  Message reply(dbus_connection_send_with_reply_and_block(conn, request, kCallTimeoutMs, &err));
+  dbus_error_free(&err);
+  return reply;
+}
+
+// AT-SPI lives on its own bus; the session bus only tells us where it is.
+DBusConnection *open_a11y_bus() {
+  DBusError err;
+  dbus_error_init(&err);
+  DBusConnection *session = dbus_bus_get_private(DBUS_BUS_SESSION, &err);
+  if (!session) {
+    spdlog::warn("Caret tracking disabled: no session bus ({})",
+                 err.message ? err.message : "unknown");
+    dbus_error_free(&err);
+    return nullptr;
+  }
+  std::string address;
+  Message reply = call(session, dbus_message_new_method_call("org.a11y.Bus", "/org/a11y/bus",
+                                                             "org.a11y.Bus", "GetAddress"));
+  const char *addr = nullptr;
+  if (reply &&
+      dbus_message_get_args(reply.get(), &err, DBUS_TYPE_STRING, &addr, DBUS_TYPE_INVALID)) {
+    address = addr;
+  }
+  dbus_error_free(&err);
+  dbus_connection_close(session);
+  dbus_connection_unref(session);
+  if (address.empty()) {
+    spdlog::warn("Caret tracking disabled: accessibility bus not available");
+    return nullptr;
+  }
+
+  DBusConnection *conn = dbus_connection_open_private(address.c_str(), &err);
+  if (!conn || !dbus_bus_register(conn, &err)) {
+    spdlog::warn("Caret tracking disabled: cannot join accessibility bus ({})",
+                 err.message ? err.message : "unknown");
+    dbus_error_free(&err);
+    if (conn) {
+      dbus_connection_close(conn);
+      dbus_connection_unref(conn);
+    }
+    return nullptr;
+  }
+  return conn;
+}
+
+void register_event(DBusConnection *conn, const char *event) {
+  DBusMessage *msg =
+      dbus_message_new_method_call("org.a11y.atspi.Registry", "/org/a11y/atspi/registry",
+                                   "org.a11y.atspi.Registry", "RegisterEvent");
+  dbus_message_append_args(msg, DBUS_TYPE_STRING, &event, DBUS_TYPE_INVALID);
+  dbus_connection_send(conn, msg, nullptr);
+  dbus_message_unref(msg);
+}
+
+std::optional<std::int32_t> caret_offset(DBusConnection *conn, const char *sender,
+                                         const char *path) {
+  DBusMessage *msg = dbus_message_new_method_call(sender, path, "org.freedesktop.DBus.Properties",
+                                                  "Get");
+  const char *iface = "org.a11y.atspi.Text";
+  const char *prop = "CaretOffset";
+  dbus_message_append_args(msg, DBUS_TYPE_STRING, &iface, DBUS_TYPE_STRING, &prop,
+                           DBUS_TYPE_INVALID);
+  Message reply = call(conn, msg);
+  DBusMessageIter it;
+  DBusMessageIter variant;
+  if (!reply || !dbus_message_iter_init(reply.get(), &it) ||
+      dbus_message_iter_get_arg_type(&it) != DBUS_TYPE_VARIANT) {
+    return std::nullopt;
+  }
+  dbus_message_iter_recurse(&it, &variant);
+  if (dbus_message_iter_get_arg_type(&variant) != DBUS_TYPE_INT32) {
+    return std::nullopt;
+  }
+  dbus_int32_t offset = 0;
+  dbus_message_iter_get_basic(&variant, &offset);
+  return offset;
+}
+
+std::optional<CaretRect> character_extents(DBusConnection *conn, const char *sender,
+                                           const char *path, std::int32_t offset) {
+  DBusMessage *msg =
+      dbus_message_new_method_call(sender, path, "org.a11y.atspi.Text", "GetCharacterExtents");
+  dbus_int32_t off = offset;
+  dbus_uint32_t coord_type = 0; // ATSPI_COORD_TYPE_SCREEN
+  dbus_message_append_args(msg, DBUS_TYPE_INT32, &off, DBUS_TYPE_UINT32, &coord_type,
+                           DBUS_TYPE_INVALID);
+  Message reply = call(conn, msg);
+  DBusError err;
+  dbus_error_init(&err);
+  dbus_int32_t x = 0, y = 0, w = 0, h = 0;
+  bool ok = reply && dbus_message_get_args(reply.get(), &err, DBUS_TYPE_INT32, &x, DBUS_TYPE_INT32,
+                                           &y, DBUS_TYPE_INT32, &w, DBUS_TYPE_INT32, &h,
+                                           DBUS_TYPE_INVALID);
+  dbus_error_free(&err);
+  if (!ok || (w <= 0 && h <= 0)) {
+    return std::nullopt;
+  }
+  return CaretRect{x, y, w, h};
+}
+
+// Caret past the last character has no extents of its own; use the trailing
+// edge of the previous character instead.
+std::optional<CaretRect> caret_extents(DBusConnection *conn, const char *sender, const char *path,
+                                       std::int32_t offset) {
+  if (auto rect = character_extents(conn, sender, path, offset)) {
+    return CaretRect{rect->x, rect->y, 0, rect->h};
+  }
+  if (offset > 0) {
+    if (auto rect = character_extents(conn, sender, path, offset - 1)) {
+      return CaretRect{rect->x + rect->w, rect->y, 0, rect->h};
+    }
+  }
+  return std::nullopt;
+}
+
+// AT-SPI events carry (type, detail1, detail2, any_data, properties).
+bool read_event_header(DBusMessage *msg, std::string &type, std::int32_t &detail1) {
+  DBusMessageIter it;
+  if (!dbus_message_iter_init(msg, &it) || dbus_message_iter_get_arg_type(&it) != DBUS_TYPE_STRING) {
+    return false;
+  }
+  const char *str = nullptr;
+  dbus_message_iter_get_basic(&it, &str);
+  type = str ? str : "";
+  if (!dbus_message_iter_next(&it) || dbus_message_iter_get_arg_type(&it) != DBUS_TYPE_INT32) {
+    return false;
+  }
+  dbus_int32_t value = 0;
+  dbus_message_iter_get_basic(&it, &value);
+  detail1 = value;
+  return true;
+}
+
+void track(std::stop_token st, DBusConnection *conn) {
+  LIZARD_TRACE_THREAD("caret_tracker");
+  std::string focused_sender;
+  std::string focused_path;
+  while (!st.stop_requested()) {
+    // Bounded wait so a stop request is noticed without a wake-up channel.
+    if (!dbus_connection_read_write(conn, 200)) {
+      spdlog::warn("Accessibility bus disconnected; caret tracking stopped");
+      break;
+    }
+    while (DBusMessage *raw = dbus_connection_pop_message(conn)) {
+      Message msg(raw);
+      if (dbus_message_get_type(raw) != DBUS_MESSAGE_TYPE_SIGNAL) {
+        continue;
+      }
+      const char *sender = dbus_message_get_sender(raw);
+      const char *path = dbus_message_get_path(raw);
+      std::string type;
+      std::int32_t detail1 = 0;
+      if (!sender || !path || !read_event_header(raw, type, detail1)) {
+        continue;
+      }
+      if (dbus_message_is_signal(raw, "org.a11y.atspi.Event.Object", "TextCaretMoved")) {
+        focused_sender = sender;
+        focused_path = path;
+        if (auto rect = caret_extents(conn, sender, path, detail1)) {
+          g_cache.publish(*rect);
+        }
+      } else if (dbus_message_is_signal(raw, "org.a11y.atspi.Event.Object", "StateChanged") &&
+                 type == "focused") {
+        if (detail1 != 0) {
+          focused_sender = sender;
+          focused_path = path;
+          auto offset = caret_offset(conn, sender, path);
+          auto rect = offset ? caret_extents(conn, sender, path, *offset) : std::nullopt;
+          if (rect) {
+            g_cache.publish(*rect);
+          } else {
+            g_cache.clear();
+          }
+        } else if (focused_sender == sender && focused_path == path) {
+          g_cache.clear();
+        }
+      }
+    }
+  }
+  g_running.store(false, std::memory_order_release);
+  g_cache.clear();
+  dbus_connection_close(conn);
+  dbus_connection_unref(conn);
+}
+
+#endif
+
+} // namespace
+
+const CaretCache *active_caret_cache() {
+  return g_running.load(std::memory_order_acquire) ? &g_cache : nullptr;
+}
+
+bool start_caret_tracker() {
+  std::lock_guard<std::mutex> lock(g_control_mutex);
+  if (g_running.load(std::memory_order_acquire)) {
+    return true;
+  }
+#ifdef LIZARD_HAVE_ATSPI
+  if (g_thread.joinable()) {
+    g_thread.join(); // a previous tracker that lost its bus
+  }
+  DBusConnection *conn = open_a11y_bus();
+  if (!conn) {
+    return false;
+  }
+  DBusError err;
+  dbus_error_init(&err);
+  dbus_bus_add_match(conn, kCaretMatch, &err);
+  dbus_error_free(&err);
+  dbus_bus_add_match(conn, kFocusMatch, &err);
+  dbus_error_free(&err);
+  register_event(conn, "object:text-caret-moved");
+  register_event(conn, "object:state-changed:focused");
+  g_cache.clear();
+  g_running.store(true, std::memory_order_release);
+  g_thread = std::jthread([conn](std::stop_token st) { track(st, conn); });
+  return true;
+#else
+  spdlog::info("Caret tracking unavailable: built without D-Bus");
+  return false;
+#endif
+}
+
+void stop_caret_tracker() {
+  std::lock_guard<std::mutex> lock(g_control_mutex);
+  if (g_thread.joinable()) {
+    g_thread.request_stop();
+    g_thread.join();
+  }
+  g_running.store(false, std::memory_order_release);
+}
+
+} // namespace lizard::platform
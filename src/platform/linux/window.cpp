@@ -1,26 +1,40 @@
 #include "glad/glad.h"
 #include "../window.hpp"
+#include "../caret_tracker.hpp"
 
-#include <X11/Xatom.h>
 #include <X11/Xlib.h>
 #include <X11/extensions/Xfixes.h>
 #include <X11/extensions/shape.h>
-#include <X11/extensions/Xrandr.h>
+#include <sys/select.h>
+#include <unistd.h>
 #include <vector>
 #include <mutex>
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
 #include <optional>
 
+#include <spdlog/spdlog.h>
+
+#include "util/trace.h"
+#include "xcb_query.hpp"
+
 namespace lizard::platform {
 
 namespace {
 
+// The render connection. Only the thread driving the overlay (create, run,
+// shutdown happen in sequence) touches it, so it needs no lock; queries from
+// other subsystems go through the shared XCB query connection instead.
 Display *g_display = nullptr;
 ::Window g_root = 0;
-::Window g_overlay = 0;
-std::mutex g_display_mutex;
+std::atomic<::Window> g_overlay{0};
 std::once_flag g_xlib_init_once;
 
+namespace xq = lizard::platform::xcb;
+using MonitorRect = xq::Rect;
+
 float compute_dpi(Display *dpy) {
   int screen = DefaultScreen(dpy);
   int width_px = DisplayWidth(dpy, screen);
@@ -29,6 +43,52 @@ float compute_dpi(Display *dpy) {
   return dpi / 96.0f;
 }
 
+// Whether `window` is fullscreen: it carries _NET_WM_STATE_FULLSCREEN or
+// covers a whole monitor. Its state, attributes, size and origin are
+// requested together, so this costs one round-trip.
+bool window_fullscreen(const xq::Connection &q, xcb_window_t window,
+                       const std::vector<MonitorRect> &monitors) {
+  if (window == XCB_WINDOW_NONE) {
+    return false;
+  }
+  xcb_atom_t net_state = xq::atom("_NET_WM_STATE");
+  xcb_atom_t net_fullscreen = xq::atom("_NET_WM_STATE_FULLSCREEN");
+  auto state_cookie = xcb_get_property(q.conn, 0, window, net_state, XCB_ATOM_ATOM, 0, 64);
+  auto attrs_cookie = xcb_get_window_attributes(q.conn, window);
+  auto geometry_cookie = xcb_get_geometry(q.conn, window);
+  auto origin_cookie = xcb_translate_coordinates(q.conn, window, q.root, 0, 0);
+  auto state = xq::take_reply(q.conn, xcb_get_property_reply, state_cookie);
+  auto attrs = xq::take_reply(q.conn, xcb_get_window_attributes_reply, attrs_cookie);
+  auto geometry = xq::take_reply(q.conn, xcb_get_geometry_reply, geometry_cookie);
+  auto origin = xq::take_reply(q.conn, xcb_translate_coordinates_reply, origin_cookie);
+  if (state && state->format == 32) {
+    const auto *atoms = static_cast<const xcb_atom_t *>(xcb_get_property_value(state.get()));
+    const auto count = static_cast<std::size_t>(xcb_get_property_value_length(state.get())) /
+                       sizeof(xcb_atom_t);
+    if (std::find(atoms, atoms + count, net_fullscreen) != atoms + count) {
+      return true;
+    }
+  }
+  if (!attrs || !geometry || !origin || attrs->map_state != XCB_MAP_STATE_VIEWABLE) {
+    return false;
+  }
+  int wx = origin->dst_x;
+  int wy = origin->dst_y;
+  int ww = geometry->width;
+  int wh = geometry->height;
+  return std::any_of(monitors.begin(), monitors.end(), [&](const MonitorRect &m) {
+    return wx <= m.x && wy <= m.y && wx + ww >= m.x + m.w && wy + wh >= m.y + m.h;
+  });
+}
+
+// Parks the fullscreen watcher until it is stopped, for when X is unavailable.
+void wait_for_stop(std::stop_token st) {
+  std::mutex m;
+  std::condition_variable_any cv;
+  std::unique_lock lk(m);
+  cv.wait(lk, st, [] { return false; });
+}
+
 } // namespace
 
 void init_xlib_threads() {
@@ -38,7 +98,6 @@ void init_xlib_threads() {
 Window create_overlay_window(const WindowDesc &desc) {
   init_xlib_threads();
   Window result{};
-  std::lock_guard<std::mutex> lock(g_display_mutex);
   g_display = XOpenDisplay(nullptr);
   if (!g_display) {
     return result;
@@ -54,7 +113,7 @@ Window create_overlay_window(const WindowDesc &desc) {
   ::Window win = XCreateWindow(g_display, g_root, desc.x, desc.y, desc.width, desc.height, 0,
                                CopyFromParent, InputOutput, CopyFromParent,
                                CWOverrideRedirect | CWEventMask | CWBackPixel, &attrs);
-  g_overlay = win;
+  g_overlay.store(win, std::memory_order_relaxed);
 
   XMapRaised(g_display, win);
 
@@ -109,13 +168,13 @@ Window create_overlay_window(const WindowDesc &desc) {
 }
 
 void destroy_window(Window &window) {
-  std::lock_guard<std::mutex> lock(g_display_mutex);
   if (g_display && window.native) {
     glXMakeCurrent(g_display, None, nullptr);
     if (window.glContext) {
       glXDestroyContext(g_display, window.glContext);
       window.glContext = nullptr;
     }
+    g_overlay.store(0, std::memory_order_relaxed);
     XDestroyWindow(g_display, (::Window)window.native);
     XCloseDisplay(g_display);
     g_display = nullptr;
@@ -124,7 +183,6 @@ void destroy_window(Window &window) {
 }
 
 void poll_events(Window &window) {
-  std::lock_guard<std::mutex> lock(g_display_mutex);
   if (!g_display || !window.native) {
     return;
   }
@@ -135,166 +193,190 @@ void poll_events(Window &window) {
 }
 
 std::pair<float, float> cursor_pos() {
-  std::lock_guard<std::mutex> lock(g_display_mutex);
-  if (!g_display) {
+  const auto *q = xq::query_connection();
+  if (!q) {
     return {0.5f, 0.5f};
   }
-  ::Window root_return, child;
-  int root_x = 0, root_y = 0;
-  int win_x = 0, win_y = 0;
-  unsigned int mask = 0;
-  if (!XQueryPointer(g_display, g_root, &root_return, &child, &root_x, &root_y, &win_x, &win_y,
-                     &mask)) {
+  auto pointer_cookie = xcb_query_pointer(q->conn, q->root);
+  auto monitors_cookie = xq::request_monitors(*q);
+  auto pointer = xq::take_reply(q->conn, xcb_query_pointer_reply, pointer_cookie);
+  auto monitors = xq::collect_monitors(*q, monitors_cookie);
+  if (!pointer) {
     return {0.5f, 0.5f};
   }
-  int nmon = 0;
-  XRRMonitorInfo *mons = XRRGetMonitors(g_display, g_root, True, &nmon);
-  int min_x = 0, min_y = 0, max_x = 0, max_y = 0;
-  if (mons && nmon > 0) {
-    min_x = mons[0].x;
-    min_y = mons[0].y;
-    max_x = mons[0].x + mons[0].width;
-    max_y = mons[0].y + mons[0].height;
-    for (int i = 1; i < nmon; ++i) {
-      min_x = std::min(min_x, mons[i].x);
-      min_y = std::min(min_y, mons[i].y);
-      max_x = std::max(max_x, mons[i].x + mons[i].width);
-      max_y = std::max(max_y, mons[i].y + mons[i].height);
-    }
-  } else {
-    int screen = DefaultScreen(g_display);
-    min_x = 0;
-    min_y = 0;
-    max_x = DisplayWidth(g_display, screen);
-    max_y = DisplayHeight(g_display, screen);
+  int min_x = monitors.front().x;
+  int min_y = monitors.front().y;
+  int max_x = monitors.front().x + monitors.front().w;
+  int max_y = monitors.front().y + monitors.front().h;
+  for (const auto &m : monitors) {
+    min_x = std::min(min_x, m.x);
+    min_y = std::min(min_y, m.y);
+    max_x = std::max(max_x, m.x + m.w);
+    max_y = std::max(max_y, m.y + m.h);
   }
-  if (mons)
-    XRRFreeMonitors(mons);
   float w = static_cast<float>(max_x - min_x);
   float h = static_cast<float>(max_y - min_y);
-  float x = w > 0.0f ? static_cast<float>(root_x - min_x) / w : 0.5f;
-  float y = h > 0.0f ? static_cast<float>(root_y - min_y) / h : 0.5f;
+  float x = w > 0.0f ? static_cast<float>(pointer->root_x - min_x) / w : 0.5f;
+  float y = h > 0.0f ? static_cast<float>(pointer->root_y - min_y) / h : 0.5f;
   x = std::clamp(x, 0.0f, 1.0f);
   y = std::clamp(y, 0.0f, 1.0f);
   return {x, y};
 }
 
 std::optional<std::pair<float, float>> caret_pos() {
-  std::lock_guard<std::mutex> lock(g_display_mutex);
-  if (!g_display) {
-    return std::nullopt;
-  }
-  Atom active_atom = XInternAtom(g_display, "_NET_ACTIVE_WINDOW", False);
-  if (active_atom == None) {
-    return std::nullopt;
-  }
-  Atom actual_type = None;
-  int actual_format = 0;
-  unsigned long nitems = 0;
-  unsigned long bytes = 0;
-  unsigned char *data = nullptr;
-  if (XGetWindowProperty(g_display, g_root, active_atom, 0, ~0L, False, XA_WINDOW, &actual_type,
-                         &actual_format, &nitems, &bytes, &data) != Success || !data || nitems == 0) {
-    if (data) {
-      XFree(data);
+  if (const auto *tracked = active_caret_cache()) {
+    if (auto rect = tracked->load()) {
+      return caret_anchor(*rect);
     }
     return std::nullopt;
   }
-  ::Window active = reinterpret_cast<::Window *>(data)[0];
-  XFree(data);
-  if (!active || active == g_overlay) {
-    return std::nullopt;
-  }
-  XWindowAttributes attrs{};
-  if (!XGetWindowAttributes(g_display, active, &attrs)) {
+  // Without AT-SPI the best available anchor is the active window's centre.
+  auto active = xq::active_window_rect();
+  if (!active || active->window == g_overlay.load(std::memory_order_relaxed)) {
     return std::nullopt;
   }
-  int abs_x = attrs.x;
-  int abs_y = attrs.y;
-  ::Window child;
-  if (XTranslateCoordinates(g_display, active, g_root, 0, 0, &abs_x, &abs_y, &child) == False) {
-    abs_x = attrs.x;
-    abs_y = attrs.y;
-  }
-  float center_x = abs_x + attrs.width * 0.5f;
-  float center_y = abs_y + attrs.height * 0.5f;
+  float center_x = active->rect.x + active->rect.w * 0.5f;
+  float center_y = active->rect.y + active->rect.h * 0.5f;
   return std::pair<float, float>{center_x, center_y};
 }
 
 bool fullscreen_window_present() {
-  std::lock_guard<std::mutex> lock(g_display_mutex);
-  if (!g_display) {
-    return false;
-  }
-  Atom listAtom = XInternAtom(g_display, "_NET_CLIENT_LIST_STACKING", False);
-  Atom type;
-  int format;
-  unsigned long nitems, bytes;
-  unsigned char *data = nullptr;
-  if (XGetWindowProperty(g_display, g_root, listAtom, 0, ~0L, False, XA_WINDOW, &type, &format,
-                         &nitems, &bytes, &data) != Success ||
-      !data) {
-    if (data)
-      XFree(data);
+  const auto *q = xq::query_connection();
+  if (!q) {
     return false;
   }
-  std::vector<::Window> stack(reinterpret_cast<::Window *>(data),
-                              reinterpret_cast<::Window *>(data) + nitems);
-  XFree(data);
-
-  int nmon = 0;
-  XRRMonitorInfo *mons = XRRGetMonitors(g_display, g_root, True, &nmon);
-  struct Mon {
-    int x, y, w, h;
-  };
-  std::vector<Mon> monitors;
-  std::vector<bool> seen;
-  if (mons && nmon > 0) {
-    for (int i = 0; i < nmon; ++i) {
-      monitors.push_back({mons[i].x, mons[i].y, mons[i].width, mons[i].height});
+  auto monitors_cookie = xq::request_monitors(*q);
+  xcb_window_t active = xq::active_window(*q);
+  auto monitors = xq::collect_monitors(*q, monitors_cookie);
+  return active != g_overlay.load(std::memory_order_relaxed) &&
+         window_fullscreen(*q, active, monitors);
+}
+
+void watch_fullscreen(std::stop_token st, const std::function<void(bool)> &on_change) {
+  // Queries go through the shared query connection. This one only receives
+  // the events selected below; errors for a window that has just gone away
+  // arrive on it as events and are dropped, so nothing process-wide changes.
+  const auto *q = xq::query_connection();
+  xcb_connection_t *events = q ? xcb_connect(nullptr, nullptr) : nullptr;
+  if (!events || xcb_connection_has_error(events)) {
+    if (events) {
+      xcb_disconnect(events);
     }
-    seen.resize(monitors.size(), false);
-  } else {
-    int screen = DefaultScreen(g_display);
-    monitors.push_back({0, 0, DisplayWidth(g_display, screen), DisplayHeight(g_display, screen)});
-    seen.resize(1, false);
+    on_change(false);
+    wait_for_stop(st);
+    return;
   }
-  if (mons)
-    XRRFreeMonitors(mons);
-
-  bool full = false;
-  for (auto it = stack.rbegin(); it != stack.rend() && !full; ++it) {
-    ::Window win = *it;
-    if (win == g_overlay) {
-      continue;
-    }
-    XWindowAttributes attrs;
-    if (!XGetWindowAttributes(g_display, win, &attrs) || attrs.map_state != IsViewable) {
-      continue;
+  int wake_fds[2]{-1, -1};
+  if (pipe(wake_fds) != 0) {
+    xcb_disconnect(events);
+    on_change(false);
+    wait_for_stop(st);
+    return;
+  }
+  {
+    std::stop_callback wake(st, [&] {
+      [[maybe_unused]] ssize_t n = write(wake_fds[1], "\0", 1);
+    });
+
+    xcb_atom_t net_active = xq::atom("_NET_ACTIVE_WINDOW");
+    xcb_atom_t net_state = xq::atom("_NET_WM_STATE");
+    std::uint32_t root_mask = XCB_EVENT_MASK_PROPERTY_CHANGE;
+    xcb_change_window_attributes(events, q->root, XCB_CW_EVENT_MASK, &root_mask);
+    const auto *randr = xcb_get_extension_data(events, &xcb_randr_id);
+    bool have_rr = randr && randr->present;
+    if (have_rr) {
+      xcb_randr_select_input(events, q->root, XCB_RANDR_NOTIFY_MASK_SCREEN_CHANGE);
     }
-    int wx = 0, wy = 0;
-    ::Window child;
-    XTranslateCoordinates(g_display, win, g_root, 0, 0, &wx, &wy, &child);
-    for (std::size_t i = 0; i < monitors.size(); ++i) {
-      if (seen[i]) {
-        continue;
+    xcb_flush(events);
+    auto monitors = xq::collect_monitors(*q, xq::request_monitors(*q));
+
+    xcb_window_t tracked = XCB_WINDOW_NONE;
+    auto retrack = [&] {
+      xcb_window_t active = xq::active_window(*q);
+      if (active == tracked) {
+        return;
+      }
+      if (tracked != XCB_WINDOW_NONE) {
+        std::uint32_t none = XCB_EVENT_MASK_NO_EVENT;
+        xcb_change_window_attributes(events, tracked, XCB_CW_EVENT_MASK, &none);
       }
-      auto &m = monitors[i];
-      if (wx <= m.x && wy <= m.y && wx + attrs.width >= m.x + m.w &&
-          wy + attrs.height >= m.y + m.h) {
-        full = true;
-        break;
+      tracked = active;
+      if (tracked != XCB_WINDOW_NONE) {
+        std::uint32_t mask = XCB_EVENT_MASK_PROPERTY_CHANGE | XCB_EVENT_MASK_STRUCTURE_NOTIFY;
+        xcb_change_window_attributes(events, tracked, XCB_CW_EVENT_MASK, &mask);
+      }
+      xcb_flush(events);
+    };
+
+    retrack();
+    bool current = window_fullscreen(*q, tracked, monitors);
+    on_change(current);
+
+    int xfd = xcb_get_file_descriptor(events);
+    int nfds = std::max(xfd, wake_fds[0]) + 1;
+    while (!st.stop_requested() && !xcb_connection_has_error(events)) {
+      bool dirty = false;
+      bool need_retrack = false;
+      while (xq::Reply<xcb_generic_event_t> ev{xcb_poll_for_event(events)}) {
+        const std::uint8_t type = ev->response_type & ~0x80;
+        if (type == XCB_PROPERTY_NOTIFY) {
+          const auto *prop = reinterpret_cast<const xcb_property_notify_event_t *>(ev.get());
+          if (prop->window == q->root && prop->atom == net_active) {
+            need_retrack = true;
+          } else if (prop->window == tracked && prop->atom == net_state) {
+            dirty = true;
+          }
+        } else if (type == XCB_CONFIGURE_NOTIFY) {
+          const auto *conf = reinterpret_cast<const xcb_configure_notify_event_t *>(ev.get());
+          dirty = dirty || conf->window == tracked;
+        } else if (type == XCB_DESTROY_NOTIFY) {
+          const auto *gone = reinterpret_cast<const xcb_destroy_notify_event_t *>(ev.get());
+          need_retrack = need_retrack || gone->window == tracked;
+        } else if (type == XCB_UNMAP_NOTIFY) {
+          const auto *unmap = reinterpret_cast<const xcb_unmap_notify_event_t *>(ev.get());
+          need_retrack = need_retrack || unmap->window == tracked;
+        } else if (have_rr && type == randr->first_event + XCB_RANDR_SCREEN_CHANGE_NOTIFY) {
+          monitors = xq::collect_monitors(*q, xq::request_monitors(*q));
+          dirty = true;
+        }
+        // type 0 is an error, e.g. BadWindow for a window that was destroyed
+        // before the request reached the server; there is nothing to do.
       }
-      if (wx < m.x + m.w && wx + attrs.width > m.x && wy < m.y + m.h && wy + attrs.height > m.y) {
-        seen[i] = true;
+      if (need_retrack) {
+        retrack();
+        dirty = true;
+      }
+      if (dirty) {
+        bool state = window_fullscreen(*q, tracked, monitors);
+        if (state != current) {
+          current = state;
+          on_change(current);
+        }
+      }
+      fd_set set;
+      FD_ZERO(&set);
+      FD_SET(xfd, &set);
+      FD_SET(wake_fds[0], &set);
+      if (select(nfds, &set, nullptr, nullptr, nullptr) <= 0) {
+        continue;
+      }
+      if (FD_ISSET(wake_fds[0], &set)) {
+        char buf[8];
+        [[maybe_unused]] ssize_t n = read(wake_fds[0], buf, sizeof(buf));
       }
     }
   }
-  return full;
+  xcb_disconnect(events);
+  close(wake_fds[0]);
+  close(wake_fds[1]);
+  if (!st.stop_requested()) {
+    spdlog::warn("Lost the X connection; fullscreen pause disabled");
+    on_change(false);
+    wait_for_stop(st);
+  }
 }
 
 void make_context_current(Window &window) {
-  std::lock_guard<std::mutex> lock(g_display_mutex);
   if (g_display && window.native && window.glContext) {
     glXMakeCurrent(g_display, static_cast<GLXDrawable>(reinterpret_cast<::Window>(window.native)),
                    window.glContext);
@@ -302,14 +384,13 @@ void make_context_current(Window &window) {
 }
 
 void clear_current_context(Window &) {
-  std::lock_guard<std::mutex> lock(g_display_mutex);
   if (g_display) {
     glXMakeCurrent(g_display, None, nullptr);
   }
 }
 
 void swap_buffers(Window &window) {
-  std::lock_guard<std::mutex> lock(g_display_mutex);
+  LIZARD_TRACE_ZONE("platform::swap_buffers");
   if (g_display && window.native) {
     glXSwapBuffers(g_display, static_cast<GLXDrawable>(reinterpret_cast<::Window>(window.native)));
   }
@@ -0,0 +1,151 @@
+#include "xcb_query.hpp"
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace lizard::platform::xcb {
+
+namespace {
+
+struct OwnedConnection : Connection {
+  ~OwnedConnection() {
+    if (conn) {
+      xcb_disconnect(conn);
+    }
+  }
+};
+
+OwnedConnection g_query;
+std::once_flag g_query_once;
+
+std::mutex g_atoms_mutex;
+std::unordered_map<std::string, xcb_atom_t> g_atoms;
+
+void open_query_connection() {
+  int screen_index = 0;
+  xcb_connection_t *conn = xcb_connect(nullptr, &screen_index);
+  if (xcb_connection_has_error(conn)) {
+    xcb_disconnect(conn);
+    return;
+  }
+  auto it = xcb_setup_roots_iterator(xcb_get_setup(conn));
+  for (int i = 0; i < screen_index && it.rem; ++i) {
+    xcb_screen_next(&it);
+  }
+  if (!it.rem) {
+    xcb_disconnect(conn);
+    return;
+  }
+  g_query.conn = conn;
+  g_query.root = it.data->root;
+  g_query.screen_width = it.data->width_in_pixels;
+  g_query.screen_height = it.data->height_in_pixels;
+
+  const auto *randr = xcb_get_extension_data(conn, &xcb_randr_id);
+  if (randr && randr->present) {
+    auto version =
+        take_reply(conn, xcb_randr_query_version_reply, xcb_randr_query_version(conn, 1, 5));
+    g_query.have_monitors = version && (version->major_version > 1 ||
+                                        (version->major_version == 1 && version->minor_version >= 5));
+  }
+}
+
+} // namespace
+
+const Connection *query_connection() {
+  std::call_once(g_query_once, open_query_connection);
+  return g_query.conn ? &g_query : nullptr;
+}
+
+xcb_atom_t atom(std::string_view name) {
+  const Connection *c = query_connection();
+  if (!c) {
+    return XCB_ATOM_NONE;
+  }
+  std::string key(name);
+  {
+    std::lock_guard<std::mutex> lock(g_atoms_mutex);
+    if (auto it = g_atoms.find(key); it != g_atoms.end()) {
+      return it->second;
+    }
+  }
+  // Interned without only_if_exists, so the id is stable for the life of the
+  // server and safe to cache even before a window manager sets the property.
+  auto reply =
+      take_reply(c->conn, xcb_intern_atom_reply,
+                 xcb_intern_atom(c->conn, 0, static_cast<std::uint16_t>(key.size()), key.data()));
+  if (!reply) {
+    return XCB_ATOM_NONE;
+  }
+  std::lock_guard<std::mutex> lock(g_atoms_mutex);
+  g_atoms.emplace(std::move(key), reply->atom);
+  return reply->atom;
+}
+
+MonitorsCookie request_monitors(const Connection &c) {
+  if (!c.have_monitors) {
+    return std::nullopt;
+  }
+  return xcb_randr_get_monitors(c.conn, c.root, 1);
+}
+
+std::vector<Rect> collect_monitors(const Connection &c, MonitorsCookie cookie) {
+  std::vector<Rect> monitors;
+  if (cookie) {
+    if (auto reply = take_reply(c.conn, xcb_randr_get_monitors_reply, *cookie)) {
+      for (auto it = xcb_randr_get_monitors_monitors_iterator(reply.get()); it.rem;
+           xcb_randr_monitor_info_next(&it)) {
+        monitors.push_back({it.data->x, it.data->y, it.data->width, it.data->height});
+      }
+    }
+  }
+  if (monitors.empty()) {
+    monitors.push_back({0, 0, c.screen_width, c.screen_height});
+  }
+  return monitors;
+}
+
+std::optional<std::uint32_t> first_card32(const xcb_get_property_reply_t *reply) {
+  if (!reply || reply->format != 32 || xcb_get_property_value_length(reply) < 4) {
+    return std::nullopt;
+  }
+  return *static_cast<const std::uint32_t *>(xcb_get_property_value(reply));
+}
+
+xcb_window_t active_window(const Connection &c) {
+  xcb_atom_t net_active = atom("_NET_ACTIVE_WINDOW");
+  if (net_active == XCB_ATOM_NONE) {
+    return XCB_WINDOW_NONE;
+  }
+  auto reply = take_reply(c.conn, xcb_get_property_reply,
+                          xcb_get_property(c.conn, 0, c.root, net_active, XCB_ATOM_WINDOW, 0, 1));
+  return first_card32(reply.get()).value_or(XCB_WINDOW_NONE);
+}
+
+std::optional<WindowRect> active_window_rect() {
+  const Connection *c = query_connection();
+  if (!c) {
+    return std::nullopt;
+  }
+  xcb_window_t active = active_window(*c);
+  if (active == XCB_WINDOW_NONE) {
+    return std::nullopt;
+  }
+  auto geometry_cookie = xcb_get_geometry(c->conn, active);
+  auto origin_cookie = xcb_translate_coordinates(c->conn, active, c->root, 0, 0);
+  auto geometry = take_reply(c->conn, xcb_get_geometry_reply, geometry_cookie);
+  auto origin = take_reply(c->conn, xcb_translate_coordinates_reply, origin_cookie);
+  if (!geometry) {
+    return std::nullopt;
+  }
+  WindowRect result;
+  result.window = active;
+  result.rect.x = origin ? origin->dst_x : geometry->x;
+  result.rect.y = origin ? origin->dst_y : geometry->y;
+  result.rect.w = geometry->width;
+  result.rect.h = geometry->height;
+  return result;
+}
+
+} // namespace lizard::platform::xcb
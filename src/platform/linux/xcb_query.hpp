@@ -0,0 +1,81 @@
+#pragma once
+
+#include <xcb/randr.h>
+#include <xcb/xcb.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// Shared, thread-safe XCB connection for read-only X11 queries (active window,
+// window geometry, monitors, client properties). Callers issue every request
+// they can as a cookie before waiting on any reply, so a compound query costs
+// one round-trip of latency per dependency level rather than one per request.
+namespace lizard::platform::xcb {
+
+struct Connection {
+  xcb_connection_t *conn = nullptr;
+  xcb_window_t root = XCB_WINDOW_NONE;
+  std::uint16_t screen_width = 0;
+  std::uint16_t screen_height = 0;
+  bool have_monitors = false; // RandR >= 1.5
+};
+
+// Opened on first use and kept for the lifetime of the process. Returns
+// nullptr when no X server is reachable.
+const Connection *query_connection();
+
+// Interns `name` once per process; later lookups are served from a cache
+// without touching the server. Returns XCB_ATOM_NONE without a connection.
+xcb_atom_t atom(std::string_view name);
+
+struct FreeDeleter {
+  void operator()(void *p) const { std::free(p); }
+};
+
+template <typename T> using Reply = std::unique_ptr<T, FreeDeleter>;
+
+// Waits for `cookie` and takes ownership of the reply. Errors are consumed
+// here so they never pile up in the (unread) event queue.
+template <typename ReplyFn, typename Cookie>
+auto take_reply(xcb_connection_t *conn, ReplyFn fn, Cookie cookie) {
+  using T = std::remove_pointer_t<decltype(fn(conn, cookie, nullptr))>;
+  xcb_generic_error_t *error = nullptr;
+  Reply<T> reply(fn(conn, cookie, &error));
+  std::free(error);
+  return reply;
+}
+
+struct Rect {
+  int x, y, w, h;
+};
+
+using MonitorsCookie = std::optional<xcb_randr_get_monitors_cookie_t>;
+
+// Sends a RandR GetMonitors request if the server supports it.
+MonitorsCookie request_monitors(const Connection &c);
+
+// Never empty: falls back to the whole screen when RandR monitors are
+// unavailable.
+std::vector<Rect> collect_monitors(const Connection &c, MonitorsCookie cookie);
+
+// First 32-bit item of a property reply, or nullopt.
+std::optional<std::uint32_t> first_card32(const xcb_get_property_reply_t *reply);
+
+// _NET_ACTIVE_WINDOW of the root window, or XCB_WINDOW_NONE.
+xcb_window_t active_window(const Connection &c);
+
+struct WindowRect {
+  xcb_window_t window = XCB_WINDOW_NONE;
+  Rect rect{};
+};
+
+// The active window and its root-relative geometry: one round-trip for the
+// window id, then geometry and origin requested together.
+std::optional<WindowRect> active_window_rect();
+
+} // namespace lizard::platform::xcb
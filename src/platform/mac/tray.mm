@@ -7,6 +7,8 @@
 #include <thread>
 #include <future>
 
+#include "util/trace.h"
+
 namespace lizard::platform {
 
 namespace {
@@ -196,6 +198,7 @@ void shutdown_thread() {
 }
 
 void tray_thread(std::stop_token st, std::promise<bool> ready) {
+  LIZARD_TRACE_THREAD("tray");
   bool ok = init_thread();
   ready.set_value(ok);
   if (!ok)
@@ -4,10 +4,15 @@
 #include <Cocoa/Cocoa.h>
 #include <CoreGraphics/CoreGraphics.h>
 #include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <vector>
 #include <optional>
 #include <ApplicationServices/ApplicationServices.h>
 
+#include "util/trace.h"
+
 namespace lizard::platform {
 
 namespace {
@@ -147,6 +152,12 @@ std::optional<std::pair<float, float>> caret_pos() {
   }
 }
 
+// macOS has no caret event stream comparable to AT-SPI or UI Automation;
+// caret_pos() queries the focused element directly.
+bool start_caret_tracker() { return false; }
+
+void stop_caret_tracker() {}
+
 bool fullscreen_window_present() {
   @autoreleasepool {
     CFArrayRef list = CGWindowListCopyWindowInfo(
@@ -184,6 +195,63 @@ bool fullscreen_window_present() {
   }
 }
 
+void watch_fullscreen(std::stop_token st, const std::function<void(bool)> &on_change) {
+  struct Shared {
+    std::mutex mutex;
+    std::condition_variable_any cv;
+    bool dirty = false;
+  } shared;
+  Shared *sp = &shared;
+  auto mark_dirty = ^(NSNotification *) {
+    {
+      std::lock_guard<std::mutex> lock(sp->mutex);
+      sp->dirty = true;
+    }
+    sp->cv.notify_one();
+  };
+
+  id space_observer = nil;
+  id activate_observer = nil;
+  @autoreleasepool {
+    NSNotificationCenter *center = [[NSWorkspace sharedWorkspace] notificationCenter];
+    space_observer = [center addObserverForName:NSWorkspaceActiveSpaceDidChangeNotification
+                                         object:nil
+                                          queue:nil
+                                     usingBlock:mark_dirty];
+    activate_observer = [center addObserverForName:NSWorkspaceDidActivateApplicationNotification
+                                            object:nil
+                                             queue:nil
+                                        usingBlock:mark_dirty];
+  }
+
+  bool current = fullscreen_window_present();
+  on_change(current);
+  std::unique_lock<std::mutex> lock(shared.mutex);
+  while (!st.stop_requested()) {
+    // Native fullscreen switches Spaces and app switches are notified; a
+    // borderless window resized within the same app is not, so re-check slowly.
+    shared.cv.wait_for(lock, st, std::chrono::seconds(2), [&] { return shared.dirty; });
+    if (st.stop_requested()) {
+      break;
+    }
+    shared.dirty = false;
+    lock.unlock();
+    bool state = fullscreen_window_present();
+    if (state != current) {
+      current = state;
+      on_change(state);
+    }
+    lock.lock();
+  }
+  lock.unlock();
+
+  @autoreleasepool {
+    NSNotificationCenter *center = [[NSWorkspace sharedWorkspace] notificationCenter];
+    [center removeObserver:space_observer];
+    [center removeObserver:activate_observer];
+  }
+}
+
 void make_context_current(Window &window) {
   @autoreleasepool {
     if (window.glContext) {
@@ -197,6 +265,7 @@ void clear_current_context(Window &) {
 }
 
 void swap_buffers(Window &window) {
+  LIZARD_TRACE_ZONE("platform::swap_buffers");
   @autoreleasepool {
     if (window.glContext) {
       [(NSOpenGLContext *)window.glContext flushBuffer];
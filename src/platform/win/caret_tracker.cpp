@@ -0,0 +1,290 @@
+#include "../caret_tracker.hpp"
+#include "../window.hpp"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <ole2.h>
+#include <uiautomation.h>
+
+#include <cmath>
+#include <future>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+#include <spdlog/spdlog.h>
+
+#include "util/trace.h"
+
+namespace lizard::platform {
+
+namespace {
+
+CaretCache g_cache;
+std::atomic<bool> g_running{false};
+std::mutex g_control_mutex;
+std::jthread g_thread;
+
+// UIA events arrive on its worker threads. Focus changes need handlers added
+// and removed, which is not allowed there, and g_cache takes one writer, so
+// both focus changes and caret moves are handed to the tracker thread here.
+std::mutex g_pending_mutex;
+IUIAutomationElement *g_pending_focus = nullptr; // holds a reference
+std::optional<CaretRect> g_pending_caret;
+HANDLE g_wake = nullptr;
+
+std::optional<CaretRect> range_rect(IUIAutomationTextRange *range) {
+  SAFEARRAY *rects = nullptr;
+  if (FAILED(range->GetBoundingRectangles(&rects)) || !rects) {
+    return std::nullopt;
+  }
+  std::optional<CaretRect> result;
+  LONG lower = 0;
+  LONG upper = -1;
+  SafeArrayGetLBound(rects, 1, &lower);
+  SafeArrayGetUBound(rects, 1, &upper);
+  double *data = nullptr;
+  if (upper - lower + 1 >= 4 && SUCCEEDED(SafeArrayAccessData(rects, reinterpret_cast<void **>(&data)))) {
+    result = CaretRect{static_cast<std::int32_t>(std::lround(data[0])),
+                       static_cast<std::int32_t>(std::lround(data[1])),
+                       static_cast<std::int32_t>(std::lround(data[2])),
+                       static_cast<std::int32_t>(std::lround(data[3]))};
+    SafeArrayUnaccessData(rects);
+  }
+  SafeArrayDestroy(rects);
+  return result;
+}
+
+// The caret is the (usually collapsed) first selection range of the element's
+// TextPattern. Returns nullopt for elements without text support.
+std::optional<CaretRect> caret_from_element(IUIAutomationElement *element) {
+  IUIAutomationTextPattern *text = nullptr;
+  if (FAILED(element->GetCurrentPatternAs(UIA_TextPatternId, IID_PPV_ARGS(&text))) || !text) {
+    return std::nullopt;
+  }
+  IUIAutomationTextRangeArray *ranges = nullptr;
+  HRESULT hr = text->GetSelection(&ranges);
+  text->Release();
+  if (FAILED(hr) || !ranges) {
+    return std::nullopt;
+  }
+  int count = 0;
+  IUIAutomationTextRange *range = nullptr;
+  if (SUCCEEDED(ranges->get_Length(&count)) && count > 0) {
+    ranges->GetElement(0, &range);
+  }
+  ranges->Release();
+  if (!range) {
+    return std::nullopt;
+  }
+  auto rect = range_rect(range);
+  if (!rect) {
+    // A collapsed range often has no box of its own; measure one character.
+    IUIAutomationTextRange *probe = nullptr;
+    if (SUCCEEDED(range->Clone(&probe)) && probe) {
+      probe->ExpandToEnclosingUnit(TextUnit_Character);
+      rect = range_rect(probe);
+      if (rect) {
+        rect->w = 0;
+      }
+      probe->Release();
+    }
+  }
+  range->Release();
+  return rect;
+}
+
+template <typename Interface> class Handler : public Interface {
+public:
+  ULONG STDMETHODCALLTYPE AddRef() override { return ++refs_; }
+  ULONG STDMETHODCALLTYPE Release() override {
+    ULONG refs = --refs_;
+    if (refs == 0) {
+      delete this;
+    }
+    return refs;
+  }
+  HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void **out) override {
+    if (riid == __uuidof(IUnknown) || riid == __uuidof(Interface)) {
+      *out = static_cast<Interface *>(this);
+      AddRef();
+      return S_OK;
+    }
+    *out = nullptr;
+    return E_NOINTERFACE;
+  }
+
+protected:
+  virtual ~Handler() = default;
+
+private:
+  std::atomic<ULONG> refs_{1};
+};
+
+class FocusHandler : public Handler<IUIAutomationFocusChangedEventHandler> {
+public:
+  HRESULT STDMETHODCALLTYPE HandleFocusChangedEvent(IUIAutomationElement *sender) override {
+    if (sender) {
+      sender->AddRef();
+    }
+    {
+      std::lock_guard<std::mutex> lock(g_pending_mutex);
+      if (g_pending_focus) {
+        g_pending_focus->Release();
+      }
+      g_pending_focus = sender;
+    }
+    SetEvent(g_wake);
+    return S_OK;
+  }
+};
+
+class SelectionHandler : public Handler<IUIAutomationEventHandler> {
+public:
+  HRESULT STDMETHODCALLTYPE HandleAutomationEvent(IUIAutomationElement *sender,
+                                                  EVENTID) override {
+    if (sender) {
+      if (auto rect = caret_from_element(sender)) {
+        {
+          std::lock_guard<std::mutex> lock(g_pending_mutex);
+          g_pending_caret = rect;
+        }
+        SetEvent(g_wake);
+      }
+    }
+    return S_OK;
+  }
+};
+
+void track(std::stop_token st, std::promise<bool> started) {
+  LIZARD_TRACE_THREAD("caret_tracker");
+  if (FAILED(CoInitializeEx(nullptr, COINIT_MULTITHREADED))) {
+    started.set_value(false);
+    return;
+  }
+  IUIAutomation *automation = nullptr;
+  if (FAILED(CoCreateInstance(__uuidof(CUIAutomation), nullptr, CLSCTX_INPROC_SERVER,
+                              IID_PPV_ARGS(&automation))) ||
+      !automation) {
+    spdlog::warn("Caret tracking disabled: UI Automation unavailable");
+    CoUninitialize();
+    started.set_value(false);
+    return;
+  }
+  auto *focus_handler = new FocusHandler();
+  auto *selection_handler = new SelectionHandler();
+  automation->AddFocusChangedEventHandler(nullptr, focus_handler);
+  g_running.store(true, std::memory_order_release);
+  started.set_value(true);
+
+  IUIAutomationElement *tracked = nullptr;
+  auto retarget = [&](IUIAutomationElement *element) {
+    if (tracked) {
+      automation->RemoveAutomationEventHandler(UIA_Text_TextSelectionChangedEventId, tracked,
+                                               selection_handler);
+      tracked->Release();
+      tracked = nullptr;
+    }
+    auto rect = element ? caret_from_element(element) : std::nullopt;
+    if (!rect) {
+      g_cache.clear();
+      if (element) {
+        element->Release();
+      }
+      return;
+    }
+    g_cache.publish(*rect);
+    tracked = element;
+    automation->AddAutomationEventHandler(UIA_Text_TextSelectionChangedEventId, tracked,
+                                          TreeScope_Element, nullptr, selection_handler);
+  };
+
+  IUIAutomationElement *initial = nullptr;
+  if (SUCCEEDED(automation->GetFocusedElement(&initial))) {
+    retarget(initial);
+  }
+  {
+    std::stop_callback wake(st, [] { SetEvent(g_wake); });
+    while (!st.stop_requested()) {
+      WaitForSingleObject(g_wake, INFINITE);
+      IUIAutomationElement *focused = nullptr;
+      std::optional<CaretRect> caret;
+      {
+        std::lock_guard<std::mutex> lock(g_pending_mutex);
+        std::swap(focused, g_pending_focus);
+        std::swap(caret, g_pending_caret);
+      }
+      if (st.stop_requested()) {
+        if (focused) {
+          focused->Release();
+        }
+      } else if (focused) {
+        // Publishes the new element's caret; a move the old one reported in
+        // the meantime is stale.
+        retarget(focused);
+      } else if (caret && tracked) {
+        g_cache.publish(*caret);
+      }
+    }
+  }
+
+  g_running.store(false, std::memory_order_release);
+  automation->RemoveAllEventHandlers();
+  if (tracked) {
+    tracked->Release();
+  }
+  {
+    std::lock_guard<std::mutex> lock(g_pending_mutex);
+    if (g_pending_focus) {
+      g_pending_focus->Release();
+      g_pending_focus = nullptr;
+    }
+  }
+  focus_handler->Release();
+  selection_handler->Release();
+  automation->Release();
+  g_cache.clear();
+  CoUninitialize();
+}
+
+} // namespace
+
+const CaretCache *active_caret_cache() {
+  return g_running.load(std::memory_order_acquire) ? &g_cache : nullptr;
+}
+
+bool start_caret_tracker() {
+  std::lock_guard<std::mutex> lock(g_control_mutex);
+  if (g_running.load(std::memory_order_acquire)) {
+    return true;
+  }
+  if (g_thread.joinable()) {
+    g_thread.join();
+  }
+  if (!g_wake) {
+    g_wake = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+    if (!g_wake) {
+      return false;
+    }
+  }
+  std::promise<bool> ready;
+  auto fut = ready.get_future();
+  g_thread = std::jthread(
+      [p = std::move(ready)](std::stop_token st) mutable { track(st, std::move(p)); });
+  bool ok = fut.get();
+  if (!ok) {
+    g_thread.join();
+  }
+  return ok;
+}
+
+void stop_caret_tracker() {
+  std::lock_guard<std::mutex> lock(g_control_mutex);
+  if (g_thread.joinable()) {
+    g_thread.request_stop();
+    g_thread.join();
+  }
+}
+
+} // namespace lizard::platform
+#endif
@@ -11,6 +11,8 @@
 #include <mutex>
 #include <thread>
 
+#include "util/trace.h"
+
 namespace lizard::platform {
 
 namespace {
@@ -242,6 +244,7 @@ void shutdown_thread() {
 }
 
 void tray_thread(std::stop_token st, std::promise<bool> ready) {
+  LIZARD_TRACE_THREAD("tray");
   bool ok = init_thread();
   ready.set_value(ok);
   if (!ok)
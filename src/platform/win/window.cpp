@@ -1,4 +1,5 @@
 #include "../window.hpp"
+#include "../caret_tracker.hpp"
 
 #ifdef _WIN32
 #include "glad/glad.h"
@@ -7,6 +8,8 @@
 #include <algorithm>
 #include <vector>
 #include <optional>
+
+#include "util/trace.h"
 #pragma comment(lib, "dwmapi.lib")
 
 namespace lizard::platform {
@@ -22,6 +25,53 @@ float compute_dpi(HWND hwnd) {
 LRESULT CALLBACK wnd_proc(HWND hwnd, UINT msg, WPARAM wp, LPARAM lp) {
   return DefWindowProc(hwnd, msg, wp, lp);
 }
+
+struct FullscreenWatch {
+  const std::function<void(bool)> *on_change = nullptr;
+  bool current = false;
+};
+
+// WinEvent callbacks are delivered on the thread that installed the hook.
+thread_local FullscreenWatch *t_fullscreen_watch = nullptr;
+
+bool foreground_fullscreen() {
+  HWND hwnd = GetForegroundWindow();
+  if (!hwnd || hwnd == g_hwnd || hwnd == GetDesktopWindow() || hwnd == GetShellWindow() ||
+      !IsWindowVisible(hwnd) || IsIconic(hwnd)) {
+    return false;
+  }
+  RECT rect{};
+  if (!GetWindowRect(hwnd, &rect)) {
+    return false;
+  }
+  HMONITOR mon = MonitorFromWindow(hwnd, MONITOR_DEFAULTTONULL);
+  if (!mon) {
+    return false;
+  }
+  MONITORINFO mi{sizeof(mi)};
+  if (!GetMonitorInfo(mon, &mi)) {
+    return false;
+  }
+  return rect.left <= mi.rcMonitor.left && rect.top <= mi.rcMonitor.top &&
+         rect.right >= mi.rcMonitor.right && rect.bottom >= mi.rcMonitor.bottom;
+}
+
+void CALLBACK fullscreen_event_proc(HWINEVENTHOOK, DWORD event, HWND hwnd, LONG id_object, LONG,
+                                    DWORD, DWORD) {
+  auto *watch = t_fullscreen_watch;
+  if (!watch) {
+    return;
+  }
+  if (event == EVENT_OBJECT_LOCATIONCHANGE &&
+      (id_object != OBJID_WINDOW || hwnd != GetForegroundWindow())) {
+    return;
+  }
+  bool state = foreground_fullscreen();
+  if (state != watch->current) {
+    watch->current = state;
+    (*watch->on_change)(state);
+  }
+}
 } // namespace
 
 Window create_overlay_window(const WindowDesc &desc) {
@@ -121,6 +171,14 @@ std::pair<float, float> cursor_pos() {
 }
 
 std::optional<std::pair<float, float>> caret_pos() {
+  if (const auto *tracked = active_caret_cache()) {
+    if (auto rect = tracked->load()) {
+      return caret_anchor(*rect);
+    }
+    return std::nullopt;
+  }
+  // Without UI Automation fall back to the Win32 caret, which many modern
+  // toolkits (browsers, Electron, WPF) never create.
   GUITHREADINFO info{};
   info.cbSize = sizeof(info);
   HWND foreground = GetForegroundWindow();
@@ -185,6 +243,42 @@ bool fullscreen_window_present() {
   return data.full;
 }
 
+void watch_fullscreen(std::stop_token st, const std::function<void(bool)> &on_change) {
+  MSG msg;
+  // Make sure this thread owns a message queue before anyone posts WM_QUIT to it.
+  PeekMessage(&msg, nullptr, WM_USER, WM_USER, PM_NOREMOVE);
+  DWORD thread_id = GetCurrentThreadId();
+
+  FullscreenWatch watch{&on_change, foreground_fullscreen()};
+  t_fullscreen_watch = &watch;
+  on_change(watch.current);
+
+  const DWORD flags = WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS;
+  HWINEVENTHOOK hooks[] = {
+      SetWinEventHook(EVENT_SYSTEM_FOREGROUND, EVENT_SYSTEM_FOREGROUND, nullptr,
+                      fullscreen_event_proc, 0, 0, flags),
+      SetWinEventHook(EVENT_SYSTEM_MINIMIZESTART, EVENT_SYSTEM_MINIMIZEEND, nullptr,
+                      fullscreen_event_proc, 0, 0, flags),
+      SetWinEventHook(EVENT_OBJECT_LOCATIONCHANGE, EVENT_OBJECT_LOCATIONCHANGE, nullptr,
+                      fullscreen_event_proc, 0, 0, flags),
+  };
+
+  {
+    std::stop_callback quit(st, [thread_id] { PostThreadMessage(thread_id, WM_QUIT, 0, 0); });
+    while (!st.stop_requested() && GetMessageW(&msg, nullptr, 0, 0) > 0) {
+      TranslateMessage(&msg);
+      DispatchMessage(&msg);
+    }
+  }
+
+  for (HWINEVENTHOOK hook : hooks) {
+    if (hook) {
+      UnhookWinEvent(hook);
+    }
+  }
+  t_fullscreen_watch = nullptr;
+}
+
 void make_context_current(Window &window) {
   if (window.device && window.glContext) {
     wglMakeCurrent(static_cast<HDC>(window.device), static_cast<HGLRC>(window.glContext));
@@ -194,6 +288,7 @@ void make_context_current(Window &window) {
 void clear_current_context(Window &) { wglMakeCurrent(nullptr, nullptr); }
 
 void swap_buffers(Window &window) {
+  LIZARD_TRACE_ZONE("platform::swap_buffers");
   if (window.device) {
     SwapBuffers(static_cast<HDC>(window.device));
   }
@@ -1,8 +1,10 @@
 #pragma once
 
 #include <cstdint>
+#include <functional>
 #include <utility>
 #include <optional>
+#include <stop_token>
 #ifdef _WIN32
 #include <windows.h>
 #elif defined(__linux__)
@@ -38,8 +40,19 @@ Window create_overlay_window(const WindowDesc &desc);
 void destroy_window(Window &window);
 void poll_events(Window &window);
 bool fullscreen_window_present();
+// Blocks until `st` is stopped. Reports the initial fullscreen state through
+// `on_change`, then again only when the foreground window enters or leaves
+// fullscreen; nothing is polled while the state is stable.
+void watch_fullscreen(std::stop_token st, const std::function<void(bool)> &on_change);
 std::pair<float, float> cursor_pos();
 std::optional<std::pair<float, float>> caret_pos();
+// Follows caret movement through the accessibility API (AT-SPI on Linux, UI
+// Automation on Windows) on a background thread. While it runs, caret_pos()
+// returns the last published caret without blocking. Returns false if the
+// service is unavailable, in which case caret_pos() keeps querying directly.
+// Both calls are idempotent.
+bool start_caret_tracker();
+void stop_caret_tracker();
 void make_context_current(Window &window);
 void clear_current_context(Window &window);
 void swap_buffers(Window &window);
@@ -1,3 +1,4 @@
+#include <catch2/catch_approx.hpp>
 #include <catch2/catch_test_macros.hpp>
 #include <chrono>
 
@@ -9,11 +10,33 @@ int g_stop_calls = 0;
 
 #define private public
 #include "audio/engine.cpp"
+#include "audio/flac_stream.cpp"
+#include "audio/latency.cpp"
+#include "audio/limiter.cpp"
+#include "audio/pcm_source.cpp"
+#include "audio/sound_bank.cpp"
 #undef private
 
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+namespace {
+const unsigned char kFakeFlac[] = {0};
+}
+
 struct AudioTestAccess {
   static std::vector<lizard::audio::Engine::Voice> &voices(lizard::audio::Engine &e) {
-    return e.m_voices;
+    e.m_bank.load_memory(kFakeFlac, sizeof(kFakeFlac));
+    // Resident, as init()'s prewarm would leave it.
+    e.m_bank.acquire(0);
+    if (!e.m_output) {
+      e.m_output = std::make_unique<lizard::audio::Engine::Output>();
+    }
+    return e.m_output->voices;
   }
 };
 
@@ -54,3 +77,507 @@ TEST_CASE("play retriggers immediately", "[audio]") {
   REQUIRE(g_start_calls == 3);
   REQUIRE(g_stop_calls == 2);
 }
+
+TEST_CASE("alias table follows weights", "[audio]") {
+  lizard::audio::AliasTable table({1.0, 0.0, 3.0, 4.0});
+  std::mt19937 rng(1234);
+  std::array<int, 4> counts{};
+  constexpr int kDraws = 80000;
+  for (int i = 0; i < kDraws; ++i) {
+    counts[table.pick(rng)]++;
+  }
+  REQUIRE(counts[1] == 0);
+  REQUIRE(counts[0] > kDraws / 8 - kDraws / 40);
+  REQUIRE(counts[0] < kDraws / 8 + kDraws / 40);
+  REQUIRE(counts[3] > counts[2]);
+  REQUIRE(counts[0] + counts[2] + counts[3] == kDraws);
+}
+
+TEST_CASE("sound bank decodes lazily and evicts least recently used", "[audio]") {
+  // The stub decoder yields one mono frame (4 bytes) per sample.
+  lizard::audio::SoundBank bank(8, std::chrono::milliseconds(0));
+  bank.m_entries.resize(3);
+  for (auto &entry : bank.m_entries) {
+    entry.data = kFakeFlac;
+    entry.size = sizeof(kFakeFlac);
+  }
+  bank.rebuild_locked();
+  REQUIRE(bank.resident_bytes() == 0);
+
+  bank.acquire(0);
+  std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  auto held = bank.acquire(1);
+  REQUIRE(bank.resident_bytes() == 8);
+
+  // Sample 0 is the least recently used and unreferenced, so it makes room.
+  std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  bank.acquire(2);
+  REQUIRE(bank.resident_bytes() == 8);
+  REQUIRE(bank.m_entries[0].pcm == nullptr);
+  REQUIRE(bank.m_entries[1].pcm == held);
+  REQUIRE(bank.m_entries[2].pcm != nullptr);
+
+  // Sample 1 is still held by a voice; sample 2 goes instead.
+  std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  bank.acquire(0);
+  REQUIRE(bank.m_entries[1].pcm == held);
+  REQUIRE(bank.m_entries[2].pcm == nullptr);
+}
+
+TEST_CASE("triggers never decode and fall back to a resident sample", "[audio]") {
+  std::vector<unsigned char> other(3);
+  lizard::audio::SoundBank bank;
+  bank.m_entries.resize(3);
+  bank.m_entries[0].data = kFakeFlac;
+  bank.m_entries[0].size = sizeof(kFakeFlac);
+  for (std::size_t i = 1; i < 3; ++i) {
+    bank.m_entries[i].data = other.data();
+    bank.m_entries[i].size = other.size();
+  }
+  bank.rebuild_locked();
+  REQUIRE(bank.try_acquire(1) == nullptr);
+
+  auto resident = bank.acquire(0);
+  REQUIRE(bank.try_acquire(2) == resident);
+
+  // The decode thread picks up both misses; later triggers get their own.
+  auto decoded = [&](std::size_t index) {
+    auto pcm = resident;
+    for (int i = 0; i < 200 && pcm == resident; ++i) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      pcm = bank.try_acquire(index);
+    }
+    return pcm;
+  };
+  REQUIRE(decoded(2)->frames == other.size());
+  REQUIRE(decoded(1)->frames == other.size());
+}
+
+TEST_CASE("sound bank maps sample specs to the entries that loaded", "[audio]") {
+  auto dir = std::filesystem::temp_directory_path() / "lizard_bank_specs";
+  std::filesystem::create_directories(dir);
+  for (const char *name : {"a.flac", "c.flac"}) {
+    std::ofstream out(dir / name, std::ios::binary);
+    out.write(reinterpret_cast<const char *>(kFakeFlac), sizeof(kFakeFlac));
+  }
+  {
+    lizard::audio::SoundBank bank;
+    REQUIRE(bank.load({{dir / "a.flac", 1.0}, {dir / "missing.flac", 1.0}, {dir / "c.flac", 1.0}}));
+    REQUIRE(bank.size() == 2);
+    REQUIRE(bank.pick(0) == 0);
+    REQUIRE(bank.pick(2) == 1);
+    // The missing sample and out-of-range specs fall back to a weighted pick.
+    REQUIRE(bank.pick(1) < 2);
+    REQUIRE(bank.pick(7) < 2);
+  }
+  std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("flac stream rewinds without replaying stale frames", "[audio]") {
+  // The stub decoder yields one frame per input byte, valued frame index + 1.
+  std::vector<unsigned char> file(50000);
+  auto stream = lizard::audio::FlacStream::open(file.data(), file.size());
+  REQUIRE(stream);
+  std::vector<float> out(64);
+  ma_uint64 read = 0;
+
+  stream->fill();
+  REQUIRE(stream->read(out.data(), 64, &read) == MA_SUCCESS);
+  REQUIRE(read == 64);
+  REQUIRE(out[0] == 1.0f);
+  REQUIRE(out[63] == 64.0f);
+
+  // A seek is silent until the decoder has stopped writing and the reader has
+  // thrown away what was already queued.
+  stream->seek(0);
+  stream->read(out.data(), 64, &read);
+  REQUIRE(out[0] == 0.0f);
+  stream->fill();
+  stream->read(out.data(), 64, &read);
+  REQUIRE(out[63] == 0.0f);
+  stream->fill();
+  stream->read(out.data(), 64, &read);
+  REQUIRE(read == 64);
+  REQUIRE(out[0] == 1.0f);
+}
+
+TEST_CASE("flac stream ends and pre-rolls the next trigger", "[audio]") {
+  std::vector<unsigned char> file(100);
+  auto stream = lizard::audio::FlacStream::open(file.data(), file.size());
+  REQUIRE(stream);
+  std::vector<float> out(64);
+  ma_uint64 read = 0;
+
+  stream->fill();
+  REQUIRE(stream->read(out.data(), 64, &read) == MA_SUCCESS);
+  REQUIRE(stream->read(out.data(), 64, &read) == MA_SUCCESS);
+  REQUIRE(read == 36);
+  REQUIRE(out[35] == 100.0f);
+  REQUIRE(stream->read(out.data(), 64, &read) == MA_AT_END);
+  REQUIRE(read == 0);
+
+  // Reaching the end rewinds in the background, so a trigger's seek to 0 is
+  // free and the first frames are ready immediately.
+  stream->fill();
+  stream->seek(0);
+  REQUIRE(stream->read(out.data(), 64, &read) == MA_SUCCESS);
+  REQUIRE(out[0] == 1.0f);
+}
+
+TEST_CASE("sound bank streams samples above the threshold", "[audio]") {
+  std::vector<unsigned char> large(64);
+  lizard::audio::SoundBank bank;
+  bank.m_entries.resize(2);
+  bank.m_entries[0].data = kFakeFlac;
+  bank.m_entries[0].size = sizeof(kFakeFlac);
+  bank.m_entries[1].data = large.data();
+  bank.m_entries[1].size = large.size();
+  bank.m_entries[1].streamed = true;
+  bank.rebuild_locked();
+
+  REQUIRE(bank.streamed_count() == 1);
+  REQUIRE(bank.acquire(1) == nullptr);
+  REQUIRE(bank.encoded(1).size() == large.size());
+  REQUIRE(bank.resident_bytes() == 0);
+  REQUIRE(bank.prewarm() != nullptr);
+}
+
+TEST_CASE("streamed voices are opened with the output, not on play", "[audio]") {
+  auto path = std::filesystem::temp_directory_path() / "lizard_streamed.flac";
+  {
+    std::vector<char> bytes(64);
+    std::ofstream out(path, std::ios::binary);
+    out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+  }
+  {
+    lizard::audio::Engine eng(2);
+    eng.set_samples({{path, 1.0}}, lizard::audio::SoundBank::kDefaultBudgetBytes, 0);
+    REQUIRE(eng.init(std::nullopt, 100, lizard::audio::Backend::null));
+    auto &voices = eng.m_output->voices;
+    REQUIRE(voices.size() == 2);
+    std::vector<lizard::audio::FlacStream *> opened;
+    for (auto &voice : voices) {
+      REQUIRE(voice.streams.size() == 1);
+      REQUIRE(voice.streams[0]);
+      opened.push_back(voice.streams[0].get());
+    }
+
+    eng.play();
+    eng.play();
+    REQUIRE(voices[0].stream == opened[0]);
+    REQUIRE(voices[1].stream == opened[1]);
+    REQUIRE(voices[0].streams[0].get() == opened[0]);
+  }
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("s16 widening matches the scalar conversion", "[audio]") {
+  std::vector<std::int16_t> in = {0, 1, -1, 32767, -32768, 12345, -12345, 2, 3, 4, 5, -6, 7};
+  for (std::size_t n = 0; n <= in.size(); ++n) {
+    std::vector<float> out(n, -99.0f);
+    lizard::audio::widen_s16(in.data(), out.data(), n);
+    for (std::size_t i = 0; i < n; ++i) {
+      REQUIRE(out[i] == static_cast<float>(in[i]) / 32768.0f);
+    }
+  }
+}
+
+TEST_CASE("s16 samples use half the pool and play back as f32", "[audio]") {
+  std::vector<unsigned char> file(32);
+  auto f32 = lizard::audio::decode_flac(file.data(), file.size());
+  auto s16 = lizard::audio::decode_flac(file.data(), file.size(), lizard::audio::SampleFormat::s16);
+  REQUIRE(f32);
+  REQUIRE(s16);
+  REQUIRE(s16->bytes() * 2 == f32->bytes());
+
+  lizard::audio::PcmSource source;
+  auto pcm = std::make_shared<const lizard::audio::Pcm>(std::move(*s16));
+  REQUIRE(source.init(pcm) == MA_SUCCESS);
+  std::vector<float> out(20);
+  ma_uint64 read = 0;
+  REQUIRE(source.read(out.data(), 20, &read) == MA_SUCCESS);
+  REQUIRE(read == 20);
+  REQUIRE(out[0] == 1.0f / 32768.0f);
+  REQUIRE(source.read(out.data(), 20, &read) == MA_SUCCESS);
+  REQUIRE(read == 12);
+  REQUIRE(out[11] == 32.0f / 32768.0f);
+  REQUIRE(source.read(out.data(), 20, &read) == MA_AT_END);
+  source.uninit();
+}
+
+TEST_CASE("samples are converted once to the device format", "[audio]") {
+  // Stub decoder output is mono 44.1 kHz, one frame per byte.
+  std::vector<unsigned char> file(441);
+  lizard::audio::SoundBank bank;
+  bank.m_entries.resize(1);
+  bank.m_entries[0].data = file.data();
+  bank.m_entries[0].size = file.size();
+  bank.rebuild_locked();
+
+  REQUIRE(bank.set_output_format(2, 48000));
+  auto pcm = bank.acquire(0);
+  REQUIRE(pcm);
+  REQUIRE(pcm->channels == 2);
+  REQUIRE(pcm->sampleRate == 48000);
+  REQUIRE(pcm->frames == 480);
+  REQUIRE(pcm->samples[0] == pcm->samples[1]);
+
+  // Same device format again: the converted sample is kept.
+  REQUIRE_FALSE(bank.set_output_format(2, 48000));
+  REQUIRE(bank.acquire(0) == pcm);
+
+  REQUIRE(bank.set_output_format(2, 44100));
+  REQUIRE(bank.acquire(0)->sampleRate == 44100);
+}
+
+TEST_CASE("pre-decoded samples play in place", "[audio]") {
+  static const std::int16_t kBuiltin[] = {100, -100, 200, -200, 300, -300};
+  lizard::audio::Pcm builtin;
+  builtin.format = lizard::audio::SampleFormat::s16;
+  builtin.borrowed16 = kBuiltin;
+  builtin.frames = 3;
+  builtin.channels = 2;
+  builtin.sampleRate = 48000;
+  auto shared = std::shared_ptr<const lizard::audio::Pcm>(
+      std::shared_ptr<const lizard::audio::Pcm>(), &builtin);
+
+  lizard::audio::SoundBank bank;
+  REQUIRE(bank.load_pcm(shared));
+  bank.set_output_format(2, 48000);
+  auto pcm = bank.acquire(0);
+  REQUIRE(pcm.get() == &builtin);
+  REQUIRE(pcm->s16().data() == kBuiltin);
+  REQUIRE(bank.resident_bytes() == 0);
+
+  lizard::audio::PcmSource source;
+  REQUIRE(source.init(pcm) == MA_SUCCESS);
+  std::vector<float> out(6);
+  ma_uint64 read = 0;
+  REQUIRE(source.read(out.data(), 3, &read) == MA_SUCCESS);
+  REQUIRE(read == 3);
+  REQUIRE(out[5] == -300.0f / 32768.0f);
+  source.uninit();
+
+  // A device at another rate gets a converted copy; the original stays put.
+  REQUIRE(bank.set_output_format(2, 96000));
+  auto converted = bank.acquire(0);
+  REQUIRE(converted.get() != &builtin);
+  REQUIRE(converted->sampleRate == 96000);
+  REQUIRE(bank.resident_bytes() == converted->bytes());
+  REQUIRE(bank.set_output_format(2, 48000));
+  REQUIRE(bank.acquire(0).get() == &builtin);
+}
+
+TEST_CASE("varied triggers interpolate and scale the shared samples", "[audio]") {
+  static const float kRamp[] = {0.0f, 0.25f, 0.5f, 0.75f};
+  lizard::audio::Pcm ramp;
+  ramp.borrowed = kRamp;
+  ramp.frames = 4;
+  ramp.channels = 1;
+  ramp.sampleRate = 48000;
+  auto shared = std::shared_ptr<const lizard::audio::Pcm>(
+      std::shared_ptr<const lizard::audio::Pcm>(), &ramp);
+
+  lizard::audio::PcmSource source;
+  REQUIRE(source.init(shared) == MA_SUCCESS);
+  std::vector<float> out(8);
+  ma_uint64 read = 0;
+
+  // An octave down reads every frame twice, with midpoints in between.
+  source.set(shared, -1200.0f, 0.5f);
+  ma_uint64 length = 0;
+  REQUIRE(lizard::audio::PcmSource::on_get_length(source.source(), &length) == MA_SUCCESS);
+  REQUIRE(length == 8);
+  REQUIRE(source.read(out.data(), 8, &read) == MA_SUCCESS);
+  REQUIRE(read == 8);
+  REQUIRE(out[1] == Catch::Approx(0.0625f));
+  REQUIRE(out[2] == Catch::Approx(0.125f));
+  REQUIRE(out[7] == Catch::Approx(0.375f));
+  REQUIRE(source.read(out.data(), 8, &read) == MA_AT_END);
+
+  // An octave up skips every other frame.
+  source.set(shared, 1200.0f, 1.0f);
+  REQUIRE(source.read(out.data(), 8, &read) == MA_SUCCESS);
+  REQUIRE(read == 2);
+  REQUIRE(out[1] == Catch::Approx(0.5f));
+
+  // Rebinding the voice drops the variation again.
+  source.set(shared);
+  REQUIRE(source.read(out.data(), 8, &read) == MA_SUCCESS);
+  REQUIRE(read == 4);
+  REQUIRE(out[3] == 0.75f);
+  source.uninit();
+}
+
+TEST_CASE("bursts within the window coalesce into one voice", "[audio]") {
+  lizard::audio::Engine eng(4);
+  auto &voices = AudioTestAccess::voices(eng);
+  voices.resize(4);
+
+  SECTION("boost") {
+    eng.set_coalescing(lizard::audio::CoalesceMode::boost, std::chrono::seconds(10));
+    g_start_calls = 0;
+    for (int i = 0; i < 8; ++i) {
+      eng.play();
+    }
+    REQUIRE(g_start_calls == 1);
+    REQUIRE(voices[0].gain == Catch::Approx(2.0f));
+    REQUIRE(voices[0].sound.volume == Catch::Approx(2.0f));
+  }
+
+  SECTION("retrigger") {
+    eng.set_coalescing(lizard::audio::CoalesceMode::retrigger, std::chrono::seconds(10));
+    g_start_calls = 0;
+    for (int i = 0; i < 8; ++i) {
+      eng.play();
+    }
+    REQUIRE(g_start_calls == 1);
+    REQUIRE(voices[0].sound.fades == 7);
+    REQUIRE_FALSE(ma_sound_is_playing(&voices[1].sound));
+  }
+
+  SECTION("outside the window") {
+    eng.set_coalescing(lizard::audio::CoalesceMode::boost, std::chrono::milliseconds(0));
+    g_start_calls = 0;
+    eng.play();
+    eng.play();
+    REQUIRE(g_start_calls == 2);
+  }
+}
+
+TEST_CASE("soft limiter is transparent when quiet and never clips", "[audio]") {
+  lizard::audio::SoftLimiter limiter;
+  limiter.configure(2, 48000);
+
+  std::vector<float> quiet(2 * 480);
+  for (std::size_t i = 0; i < quiet.size(); ++i) {
+    quiet[i] = 0.5f * std::sin(static_cast<float>(i) * 0.05f);
+  }
+  std::vector<float> out(quiet.size());
+  limiter.process(quiet.data(), out.data(), 480);
+  REQUIRE(out == quiet);
+
+  std::vector<float> loud(2 * 4800);
+  for (std::size_t i = 0; i < loud.size(); ++i) {
+    loud[i] = 4.0f * std::sin(static_cast<float>(i / 2) * 0.05f);
+  }
+  limiter.process(loud.data(), loud.data(), 4800);
+  float peak = 0.0f;
+  for (float sample : loud) {
+    peak = std::max(peak, std::fabs(sample));
+  }
+  REQUIRE(peak <= 1.0f);
+  REQUIRE(limiter.gain() < 0.5f);
+}
+
+TEST_CASE("latency probe times the first trigger of each mix pass", "[audio]") {
+  lizard::audio::LatencyProbe probe;
+  probe.mixed();
+  REQUIRE(probe.stats().count == 0);
+
+  probe.trigger();
+  auto first = probe.m_pending.load();
+  std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  probe.trigger();
+  REQUIRE(probe.m_pending.load() == first);
+  probe.mixed();
+  auto stats = probe.stats();
+  REQUIRE(stats.count == 1);
+  REQUIRE(stats.maxMs >= 2.0);
+  REQUIRE(stats.averageMs == stats.maxMs);
+
+  lizard::audio::Engine eng(1);
+  AudioTestAccess::voices(eng).resize(1);
+  eng.play();
+  eng.m_probe.mixed();
+  REQUIRE(eng.latency().triggerToMix.count == 1);
+}
+
+TEST_CASE("a rerouted device is replaced off the play lock", "[audio]") {
+  lizard::audio::Engine eng(2);
+  REQUIRE(eng.init());
+  auto *first = eng.m_output.get();
+  REQUIRE(first != nullptr);
+  REQUIRE(first->voices.size() == 2);
+
+  // Another init() with the same samples swaps outputs without a gap.
+  REQUIRE(eng.init());
+  auto *second = eng.m_output.get();
+  REQUIRE(second != first);
+
+  ma_device device;
+  device.pUserData = second;
+  ma_device_notification stopped{&device, ma_device_notification_type_stopped};
+  lizard::audio::Engine::notification_callback(&stopped);
+  ma_device_notification rerouted{&device, ma_device_notification_type_rerouted};
+  lizard::audio::Engine::notification_callback(&rerouted);
+
+  bool replaced = false;
+  for (int i = 0; i < 200 && !replaced; ++i) {
+    eng.play();
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    std::lock_guard<std::mutex> lock(eng.m_mutex);
+    replaced = eng.m_output && eng.m_output.get() != second;
+  }
+  REQUIRE(replaced);
+}
+
+TEST_CASE("null backend mixes only when rendered", "[audio]") {
+  lizard::audio::Engine eng(4);
+  REQUIRE(eng.init(std::nullopt, 100, lizard::audio::Backend::null));
+  auto *output = eng.m_output.get();
+  REQUIRE(output->headless);
+  REQUIRE_FALSE(output->deviceInitialized);
+  REQUIRE(output->voices.size() == 4);
+  REQUIRE(eng.latency().sampleRate == lizard::audio::Engine::kNullSampleRate);
+
+  eng.play();
+  std::vector<float> period(480 * lizard::audio::Engine::kNullChannels);
+  REQUIRE(eng.render(period.data(), 480) == 480);
+  REQUIRE(eng.render(period.data(), 480) == 480);
+  REQUIRE(output->engine.time == 960);
+
+  // With a device the callback drives the mix and render() does nothing.
+  REQUIRE(eng.init());
+  REQUIRE(eng.render(period.data(), 480) == 0);
+}
+
+TEST_CASE("stealing a voice the mixer is reading hands the sample over", "[audio]") {
+  // Ten seconds with the stub decoder, so no voice ends on its own.
+  auto path = std::filesystem::temp_directory_path() / "lizard_steal.flac";
+  {
+    std::vector<char> bytes(441000);
+    std::ofstream out(path, std::ios::binary);
+    out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+  }
+  {
+    lizard::audio::Engine eng(2);
+    eng.set_samples({{path, 1.0}});
+    // Varied, so each switch carries a step and gain as well.
+    eng.set_variation(50.0f, 3.0f);
+    REQUIRE(eng.init(std::nullopt, 100, lizard::audio::Backend::null));
+    g_stop_calls = 0;
+
+    std::atomic<bool> done{false};
+    // Roughly real time, so the voices are still mid-sample when stolen.
+    std::thread mixer([&] {
+      std::vector<float> period(48 * lizard::audio::Engine::kNullChannels);
+      while (!done.load()) {
+        eng.render(period.data(), 48);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    });
+    for (int i = 0; i < 3; ++i) {
+      eng.play();
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    done = true;
+    mixer.join();
+
+    REQUIRE(g_stop_calls == 1);
+    auto &voices = eng.m_output->voices;
+    REQUIRE(ma_sound_is_playing(&voices[0].sound));
+    REQUIRE(ma_sound_is_playing(&voices[1].sound));
+  }
+  std::filesystem::remove(path);
+}
@@ -0,0 +1,54 @@
+#include "platform/caret_tracker.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using lizard::platform::CaretCache;
+using lizard::platform::CaretRect;
+
+TEST_CASE("caret cache publishes and clears", "[caret]") {
+  CaretCache cache;
+  REQUIRE_FALSE(cache.load().has_value());
+
+  cache.publish(CaretRect{10, 20, 2, 16});
+  auto rect = cache.load();
+  REQUIRE(rect.has_value());
+  REQUIRE(rect->x == 10);
+  REQUIRE(rect->y == 20);
+  REQUIRE(rect->w == 2);
+  REQUIRE(rect->h == 16);
+
+  auto anchor = lizard::platform::caret_anchor(*rect);
+  REQUIRE(anchor.first == 11.0f);
+  REQUIRE(anchor.second == 36.0f);
+
+  cache.clear();
+  REQUIRE_FALSE(cache.load().has_value());
+}
+
+TEST_CASE("caret cache readers never observe a torn rect", "[caret]") {
+  CaretCache cache;
+  std::atomic<bool> done{false};
+  std::atomic<int> torn{0};
+  std::vector<std::thread> readers;
+  for (int i = 0; i < 3; ++i) {
+    readers.emplace_back([&] {
+      while (!done.load(std::memory_order_relaxed)) {
+        if (auto r = cache.load()) {
+          if (r->y != r->x || r->w != r->x || r->h != r->x) {
+            torn.fetch_add(1, std::memory_order_relaxed);
+          }
+        }
+      }
+    });
+  }
+  for (std::int32_t i = 0; i < 200000; ++i) {
+    cache.publish(CaretRect{i, i, i, i});
+  }
+  done = true;
+  for (auto &t : readers) {
+    t.join();
+  }
+  REQUIRE(torn.load() == 0);
+}
@@ -8,9 +8,23 @@
 #include <mutex>
 #include <spdlog/sinks/ringbuffer_sink.h>
 #include <spdlog/spdlog.h>
+#include <thread>
+#include <vector>
 
 using lizard::app::Config;
 
+namespace {
+
+// Config leaves "<file>.cache" next to the JSON it loads.
+void remove_config(const std::filesystem::path &cfg_file) {
+  std::filesystem::remove(cfg_file);
+  auto cache = cfg_file;
+  cache += ".cache";
+  std::filesystem::remove(cache);
+}
+
+} // namespace
+
 TEST_CASE("loads default when file missing", "[config]") {
   auto tempdir = std::filesystem::temp_directory_path() / "lizard_cfg_missing";
   std::filesystem::create_directories(tempdir);
@@ -18,6 +32,7 @@ TEST_CASE("loads default when file missing", "[config]") {
     Config cfg(tempdir);
     REQUIRE(cfg.enabled());
     REQUIRE_FALSE(cfg.mute());
+    REQUIRE(cfg.audio_profile() == lizard::app::AudioProfile::Default);
   }
   std::filesystem::remove_all(tempdir);
 }
@@ -36,7 +51,7 @@ TEST_CASE("parses provided values", "[config]") {
   REQUIRE(cfg.logging_queue_size() == 42);
   REQUIRE(cfg.logging_worker_count() == 2);
 
-  std::filesystem::remove(cfg_file);
+  remove_config(cfg_file);
 }
 
 TEST_CASE("parses asset paths", "[config]") {
@@ -50,7 +65,7 @@ TEST_CASE("parses asset paths", "[config]") {
   REQUIRE(cfg.sound_path().has_value());
   REQUIRE(cfg.emoji_atlas().has_value());
 
-  std::filesystem::remove(cfg_file);
+  remove_config(cfg_file);
 }
 
 TEST_CASE("parses emoji_pngs", "[config]") {
@@ -66,7 +81,7 @@ TEST_CASE("parses emoji_pngs", "[config]") {
   REQUIRE(cfg.emoji().empty());
   REQUIRE(cfg.emoji_weighted().empty());
 
-  std::filesystem::remove(cfg_file);
+  remove_config(cfg_file);
 }
 
 TEST_CASE("resolves relative asset paths", "[config]") {
@@ -88,6 +103,33 @@ TEST_CASE("resolves relative asset paths", "[config]") {
   std::filesystem::remove_all(tempdir);
 }
 
+TEST_CASE("parses weighted sound samples", "[config]") {
+  auto tempdir = std::filesystem::temp_directory_path() / "lizard_cfg_samples";
+  std::filesystem::create_directories(tempdir);
+  auto cfg_file = tempdir / "lizard_cfg_samples.json";
+  {
+    std::ofstream out(cfg_file);
+    out << R"({"sound_samples":["a.flac",{"path":"b.flac","weight":3},{"path":"c.flac","weight":0}],"sound_pool_budget_mb":8,"sound_stream_threshold_mb":2,"sound_pcm_format":"s16","sound_coalesce_mode":"retrigger","sound_coalesce_ms":30,"sound_pitch_variation_cents":25,"sound_gain_variation_db":1.5})";
+  }
+
+  Config cfg(tempdir, cfg_file);
+  auto samples = cfg.sound_samples();
+  REQUIRE(samples.size() == 2);
+  REQUIRE(samples[0].path == tempdir / "a.flac");
+  REQUIRE(samples[0].weight == Catch::Approx(1.0));
+  REQUIRE(samples[1].path == tempdir / "b.flac");
+  REQUIRE(samples[1].weight == Catch::Approx(3.0));
+  REQUIRE(cfg.sound_pool_budget_mb() == 8);
+  REQUIRE(cfg.sound_stream_threshold_mb() == 2);
+  REQUIRE(cfg.sound_pcm_format() == lizard::app::SoundPcmFormat::S16);
+  REQUIRE(cfg.sound_coalesce_mode() == lizard::app::SoundCoalesceMode::Retrigger);
+  REQUIRE(cfg.sound_coalesce_ms() == 30);
+  REQUIRE(cfg.sound_pitch_variation_cents() == 25);
+  REQUIRE(cfg.sound_gain_variation_db() == Catch::Approx(1.5));
+
+  std::filesystem::remove_all(tempdir);
+}
+
 TEST_CASE("asset paths reset when removed or empty", "[config]") {
   using namespace std::chrono_literals;
   auto tempdir = std::filesystem::temp_directory_path();
@@ -130,7 +172,7 @@ TEST_CASE("asset paths reset when removed or empty", "[config]") {
   REQUIRE_FALSE(cfg.sound_path().has_value());
   REQUIRE_FALSE(cfg.emoji_atlas().has_value());
 
-  std::filesystem::remove(cfg_file);
+  remove_config(cfg_file);
 }
 
 TEST_CASE("reloads on file change", "[config]") {
@@ -164,7 +206,39 @@ TEST_CASE("reloads on file change", "[config]") {
 
   REQUIRE(wait([&] { return cfg.enabled(); }));
 
-  std::filesystem::remove(cfg_file);
+  remove_config(cfg_file);
+}
+
+TEST_CASE("reloads when a save renames a new file over the old one", "[config]") {
+  using namespace std::chrono_literals;
+  auto tempdir = std::filesystem::temp_directory_path();
+  auto cfg_file = tempdir / "lizard_cfg_rename.json";
+  auto tmp_file = tempdir / "lizard_cfg_rename.json.tmp";
+  {
+    std::ofstream out(cfg_file);
+    out << R"({"volume_percent":10})";
+  }
+
+  // A long polling interval: only a change notification reloads in time.
+  Config cfg(tempdir, cfg_file, 1h);
+  REQUIRE(cfg.volume_percent() == 10);
+
+  auto wait = [&](auto pred) {
+    std::mutex m;
+    std::unique_lock lk(m);
+    return cfg.reload_cv().wait_for(lk, 2s, pred);
+  };
+
+  {
+    std::ofstream out(tmp_file);
+    out << R"({"volume_percent":20})";
+  }
+  auto ts = std::filesystem::last_write_time(cfg_file);
+  std::filesystem::last_write_time(tmp_file, ts + 1s);
+  std::filesystem::rename(tmp_file, cfg_file);
+  REQUIRE(wait([&] { return cfg.volume_percent() == 20; }));
+
+  remove_config(cfg_file);
 }
 
 TEST_CASE("clamps out-of-range numeric values", "[config]") {
@@ -186,7 +260,7 @@ TEST_CASE("clamps out-of-range numeric values", "[config]") {
   REQUIRE(cfg.logging_queue_size() == 0);
   REQUIRE(cfg.logging_worker_count() == 1);
 
-  std::filesystem::remove(cfg_file);
+  remove_config(cfg_file);
 }
 
 TEST_CASE("enforces badge size ordering", "[config]") {
@@ -201,7 +275,7 @@ TEST_CASE("enforces badge size ordering", "[config]") {
   REQUIRE(cfg.badge_max_px() == 120);
   REQUIRE(cfg.volume_percent() == 100);
 
-  std::filesystem::remove(cfg_file);
+  remove_config(cfg_file);
 }
 
 TEST_CASE("logs warnings for adjusted values", "[config]") {
@@ -236,5 +310,369 @@ TEST_CASE("logs warnings for adjusted values", "[config]") {
   REQUIRE(saw_badge_max);
   REQUIRE(saw_volume);
 
-  std::filesystem::remove(cfg_file);
+  remove_config(cfg_file);
+}
+
+TEST_CASE("accepts comments in the config", "[config]") {
+  auto tempdir = std::filesystem::temp_directory_path() / "lizard_cfg_comments";
+  std::filesystem::create_directories(tempdir);
+  auto cfg_file = tempdir / "lizard.json";
+  {
+    std::ofstream out(cfg_file);
+    out << "{\n  // quieter at night\n  \"volume_percent\": 30, /* and muted */ \"mute\": true\n}";
+  }
+
+  {
+    Config cfg(tempdir, cfg_file);
+    REQUIRE(cfg.volume_percent() == 30);
+    REQUIRE(cfg.mute());
+  }
+  std::filesystem::remove_all(tempdir);
+}
+
+TEST_CASE("loads an unchanged config from the cache", "[config]") {
+  auto tempdir = std::filesystem::temp_directory_path() / "lizard_cfg_cache";
+  std::filesystem::create_directories(tempdir);
+  auto cfg_file = tempdir / "lizard.json";
+  {
+    std::ofstream out(cfg_file);
+    out << R"({"volume_percent":150,"exclude_processes":["a.exe","b.exe"]})";
+  }
+
+  // Each load hands the default logger back to init_logging(), so listen
+  // again before every construction.
+  std::shared_ptr<spdlog::sinks::ringbuffer_sink_mt> sink;
+  auto listen = [&] {
+    sink = std::make_shared<spdlog::sinks::ringbuffer_sink_mt>(32);
+    spdlog::set_default_logger(std::make_shared<spdlog::logger>("test", sink));
+  };
+  auto warned = [&] {
+    for (const auto &line : sink->last_formatted()) {
+      if (line.find("volume_percent") != std::string::npos)
+        return true;
+    }
+    return false;
+  };
+
+  listen();
+  {
+    Config cfg(tempdir, cfg_file);
+    REQUIRE(cfg.volume_percent() == 100);
+  }
+  REQUIRE(warned());
+  REQUIRE(std::filesystem::exists(tempdir / "lizard.json.cache"));
+
+  // Validation only runs when the JSON is parsed, so a cache hit is silent.
+  listen();
+  {
+    Config cfg(tempdir, cfg_file);
+    REQUIRE(cfg.volume_percent() == 100);
+    REQUIRE(cfg.exclude_processes() == std::vector<std::string>{"a.exe", "b.exe"});
+  }
+  REQUIRE_FALSE(warned());
+
+  // Same size and timestamp, different content: the hash still catches it.
+  auto ts = std::filesystem::last_write_time(cfg_file);
+  {
+    std::ofstream out(cfg_file);
+    out << R"({"volume_percent":140,"exclude_processes":["a.exe","c.exe"]})";
+  }
+  std::filesystem::last_write_time(cfg_file, ts);
+  listen();
+  {
+    Config cfg(tempdir, cfg_file);
+    REQUIRE(cfg.volume_percent() == 100);
+    REQUIRE(cfg.exclude_processes() == std::vector<std::string>{"a.exe", "c.exe"});
+  }
+  REQUIRE(warned());
+
+  // A damaged cache is ignored.
+  {
+    std::ofstream out(tempdir / "lizard.json.cache", std::ios::binary | std::ios::trunc);
+    out << "LZCC";
+  }
+  {
+    Config cfg(tempdir, cfg_file);
+    REQUIRE(cfg.exclude_processes() == std::vector<std::string>{"a.exe", "c.exe"});
+  }
+  std::filesystem::remove_all(tempdir);
+}
+
+static_assert(lizard::app::to_string(lizard::app::FpsMode::Fixed) == "fixed");
+static_assert(lizard::app::from_string<lizard::app::AudioBackend>("null") ==
+              lizard::app::AudioBackend::Null);
+static_assert(!lizard::app::from_string<lizard::app::DpiScalingMode>("per_monitor"));
+
+TEST_CASE("resolves enumerated settings when parsed", "[config]") {
+  using namespace lizard::app;
+  auto tempdir = std::filesystem::temp_directory_path() / "lizard_cfg_enums";
+  std::filesystem::create_directories(tempdir);
+  auto cfg_file = tempdir / "lizard.json";
+  {
+    std::ofstream out(cfg_file);
+    out << R"({"badge_spawn_strategy":"near_caret","fps_mode":"fixed","audio_backend":"null",
+"dpi_scaling_mode":"system","logging_overflow":"overrun_oldest","sound_pcm_format":"s16",
+"sound_coalesce_mode":"off","audio_profile":"low_latency"})";
+  }
+  {
+    Config cfg(tempdir, cfg_file);
+    REQUIRE(cfg.badge_spawn_strategy() == BadgeSpawnStrategy::NearCaret);
+    REQUIRE(cfg.fps_mode() == FpsMode::Fixed);
+    REQUIRE(cfg.audio_backend() == AudioBackend::Null);
+    REQUIRE(cfg.dpi_scaling_mode() == DpiScalingMode::System);
+    REQUIRE(cfg.logging_overflow() == lizard::util::OverflowPolicy::overrun_oldest);
+    REQUIRE(cfg.sound_pcm_format() == SoundPcmFormat::S16);
+    REQUIRE(cfg.sound_coalesce_mode() == SoundCoalesceMode::Off);
+    REQUIRE(cfg.audio_profile() == AudioProfile::LowLatency);
+  }
+
+  // Served from the cache this time.
+  {
+    Config cfg(tempdir, cfg_file);
+    REQUIRE(cfg.badge_spawn_strategy() == BadgeSpawnStrategy::NearCaret);
+    REQUIRE(cfg.audio_backend() == AudioBackend::Null);
+    REQUIRE(cfg.logging_overflow() == lizard::util::OverflowPolicy::overrun_oldest);
+    REQUIRE(cfg.sound_coalesce_mode() == SoundCoalesceMode::Off);
+    REQUIRE(cfg.audio_profile() == AudioProfile::LowLatency);
+  }
+
+  {
+    std::ofstream out(cfg_file);
+    out << R"({"badge_spawn_strategy":"under_cursor","fps_mode":"fixed","sound_coalesce_mode":"merge"})";
+  }
+  auto sink = std::make_shared<spdlog::sinks::ringbuffer_sink_mt>(32);
+  spdlog::set_default_logger(std::make_shared<spdlog::logger>("test", sink));
+  {
+    Config cfg(tempdir, cfg_file);
+    REQUIRE(cfg.badge_spawn_strategy() == BadgeSpawnStrategy::RandomScreen);
+    REQUIRE(cfg.fps_mode() == FpsMode::Fixed);
+    REQUIRE(cfg.audio_backend() == AudioBackend::Miniaudio);
+    REQUIRE(cfg.logging_overflow() == lizard::util::OverflowPolicy::block);
+    REQUIRE(cfg.sound_coalesce_mode() == SoundCoalesceMode::Boost);
+    REQUIRE(cfg.audio_profile() == AudioProfile::Default);
+  }
+  bool warned = false;
+  for (const auto &line : sink->last_formatted()) {
+    if (line.find("Unknown badge_spawn_strategy (under_cursor); defaulting to random_screen") !=
+        std::string::npos)
+      warned = true;
+  }
+  REQUIRE(warned);
+  std::filesystem::remove_all(tempdir);
+}
+
+TEST_CASE("parses audio_profile", "[config]") {
+  using namespace lizard::app;
+  auto tempdir = std::filesystem::temp_directory_path() / "lizard_cfg_profile";
+  std::filesystem::create_directories(tempdir);
+  auto cfg_file = tempdir / "lizard.json";
+  {
+    std::ofstream out(cfg_file);
+    out << R"({"audio_profile":"low_latency"})";
+  }
+  {
+    Config cfg(tempdir, cfg_file);
+    REQUIRE(cfg.audio_profile() == AudioProfile::LowLatency);
+  }
+  {
+    std::ofstream out(cfg_file);
+    out << R"({"audio_profile":"default"})";
+  }
+  {
+    Config cfg(tempdir, cfg_file);
+    REQUIRE(cfg.audio_profile() == AudioProfile::Default);
+  }
+  std::filesystem::remove_all(tempdir);
+}
+
+TEST_CASE("compiles key_rules into a per-key table", "[config]") {
+  using namespace lizard::app;
+  auto tempdir = std::filesystem::temp_directory_path() / "lizard_cfg_keys";
+  std::filesystem::create_directories(tempdir);
+  auto cfg_file = tempdir / "lizard.json";
+  {
+    std::ofstream out(cfg_file);
+    out << R"({
+  "sound_samples": ["tap.flac", "thud.flac"],
+  "key_rules": [
+    {"keys": ["modifiers"], "suppress": true},
+    {"keys": ["space", 200, 300, "thumbs"], "sound": "thud.flac",
+     "emoji": ["A", "B"], "badge_scale": 1.5, "comment": {"ignored": [1]}},
+    {"keys": [200], "badge_scale": -1}
+  ]
+})";
+  }
+  int space = -1;
+  int modifier = -1;
+  for (int keycode = 0; keycode < static_cast<int>(KeyTable::kSize); ++keycode) {
+    if (space < 0 && key_in_class(keycode, KeyClass::Space)) {
+      space = keycode;
+    }
+    if (modifier < 0 && key_in_class(keycode, KeyClass::Modifiers)) {
+      modifier = keycode;
+    }
+  }
+  REQUIRE(space >= 0);
+  REQUIRE(modifier >= 0);
+
+  auto check = [&](const Config &cfg) {
+    auto reaction = cfg.key_reaction(space);
+    REQUIRE_FALSE(reaction.suppress);
+    REQUIRE(reaction.sample == 1);
+    REQUIRE(reaction.badge_scale == Catch::Approx(1.5));
+    REQUIRE(reaction.emoji_set == 1);
+    REQUIRE(cfg.key_emoji_sets() == std::vector<std::vector<std::string>>{{"A", "B"}});
+    REQUIRE(cfg.key_reaction(modifier).suppress);
+    // The later rule replaces the earlier one for keycode 200.
+    REQUIRE(cfg.key_reaction(200).sample == -1);
+    REQUIRE(cfg.key_reaction(200).badge_scale == Catch::Approx(1.0));
+    // 300 was rejected, and nothing out of range aliases a key in the table.
+    REQUIRE(cfg.key_reaction(300).sample == -1);
+    REQUIRE(cfg.key_reaction(space + static_cast<int>(KeyTable::kSize)).sample == -1);
+    REQUIRE_FALSE(cfg.key_reaction(modifier - static_cast<int>(KeyTable::kSize)).suppress);
+    REQUIRE_FALSE(cfg.key_reaction(-1).suppress);
+  };
+  {
+    Config cfg(tempdir, cfg_file);
+    check(cfg);
+    auto untouched = cfg.key_reaction(0);
+    REQUIRE_FALSE(untouched.suppress);
+    REQUIRE(untouched.sample == -1);
+    REQUIRE(untouched.emoji_set == 0);
+  }
+  // The rules come back from the cache and are compiled again.
+  {
+    Config cfg(tempdir, cfg_file);
+    check(cfg);
+  }
+  std::filesystem::remove_all(tempdir);
+}
+
+// The first keycode the hook would report for a modifier on this platform.
+static int modifier_key(int bit) {
+  using namespace lizard::app;
+  HotkeyTable table;
+  for (int keycode = 0; keycode < static_cast<int>(HotkeyTable::kSize); ++keycode) {
+    HotkeyTable::Keys down;
+    down.set(HotkeyTable::index(keycode));
+    if (table.modifiers(down) == bit) {
+      return keycode;
+    }
+  }
+  return -1;
+}
+
+TEST_CASE("matches hotkey chords", "[config]") {
+  using namespace lizard::app;
+  auto f9 = parse_chord(HotkeyAction::ToggleEnabled, " Ctrl + SHIFT + F9 ");
+  REQUIRE(f9);
+  REQUIRE(f9->modifiers == (kCtrl | kShift));
+  REQUIRE(parse_chord(HotkeyAction::Reload, "cmd+12")->modifiers == kSuper);
+  REQUIRE(parse_chord(HotkeyAction::Reload, "cmd+12")->keycode == 12);
+  REQUIRE_FALSE(parse_chord(HotkeyAction::Reload, "ctrl+shift"));
+  REQUIRE_FALSE(parse_chord(HotkeyAction::Reload, "hyper+f9"));
+  REQUIRE_FALSE(parse_chord(HotkeyAction::Reload, "f13"));
+  REQUIRE_FALSE(parse_chord(HotkeyAction::Reload, "ctrl+256"));
+
+  int ctrl_key = modifier_key(kCtrl);
+  int shift_key = modifier_key(kShift);
+  int alt_key = modifier_key(kAlt);
+  REQUIRE(ctrl_key >= 0);
+  REQUIRE(shift_key >= 0);
+  REQUIRE(alt_key >= 0);
+
+  HotkeyTable table(default_hotkeys());
+  HotkeyMatcher matcher;
+  // F9 alone is an ordinary key.
+  REQUIRE_FALSE(matcher.feed(table, f9->keycode, true).consumed);
+  REQUIRE_FALSE(matcher.feed(table, f9->keycode, false).consumed);
+
+  REQUIRE_FALSE(matcher.feed(table, ctrl_key, true).consumed);
+  REQUIRE_FALSE(matcher.feed(table, shift_key, true).consumed);
+  auto first = matcher.feed(table, f9->keycode, true);
+  REQUIRE(first.consumed);
+  REQUIRE(first.action == HotkeyAction::ToggleEnabled);
+  // Auto-repeat is swallowed without firing again.
+  auto repeat = matcher.feed(table, f9->keycode, true);
+  REQUIRE(repeat.consumed);
+  REQUIRE_FALSE(repeat.action);
+  REQUIRE_FALSE(matcher.feed(table, f9->keycode, false).consumed);
+
+  // An extra modifier makes it a different chord.
+  matcher.feed(table, alt_key, true);
+  REQUIRE_FALSE(matcher.feed(table, f9->keycode, true).consumed);
+  matcher.feed(table, f9->keycode, false);
+  matcher.feed(table, alt_key, false);
+
+  REQUIRE(matcher.feed(table, f9->keycode, true).action == HotkeyAction::ToggleEnabled);
+  matcher.feed(table, f9->keycode, false);
+  matcher.feed(table, shift_key, false);
+  REQUIRE_FALSE(matcher.feed(table, f9->keycode, true).consumed);
+}
+
+TEST_CASE("runs hotkey actions in order off the calling thread", "[config]") {
+  using namespace lizard::app;
+  std::mutex m;
+  std::condition_variable cv;
+  std::vector<HotkeyAction> seen;
+  auto caller = std::this_thread::get_id();
+  bool same_thread = false;
+  {
+    HotkeyDispatcher dispatcher([&](HotkeyAction action) {
+      std::lock_guard lock(m);
+      same_thread = same_thread || std::this_thread::get_id() == caller;
+      seen.push_back(action);
+      cv.notify_all();
+    });
+    dispatcher.post(HotkeyAction::Reload);
+    dispatcher.post(HotkeyAction::ToggleMute);
+    dispatcher.post(HotkeyAction::ToggleEnabled);
+    std::unique_lock lock(m);
+    REQUIRE(cv.wait_for(lock, std::chrono::seconds(5), [&] { return seen.size() == 3; }));
+  }
+  REQUIRE_FALSE(same_thread);
+  REQUIRE(seen == std::vector<HotkeyAction>{HotkeyAction::Reload, HotkeyAction::ToggleMute,
+                                            HotkeyAction::ToggleEnabled});
+}
+
+TEST_CASE("reads hotkeys from the config", "[config]") {
+  using namespace lizard::app;
+  auto tempdir = std::filesystem::temp_directory_path() / "lizard_cfg_hotkeys";
+  std::filesystem::create_directories(tempdir);
+  auto cfg_file = tempdir / "lizard.json";
+  {
+    std::ofstream out(cfg_file);
+    out << R"({"hotkeys": {"reload": "alt+f5", "toggle_mute": "", "toggle_enabled": "ctrl+f99",
+                           "launch": "f1"}})";
+  }
+  auto f5 = parse_chord(HotkeyAction::Reload, "alt+f5");
+  auto f9 = parse_chord(HotkeyAction::ToggleEnabled, "ctrl+shift+f9");
+  auto f10 = parse_chord(HotkeyAction::ToggleMute, "ctrl+shift+f10");
+  int ctrl_key = modifier_key(kCtrl);
+  int shift_key = modifier_key(kShift);
+  int alt_key = modifier_key(kAlt);
+
+  auto check = [&](const Config &cfg) {
+    HotkeyMatcher matcher;
+    cfg.match_hotkey(matcher, alt_key, true);
+    REQUIRE(cfg.match_hotkey(matcher, f5->keycode, true).action == HotkeyAction::Reload);
+    cfg.match_hotkey(matcher, f5->keycode, false);
+    cfg.match_hotkey(matcher, alt_key, false);
+
+    cfg.match_hotkey(matcher, ctrl_key, true);
+    cfg.match_hotkey(matcher, shift_key, true);
+    // An unparsable chord keeps the default; an empty one unbinds.
+    REQUIRE(cfg.match_hotkey(matcher, f9->keycode, true).action == HotkeyAction::ToggleEnabled);
+    REQUIRE_FALSE(cfg.match_hotkey(matcher, f10->keycode, true).consumed);
+  };
+  {
+    Config cfg(tempdir, cfg_file);
+    check(cfg);
+  }
+  // From the cache.
+  {
+    Config cfg(tempdir, cfg_file);
+    check(cfg);
+  }
+  std::filesystem::remove_all(tempdir);
 }
@@ -1,7 +1,15 @@
+#include "util/binlog.h"
 #include "util/log.h"
 #include <catch2/catch_test_macros.hpp>
+#include <cstdint>
 #include <filesystem>
+#include <fstream>
+#include <spdlog/async.h>
+#include <spdlog/sinks/ringbuffer_sink.h>
 #include <spdlog/spdlog.h>
+#include <string>
+#include <thread>
+#include <vector>
 
 TEST_CASE("logs rotate", "[log]") {
   using namespace std::filesystem;
@@ -38,3 +46,80 @@ TEST_CASE("invalid level defaults to info", "[log]") {
   spdlog::shutdown();
   remove_all(tempdir);
 }
+
+TEST_CASE("reconfigures logging without losing messages", "[log]") {
+  using namespace std::filesystem;
+  auto tempdir = temp_directory_path() / "lizard_log_reconfigure";
+  remove_all(tempdir);
+  create_directories(tempdir);
+  auto count = [](const path &file, const std::string &word) {
+    std::ifstream in(file);
+    std::size_t n = 0;
+    for (std::string line; std::getline(in, line);) {
+      n += line.find(word) != std::string::npos ? 1 : 0;
+    }
+    return n;
+  };
+
+  lizard::util::init_logging("info", 8192, 1, tempdir / "first.log");
+  auto pool = spdlog::thread_pool();
+  auto logger = spdlog::default_logger();
+  // Every config load calls again; unchanged settings rebuild nothing.
+  lizard::util::init_logging("debug", 8192, 1, tempdir / "first.log");
+  REQUIRE(spdlog::thread_pool() == pool);
+  REQUIRE(spdlog::default_logger() == logger);
+  REQUIRE(logger->level() == spdlog::level::debug);
+
+  for (int i = 0; i < 1000; ++i) {
+    spdlog::info("first {}", i);
+  }
+  lizard::util::init_logging("info", 64, 2, tempdir / "second.log",
+                             lizard::util::OverflowPolicy::overrun_oldest);
+  REQUIRE(spdlog::thread_pool() != pool);
+  REQUIRE(spdlog::default_logger() != logger);
+  // The old queue was written out before the swap returned.
+  REQUIRE(count(tempdir / "first.log", "first ") == 1000);
+
+  for (int i = 0; i < 50; ++i) {
+    spdlog::info("second {}", i);
+  }
+  spdlog::shutdown();
+  REQUIRE(count(tempdir / "second.log", "second ") == 50);
+  REQUIRE(count(tempdir / "first.log", "second ") == 0);
+  remove_all(tempdir);
+}
+
+TEST_CASE("binary log formats records off the calling thread", "[log]") {
+  auto sink = std::make_shared<spdlog::sinks::ringbuffer_sink_mt>(16);
+  auto logger = std::make_shared<spdlog::logger>("binlog", sink);
+  logger->set_pattern("%l %v");
+  logger->set_level(spdlog::level::debug);
+  spdlog::set_default_logger(logger);
+
+  enum class Side : std::uint8_t { Left = 1, Right = 2 };
+  std::string key = "F9";
+  LIZARD_LOG_DEBUG("key {} code {} down={} side {}", key, 120, true, Side::Right);
+  LIZARD_LOG_TRACE("filtered {}", 1);
+  LIZARD_LOG_INFO("no arguments");
+  // Strings are cut so the arguments after them still fit.
+  LIZARD_LOG_WARN("{} {}", std::string(100, 'x'), 7);
+  std::thread([] {
+    lizard::util::binlog::register_thread();
+    LIZARD_LOG_INFO("from {} {:.1f}", "worker", 2.5);
+  }).join();
+  lizard::util::binlog::flush();
+
+  std::vector<std::string> lines;
+  for (auto &line : sink->last_formatted()) {
+    while (!line.empty() && (line.back() == '\n' || line.back() == '\r')) {
+      line.pop_back();
+    }
+    lines.push_back(line);
+  }
+  std::vector<std::string> expected = {"debug key F9 code 120 down=true side 2",
+                                       "info no arguments",
+                                       "warning " + std::string(35, 'x') + " 7",
+                                       "info from worker 2.5"};
+  REQUIRE(lines == expected);
+  spdlog::set_default_logger(std::make_shared<spdlog::logger>("default"));
+}
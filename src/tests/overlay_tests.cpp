@@ -30,6 +30,14 @@ void glDeleteProgram(GLuint);
 
 #include "overlay/gl_raii.cpp"
 #include "overlay/overlay.cpp"
+#include "overlay/program_cache.cpp"
+
+// Config publishes immutable snapshots, so tests swap in an edited copy.
+template <typename Edit> void set_values(lizard::app::Config &cfg, Edit edit) {
+  auto values = std::make_shared<lizard::app::Config::Values>(*cfg.values_);
+  edit(*values);
+  cfg.values_ = std::move(values);
+}
 
 #if defined(__linux__)
 namespace lizard::platform {
@@ -133,6 +141,7 @@ void stbi_image_free(void *) {}
 }
 
 using Catch::Approx;
+using lizard::app::BadgeSpawnStrategy;
 using lizard::app::Config;
 using lizard::overlay::Overlay;
 
@@ -144,7 +153,7 @@ TEST_CASE("select_sprite respects weights", "[overlay]") {
   OverlayTestAccess::sprite_lookup(ov) = {{"A", 0}, {"B", 1}, {"C", 2}};
 
   Config cfg(std::filesystem::temp_directory_path());
-  cfg.emoji_weighted_ = {{"A", 1.0}, {"B", 3.0}, {"C", 6.0}};
+  set_values(cfg, [](auto &v) { v.emoji_weighted = {{"A", 1.0}, {"B", 3.0}, {"C", 6.0}}; });
 
   ov.init(cfg);
   OverlayTestAccess::rng(ov).seed(42);
@@ -222,7 +231,7 @@ TEST_CASE("GL resources released when Overlay is destroyed", "[overlay]") {
 TEST_CASE("random_screen strategy randomizes badge position", "[overlay]") {
   OverlayTestAccess::reset_overrides();
   Config cfg(std::filesystem::temp_directory_path());
-  cfg.badge_spawn_strategy_ = "random_screen";
+  set_values(cfg, [](auto &v) { v.badge_spawn_strategy = BadgeSpawnStrategy::RandomScreen; });
   Overlay ov;
   ov.init(cfg);
   OverlayTestAccess::set_view(ov, 1920.0f, 1080.0f, 0.0f, 0.0f);
@@ -238,7 +247,7 @@ TEST_CASE("random_screen strategy randomizes badge position", "[overlay]") {
 TEST_CASE("near_caret strategy uses caret coordinates when available", "[overlay]") {
   OverlayTestAccess::reset_overrides();
   Config cfg(std::filesystem::temp_directory_path());
-  cfg.badge_spawn_strategy_ = "near_caret";
+  set_values(cfg, [](auto &v) { v.badge_spawn_strategy = BadgeSpawnStrategy::NearCaret; });
   Overlay ov;
   ov.init(cfg);
   OverlayTestAccess::set_view(ov, 1920.0f, 1080.0f, 0.0f, 0.0f);
@@ -254,7 +263,7 @@ TEST_CASE("near_caret strategy uses caret coordinates when available", "[overlay
 TEST_CASE("near_caret strategy falls back to foreground monitor", "[overlay]") {
   OverlayTestAccess::reset_overrides();
   Config cfg(std::filesystem::temp_directory_path());
-  cfg.badge_spawn_strategy_ = "near_caret";
+  set_values(cfg, [](auto &v) { v.badge_spawn_strategy = BadgeSpawnStrategy::NearCaret; });
   Overlay ov;
   ov.init(cfg);
   OverlayTestAccess::set_view(ov, 3840.0f, 1080.0f, 0.0f, 0.0f);
@@ -272,7 +281,7 @@ TEST_CASE("near_caret strategy falls back to foreground monitor", "[overlay]") {
 TEST_CASE("badge spawns respect per-second limit", "[overlay]") {
   OverlayTestAccess::reset_overrides();
   Config cfg(std::filesystem::temp_directory_path());
-  cfg.badges_per_second_max_ = 2;
+  set_values(cfg, [](auto &v) { v.badges_per_second_max = 2; });
   Overlay ov;
   ov.init(cfg);
   ov.spawn_badge(0, 0.0f, 0.0f);
@@ -281,3 +290,27 @@ TEST_CASE("badge spawns respect per-second limit", "[overlay]") {
   REQUIRE(OverlayTestAccess::badges(ov).size() == 2);
   OverlayTestAccess::reset_overrides();
 }
+
+TEST_CASE("program binaries are only read back for their key", "[overlay]") {
+  using namespace lizard::overlay;
+  auto dir = std::filesystem::temp_directory_path() / "lizard_program_cache";
+  std::filesystem::remove_all(dir);
+  auto key = program_key("Mesa", "llvmpipe", "4.5 (Core Profile) Mesa 23.2", "vs", "fs");
+  REQUIRE(key != program_key("Mesa", "llvmpipe", "4.5 (Core Profile) Mesa 23.3", "vs", "fs"));
+  REQUIRE(key != program_key("Mesa", "llvmpipe", "4.5 (Core Profile) Mesa 23.2", "vs", "fs2"));
+  REQUIRE(program_key("ab", "c", "", "", "") != program_key("a", "bc", "", "", ""));
+
+  auto path = program_cache_path(dir, key);
+  REQUIRE_FALSE(read_program_binary(path, key));
+  REQUIRE(write_program_binary(path, key, {0x8E21, std::string("\x01\x00binary", 8)}));
+  auto binary = read_program_binary(path, key);
+  REQUIRE(binary);
+  REQUIRE(binary->format == 0x8E21);
+  REQUIRE(binary->data == std::string("\x01\x00binary", 8));
+  REQUIRE_FALSE(read_program_binary(path, key + 1));
+
+  auto size = std::filesystem::file_size(path);
+  std::filesystem::resize_file(path, size - 1);
+  REQUIRE_FALSE(read_program_binary(path, key));
+  std::filesystem::remove_all(dir);
+}
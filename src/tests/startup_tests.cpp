@@ -0,0 +1,118 @@
+#include "app/startup.h"
+#include <catch2/catch_test_macros.hpp>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+using lizard::app::KeyGate;
+using lizard::app::StartupTimer;
+
+TEST_CASE("replays keys posted before the gate opens", "[startup]") {
+  KeyGate gate;
+  std::vector<std::pair<int, bool>> seen;
+  for (std::size_t i = 0; i < KeyGate::kCapacity + 3; ++i) {
+    gate.post(static_cast<int>(i), i % 2 == 0);
+  }
+  REQUIRE(gate.open([&](int key, bool pressed, bool) { seen.emplace_back(key, pressed); }) ==
+          KeyGate::kCapacity);
+  REQUIRE(seen.size() == KeyGate::kCapacity);
+  REQUIRE(seen.front() == std::pair{0, true});
+  REQUIRE(seen.back() == std::pair{static_cast<int>(KeyGate::kCapacity) - 1, false});
+  gate.post(7, true);
+  REQUIRE(seen.back() == std::pair{7, true});
+}
+
+TEST_CASE("keeps key order while the gate opens", "[startup]") {
+  constexpr int kKeys = static_cast<int>(KeyGate::kCapacity) - 1;
+  KeyGate gate;
+  std::vector<int> seen;
+  std::atomic<int> posted{0};
+  std::thread hook([&] {
+    for (int i = 0; i < kKeys; ++i) {
+      gate.post(i, true);
+      posted.store(i + 1);
+      std::this_thread::yield();
+    }
+  });
+  while (posted.load() < 10) {
+    std::this_thread::yield();
+  }
+  gate.open([&](int key, bool, bool) { seen.push_back(key); });
+  hook.join();
+  REQUIRE(seen.size() == static_cast<std::size_t>(kKeys));
+  bool in_order = true;
+  for (std::size_t i = 0; i < seen.size(); ++i) {
+    in_order = in_order && seen[i] == static_cast<int>(i);
+  }
+  REQUIRE(in_order);
+}
+
+TEST_CASE("does not block the hook while replaying", "[startup]") {
+  KeyGate gate;
+  gate.post(1, true);
+  std::atomic<bool> replaying{false};
+  std::atomic<bool> posted{false};
+  std::vector<int> seen;
+  std::thread opener([&] {
+    gate.open([&](int key, bool, bool) {
+      seen.push_back(key);
+      if (key == 1) {
+        replaying = true;
+        // Holds the replay until the hook has posted, which would deadlock
+        // if post() waited for it.
+        while (!posted.load()) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  });
+  while (!replaying.load()) {
+    std::this_thread::yield();
+  }
+  gate.post(2, true);
+  posted = true;
+  opener.join();
+  REQUIRE(seen == std::vector<int>{1, 2});
+}
+
+TEST_CASE("marks keys queued long before opening as stale", "[startup]") {
+  KeyGate gate;
+  gate.post(1, true);
+  gate.post(1, false);
+  std::this_thread::sleep_for(KeyGate::kStaleAfter + std::chrono::milliseconds(50));
+  gate.post(2, true);
+  std::vector<std::tuple<int, bool, bool>> seen;
+  gate.open([&](int key, bool pressed, bool stale) { seen.emplace_back(key, pressed, stale); });
+  gate.post(3, true);
+  REQUIRE(seen == std::vector<std::tuple<int, bool, bool>>{
+                      {1, true, true}, {1, false, true}, {2, true, false}, {3, true, false}});
+}
+
+TEST_CASE("times startup phases", "[startup]") {
+  StartupTimer timer;
+  {
+    auto config = timer.phase("config");
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+  auto audio = timer.phase("audio");
+  std::thread([&] { auto overlay = timer.phase("overlay"); }).join();
+  audio.end();
+  audio.end();
+
+  auto phases = timer.phases();
+  REQUIRE(phases.size() == 3);
+  REQUIRE(phases[0].name == "config");
+  REQUIRE(phases[0].end - phases[0].begin >= std::chrono::milliseconds(2));
+  REQUIRE(phases[1].name == "overlay");
+  REQUIRE(phases[2].name == "audio");
+  REQUIRE(phases[2].begin <= phases[1].begin);
+  REQUIRE(phases[2].end >= phases[1].end);
+  auto summary = timer.summary();
+  REQUIRE(summary.rfind("Started in ", 0) == 0);
+  REQUIRE(summary.find("config 0.0-") != std::string::npos);
+  REQUIRE(summary.find(", overlay ") != std::string::npos);
+}
@@ -1,38 +1,146 @@
 #pragma once
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
+#include <mutex>
+#include <vector>
 
 using ma_uint64 = std::uint64_t;
 using ma_uint32 = std::uint32_t;
 using ma_result = int;
 using ma_backend = int;
 using ma_format = int;
+using ma_channel = std::uint8_t;
+using ma_bool32 = std::uint32_t;
+inline constexpr ma_bool32 MA_TRUE = 1;
+inline constexpr ma_bool32 MA_FALSE = 0;
+typedef void ma_data_source;
 
 inline constexpr ma_result MA_SUCCESS = 0;
+inline constexpr ma_result MA_INVALID_ARGS = -2;
+inline constexpr ma_result MA_AT_END = -17;
 inline constexpr ma_format ma_format_f32 = 1;
 inline constexpr ma_backend ma_backend_wasapi = 1;
 inline constexpr ma_backend ma_backend_coreaudio = 2;
 inline constexpr ma_backend ma_backend_alsa = 3;
 
-struct ma_engine {};
+struct ma_engine {
+  bool noDevice = false;
+  ma_uint32 channels = 2;
+  ma_uint32 sampleRate = 48000;
+  ma_uint64 time = 0;
+};
 struct ma_context {};
+enum ma_device_type { ma_device_type_playback = 1, ma_device_type_capture = 2 };
+enum ma_share_mode { ma_share_mode_shared = 0, ma_share_mode_exclusive = 1 };
+enum ma_performance_profile {
+  ma_performance_profile_low_latency = 0,
+  ma_performance_profile_conservative = 1
+};
+struct ma_device;
+using ma_device_data_proc = void (*)(ma_device *, void *, const void *, ma_uint32);
+enum ma_device_notification_type {
+  ma_device_notification_type_started,
+  ma_device_notification_type_stopped,
+  ma_device_notification_type_rerouted,
+  ma_device_notification_type_interruption_began,
+  ma_device_notification_type_interruption_ended,
+  ma_device_notification_type_unlocked
+};
+struct ma_device_notification {
+  ma_device *pDevice;
+  ma_device_notification_type type;
+};
+using ma_device_notification_proc = void (*)(const ma_device_notification *);
+struct ma_device_config {
+  ma_device_type deviceType = ma_device_type_playback;
+  ma_uint32 periodSizeInFrames = 0;
+  ma_uint32 periodSizeInMilliseconds = 0;
+  ma_uint32 periods = 0;
+  ma_performance_profile performanceProfile = ma_performance_profile_low_latency;
+  ma_device_data_proc dataCallback = nullptr;
+  ma_device_notification_proc notificationCallback = nullptr;
+  void *pUserData = nullptr;
+  struct {
+    ma_format format = 0;
+    ma_uint32 channels = 0;
+    ma_share_mode shareMode = ma_share_mode_shared;
+  } playback;
+};
+struct ma_device {
+  void *pUserData = nullptr;
+  struct {
+    ma_share_mode shareMode = ma_share_mode_shared;
+    ma_uint32 internalPeriodSizeInFrames = 480;
+    ma_uint32 internalPeriods = 3;
+    ma_uint32 internalSampleRate = 48000;
+  } playback;
+};
 struct ma_engine_config {
   ma_context *pContext = nullptr;
+  ma_device *pDevice = nullptr;
+  ma_device_notification_proc notificationCallback = nullptr;
+  ma_bool32 noDevice = 0;
+  ma_uint32 channels = 0;
+  ma_uint32 sampleRate = 0;
 };
 struct ma_context_config {};
 struct ma_audio_buffer_config {};
 struct ma_audio_buffer {};
 struct ma_sound {
+  // Read and written through std::atomic_ref, since the stub engine mixes on
+  // whichever thread calls ma_engine_read_pcm_frames.
   bool playing = false;
+  float volume = 1.0f;
+  int fades = 0;
+  ma_engine *engine = nullptr;
+  ma_data_source *source = nullptr;
 };
+typedef ma_sound ma_sound_group;
 
 inline ma_engine_config ma_engine_config_init() { return {}; }
+inline ma_device_config ma_device_config_init(ma_device_type type) {
+  ma_device_config config;
+  config.deviceType = type;
+  return config;
+}
+inline ma_result ma_device_init(ma_context *, const ma_device_config *config, ma_device *device) {
+  device->pUserData = config->pUserData;
+  device->playback.shareMode = config->playback.shareMode;
+  return MA_SUCCESS;
+}
+inline ma_result ma_device_stop(ma_device *) { return MA_SUCCESS; }
+inline void ma_device_uninit(ma_device *) {}
+inline ma_device *ma_engine_get_device(ma_engine *engine) {
+  static ma_device device;
+  return engine->noDevice ? nullptr : &device;
+}
+// Reads every playing sound of `engine` once, as the node graph would.
+inline void ma_stub_mix(ma_engine *engine, ma_uint64 frames);
+inline ma_result ma_engine_read_pcm_frames(ma_engine *engine, void *, ma_uint64 frames,
+                                           ma_uint64 *framesRead) {
+  ma_stub_mix(engine, frames);
+  engine->time += frames;
+  if (framesRead != nullptr) {
+    *framesRead = frames;
+  }
+  return MA_SUCCESS;
+}
 inline ma_context_config ma_context_config_init() { return {}; }
 inline ma_result ma_context_init(const ma_backend *, ma_uint32, const ma_context_config *,
                                  ma_context *) {
   return MA_SUCCESS;
 }
 inline void ma_context_uninit(ma_context *) {}
-inline ma_result ma_engine_init(const ma_engine_config *, ma_engine *) { return MA_SUCCESS; }
+inline ma_result ma_engine_init(const ma_engine_config *config, ma_engine *engine) {
+  *engine = {};
+  if (config->noDevice) {
+    engine->noDevice = true;
+    engine->channels = config->channels;
+    engine->sampleRate = config->sampleRate;
+  }
+  return MA_SUCCESS;
+}
 inline void ma_engine_uninit(ma_engine *) {}
 inline ma_audio_buffer_config ma_audio_buffer_config_init(ma_format, ma_uint32, ma_uint64,
                                                           const void *, void *) {
@@ -42,22 +150,248 @@ inline ma_result ma_audio_buffer_init(const ma_audio_buffer_config *, ma_audio_b
   return MA_SUCCESS;
 }
 inline void ma_audio_buffer_uninit(ma_audio_buffer *) {}
-inline ma_result ma_sound_init_from_data_source(ma_engine *, ma_audio_buffer *, int, void *,
+// Sounds the stub engine mixes. Like miniaudio's node graph, uninit waits
+// for a mix in progress to finish.
+inline std::mutex g_ma_sounds_mutex;
+inline std::vector<ma_sound *> g_ma_sounds;
+inline ma_result ma_sound_init_from_data_source(ma_engine *engine, void *source, int, void *,
                                                 ma_sound *s) {
-  s->playing = false;
+  std::lock_guard<std::mutex> lock(g_ma_sounds_mutex);
+  std::atomic_ref<bool>(s->playing).store(false);
+  s->volume = 1.0f;
+  s->engine = engine;
+  s->source = source;
+  g_ma_sounds.push_back(s);
   return MA_SUCCESS;
 }
-inline void ma_sound_uninit(ma_sound *) {}
-inline bool ma_sound_is_playing(const ma_sound *s) { return s->playing; }
+inline void ma_sound_uninit(ma_sound *s) {
+  std::lock_guard<std::mutex> lock(g_ma_sounds_mutex);
+  std::erase(g_ma_sounds, s);
+}
+inline bool ma_sound_is_playing(const ma_sound *s) {
+  return std::atomic_ref<bool>(const_cast<bool &>(s->playing)).load();
+}
 extern int g_stop_calls;
 extern int g_start_calls;
 inline void ma_sound_stop(ma_sound *s) {
-  s->playing = false;
+  std::atomic_ref<bool>(s->playing).store(false);
   ++g_stop_calls;
 }
 inline void ma_sound_seek_to_pcm_frame(ma_sound *, ma_uint64) {}
 inline void ma_sound_start(ma_sound *s) {
-  s->playing = true;
+  std::atomic_ref<bool>(s->playing).store(true);
   ++g_start_calls;
 }
-inline void ma_sound_set_volume(ma_sound *, float) {}
+inline void ma_sound_set_volume(ma_sound *s, float volume) { s->volume = volume; }
+inline void ma_sound_set_fade_in_milliseconds(ma_sound *s, float, float, ma_uint64) { ++s->fades; }
+inline ma_result ma_sound_group_init(ma_engine *, ma_uint32, ma_sound_group *, ma_sound_group *) {
+  return MA_SUCCESS;
+}
+inline void ma_sound_group_uninit(ma_sound_group *) {}
+
+typedef void ma_node;
+struct ma_node_graph {};
+struct ma_node_base {};
+struct ma_node_vtable {
+  void (*onProcess)(ma_node *, const float **, ma_uint32 *, float **, ma_uint32 *);
+  ma_result (*onGetRequiredInputFrameCount)(ma_node *, ma_uint32, ma_uint32 *);
+  std::uint8_t inputBusCount;
+  std::uint8_t outputBusCount;
+  ma_uint32 flags;
+};
+struct ma_node_config {
+  const ma_node_vtable *vtable = nullptr;
+  const ma_uint32 *pInputChannels = nullptr;
+  const ma_uint32 *pOutputChannels = nullptr;
+};
+inline ma_node_config ma_node_config_init() { return {}; }
+inline ma_result ma_node_init(ma_node_graph *, const ma_node_config *, void *, ma_node *) {
+  return MA_SUCCESS;
+}
+inline void ma_node_uninit(ma_node *, void *) {}
+inline ma_result ma_node_attach_output_bus(ma_node *, ma_uint32, ma_node *, ma_uint32) {
+  return MA_SUCCESS;
+}
+inline ma_node_graph *ma_engine_get_node_graph(ma_engine *) {
+  static ma_node_graph graph;
+  return &graph;
+}
+inline ma_node *ma_engine_get_endpoint(ma_engine *) {
+  static ma_node_base endpoint;
+  return &endpoint;
+}
+
+struct ma_data_source_vtable {
+  ma_result (*onRead)(ma_data_source *, void *, ma_uint64, ma_uint64 *);
+  ma_result (*onSeek)(ma_data_source *, ma_uint64);
+  ma_result (*onGetDataFormat)(ma_data_source *, ma_format *, ma_uint32 *, ma_uint32 *,
+                               ma_channel *, size_t);
+  ma_result (*onGetCursor)(ma_data_source *, ma_uint64 *);
+  ma_result (*onGetLength)(ma_data_source *, ma_uint64 *);
+  ma_result (*onSetLooping)(ma_data_source *, ma_bool32);
+  ma_uint32 flags;
+};
+struct ma_data_source_base {
+  const ma_data_source_vtable *vtable = nullptr;
+};
+struct ma_data_source_config {
+  const ma_data_source_vtable *vtable = nullptr;
+};
+inline ma_data_source_config ma_data_source_config_init() { return {}; }
+inline ma_result ma_data_source_init(const ma_data_source_config *config,
+                                     ma_data_source *ds) {
+  static_cast<ma_data_source_base *>(ds)->vtable = config->vtable;
+  return MA_SUCCESS;
+}
+inline void ma_data_source_uninit(ma_data_source *) {}
+
+// Single-producer/single-consumer ring, enough for the streaming tests.
+struct ma_pcm_rb {
+  std::vector<float> data;
+  ma_uint32 channels = 0;
+  ma_uint32 capacity = 0;
+  std::atomic<ma_uint64> head{0};
+  std::atomic<ma_uint64> tail{0};
+};
+inline ma_result ma_pcm_rb_init(ma_format, ma_uint32 channels, ma_uint32 frames, void *, void *,
+                                ma_pcm_rb *rb) {
+  rb->channels = channels;
+  rb->capacity = frames;
+  rb->data.assign(std::size_t(frames) * channels, 0.0f);
+  return MA_SUCCESS;
+}
+inline void ma_pcm_rb_uninit(ma_pcm_rb *) {}
+inline ma_uint32 ma_pcm_rb_available_read(ma_pcm_rb *rb) {
+  return static_cast<ma_uint32>(rb->head.load() - rb->tail.load());
+}
+inline ma_uint32 ma_pcm_rb_available_write(ma_pcm_rb *rb) {
+  return rb->capacity - ma_pcm_rb_available_read(rb);
+}
+inline ma_result ma_pcm_rb_acquire_read(ma_pcm_rb *rb, ma_uint32 *frames, void **buffer) {
+  ma_uint32 offset = static_cast<ma_uint32>(rb->tail.load() % rb->capacity);
+  ma_uint32 n = ma_pcm_rb_available_read(rb);
+  n = n < rb->capacity - offset ? n : rb->capacity - offset;
+  *frames = *frames < n ? *frames : n;
+  *buffer = rb->data.data() + std::size_t(offset) * rb->channels;
+  return MA_SUCCESS;
+}
+inline ma_result ma_pcm_rb_commit_read(ma_pcm_rb *rb, ma_uint32 frames) {
+  rb->tail += frames;
+  return MA_SUCCESS;
+}
+inline ma_result ma_pcm_rb_seek_read(ma_pcm_rb *rb, ma_uint32 frames) {
+  rb->tail += frames;
+  return MA_SUCCESS;
+}
+inline ma_result ma_pcm_rb_acquire_write(ma_pcm_rb *rb, ma_uint32 *frames, void **buffer) {
+  ma_uint32 offset = static_cast<ma_uint32>(rb->head.load() % rb->capacity);
+  ma_uint32 n = ma_pcm_rb_available_write(rb);
+  n = n < rb->capacity - offset ? n : rb->capacity - offset;
+  *frames = *frames < n ? *frames : n;
+  *buffer = rb->data.data() + std::size_t(offset) * rb->channels;
+  return MA_SUCCESS;
+}
+inline ma_result ma_pcm_rb_commit_write(ma_pcm_rb *rb, ma_uint32 frames) {
+  rb->head += frames;
+  return MA_SUCCESS;
+}
+inline ma_result ma_data_source_read_pcm_frames(ma_data_source *ds, void *out, ma_uint64 frames,
+                                                ma_uint64 *read) {
+  return static_cast<ma_data_source_base *>(ds)->vtable->onRead(ds, out, frames, read);
+}
+inline ma_result ma_data_source_seek_to_pcm_frame(ma_data_source *ds, ma_uint64 frame) {
+  return static_cast<ma_data_source_base *>(ds)->vtable->onSeek(ds, frame);
+}
+
+inline void ma_stub_mix(ma_engine *engine, ma_uint64 frames) {
+  thread_local std::vector<float> scratch;
+  scratch.resize(std::size_t(frames) * 8);
+  std::lock_guard<std::mutex> lock(g_ma_sounds_mutex);
+  for (ma_sound *s : g_ma_sounds) {
+    if (s->engine != engine || s->source == nullptr || !ma_sound_is_playing(s)) {
+      continue;
+    }
+    ma_uint64 read = 0;
+    if (ma_data_source_read_pcm_frames(s->source, scratch.data(), frames, &read) == MA_AT_END) {
+      std::atomic_ref<bool>(s->playing).store(false);
+    }
+  }
+}
+
+inline ma_uint32 ma_engine_get_channels(const ma_engine *engine) { return engine->channels; }
+inline ma_uint32 ma_engine_get_sample_rate(const ma_engine *engine) { return engine->sampleRate; }
+
+// Nearest-neighbour stand-in for miniaudio's converter: enough to check the
+// shape of what comes out.
+inline constexpr ma_format ma_format_s16 = 2;
+inline constexpr ma_uint32 MA_MAX_FILTER_ORDER = 8;
+enum ma_resample_algorithm { ma_resample_algorithm_linear = 0 };
+struct ma_data_converter_config {
+  ma_format formatIn;
+  ma_format formatOut;
+  ma_uint32 channelsIn;
+  ma_uint32 channelsOut;
+  ma_uint32 sampleRateIn;
+  ma_uint32 sampleRateOut;
+  struct {
+    ma_resample_algorithm algorithm;
+    struct {
+      ma_uint32 lpfOrder;
+    } linear;
+  } resampling;
+};
+struct ma_data_converter {
+  ma_data_converter_config config;
+  ma_uint64 inPos;
+  ma_uint64 outPos;
+};
+inline ma_data_converter_config ma_data_converter_config_init(ma_format in, ma_format out,
+                                                              ma_uint32 channelsIn,
+                                                              ma_uint32 channelsOut,
+                                                              ma_uint32 rateIn, ma_uint32 rateOut) {
+  return {in, out, channelsIn, channelsOut, rateIn, rateOut, {}};
+}
+inline ma_result ma_data_converter_init(const ma_data_converter_config *config, void *,
+                                        ma_data_converter *conv) {
+  *conv = {*config, 0, 0};
+  return MA_SUCCESS;
+}
+inline void ma_data_converter_uninit(ma_data_converter *, void *) {}
+inline ma_uint64 ma_data_converter_get_input_latency(const ma_data_converter *) { return 0; }
+inline ma_uint64 ma_data_converter_get_output_latency(const ma_data_converter *) { return 0; }
+inline ma_result ma_data_converter_get_expected_output_frame_count(const ma_data_converter *conv,
+                                                                   ma_uint64 in, ma_uint64 *out) {
+  *out = in * conv->config.sampleRateOut / conv->config.sampleRateIn;
+  return MA_SUCCESS;
+}
+inline ma_result ma_data_converter_process_pcm_frames(ma_data_converter *conv, const void *in,
+                                                      ma_uint64 *inFrames, void *out,
+                                                      ma_uint64 *outFrames) {
+  const auto &c = conv->config;
+  std::size_t width = c.formatIn == ma_format_s16 ? 2 : 4;
+  ma_uint64 written = 0;
+  ma_uint64 consumedEnd = conv->inPos + *inFrames;
+  while (written < *outFrames) {
+    ma_uint64 src = (conv->outPos * c.sampleRateIn) / c.sampleRateOut;
+    if (src >= consumedEnd) {
+      break;
+    }
+    for (ma_uint32 ch = 0; ch < c.channelsOut; ++ch) {
+      ma_uint32 from = ch < c.channelsIn ? ch : c.channelsIn - 1;
+      const auto *s = static_cast<const unsigned char *>(in) +
+                      ((src - conv->inPos) * c.channelsIn + from) * width;
+      auto *d = static_cast<unsigned char *>(out) + (written * c.channelsOut + ch) * width;
+      for (std::size_t b = 0; b < width; ++b) {
+        d[b] = s[b];
+      }
+    }
+    ++written;
+    ++conv->outPos;
+  }
+  ma_uint64 next = (conv->outPos * c.sampleRateIn) / c.sampleRateOut;
+  ma_uint64 consumed = next < consumedEnd ? next : consumedEnd;
+  *inFrames = consumed - conv->inPos;
+  conv->inPos = consumed;
+  *outFrames = written;
+  return MA_SUCCESS;
+}
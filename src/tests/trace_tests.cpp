@@ -0,0 +1,75 @@
+#include "util/trace.h"
+#include <algorithm>
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+TEST_CASE("trace session writes zones per thread", "[trace]") {
+  auto path = std::filesystem::temp_directory_path() / "lizard_trace_test.json";
+  std::filesystem::remove(path);
+
+  REQUIRE(lizard::util::trace::begin_session(path));
+  REQUIRE_FALSE(lizard::util::trace::begin_session(path));
+  {
+    LIZARD_TRACE_THREAD("main");
+    LIZARD_TRACE_ZONE("outer");
+    std::thread worker([] {
+      LIZARD_TRACE_THREAD("worker");
+      LIZARD_TRACE_ZONE("inner");
+    });
+    worker.join();
+  }
+  lizard::util::trace::end_session();
+
+  std::ifstream in(path);
+  REQUIRE(in.is_open());
+  std::stringstream ss;
+  ss << in.rdbuf();
+  auto text = ss.str();
+  REQUIRE(text.find("\"traceEvents\"") != std::string::npos);
+  REQUIRE(text.find("\"name\":\"outer\",\"ph\":\"X\"") != std::string::npos);
+  REQUIRE(text.find("\"name\":\"inner\",\"ph\":\"X\"") != std::string::npos);
+  REQUIRE(text.find("\"args\":{\"name\":\"worker\"}") != std::string::npos);
+  in.close();
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("zones outside a session are not recorded", "[trace]") {
+  auto path = std::filesystem::temp_directory_path() / "lizard_trace_idle.json";
+  {
+    LIZARD_TRACE_ZONE("before");
+  }
+  REQUIRE(lizard::util::trace::begin_session(path));
+  lizard::util::trace::end_session();
+
+  std::ifstream in(path);
+  std::stringstream ss;
+  ss << in.rdbuf();
+  REQUIRE(ss.str().find("before") == std::string::npos);
+  in.close();
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("trace names are escaped as JSON strings", "[trace]") {
+  auto path = std::filesystem::temp_directory_path() / "lizard_trace_escape.json";
+  REQUIRE(lizard::util::trace::begin_session(path));
+  {
+    LIZARD_TRACE_THREAD("tab\there");
+    LIZARD_TRACE_ZONE("say \"hi\"\\\nbell\a");
+  }
+  lizard::util::trace::end_session();
+
+  std::ifstream in(path);
+  std::stringstream ss;
+  ss << in.rdbuf();
+  auto text = ss.str();
+  REQUIRE(text.find("\"name\":\"say \\\"hi\\\"\\\\\\nbell\\u0007\"") != std::string::npos);
+  REQUIRE(text.find("\"args\":{\"name\":\"tab\\there\"}") != std::string::npos);
+  REQUIRE(std::none_of(text.begin(), text.end(), [](char c) {
+    return static_cast<unsigned char>(c) < 0x20 && c != '\n';
+  }));
+  in.close();
+  std::filesystem::remove(path);
+}
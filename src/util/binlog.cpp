@@ -0,0 +1,173 @@
+#include "binlog.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+#include "trace.h"
+
+namespace lizard::util::binlog {
+
+namespace {
+
+// 64 KiB per thread that logs; a burst larger than this between drains is
+// dropped rather than blocking the caller.
+constexpr std::uint32_t kRecordsPerThread = 1024;
+constexpr std::chrono::milliseconds kDrainInterval{10};
+
+struct alignas(64) Record {
+  const Site *site;
+  Render render;
+  spdlog::log_clock::time_point time;
+  std::byte args[kArgBytes];
+};
+static_assert(sizeof(Record) == 64, "a record should fill one cache line");
+
+// Single producer (the owning thread), single consumer (whoever holds
+// g_drain_mutex).
+struct Ring {
+  std::array<Record, kRecordsPerThread> records;
+  alignas(64) std::atomic<std::uint32_t> head{0};
+  alignas(64) std::atomic<std::uint32_t> tail{0};
+  std::atomic<std::uint64_t> dropped{0};
+  std::atomic<bool> orphaned{false};
+};
+
+std::mutex g_registry_mutex;
+std::vector<std::shared_ptr<Ring>> g_rings;
+std::mutex g_drain_mutex;
+
+// Marks the ring for removal once it has been drained.
+struct Owner {
+  std::shared_ptr<Ring> ring;
+  ~Owner() {
+    if (ring) {
+      ring->orphaned.store(true, std::memory_order_release);
+    }
+  }
+};
+
+thread_local Owner t_owner;
+
+void drain() {
+  std::lock_guard<std::mutex> drain_lock(g_drain_mutex);
+  std::vector<std::shared_ptr<Ring>> rings;
+  {
+    std::lock_guard<std::mutex> lock(g_registry_mutex);
+    rings = g_rings;
+  }
+  auto logger = spdlog::default_logger();
+  if (!logger) {
+    return; // after spdlog::shutdown()
+  }
+  spdlog::memory_buf_t text;
+  std::uint64_t dropped = 0;
+  for (auto &ring : rings) {
+    bool orphaned = ring->orphaned.load(std::memory_order_acquire);
+    auto tail = ring->tail.load(std::memory_order_relaxed);
+    auto head = ring->head.load(std::memory_order_acquire);
+    for (; tail != head; ++tail) {
+      const auto &record = ring->records[tail % kRecordsPerThread];
+      text.clear();
+      try {
+        record.render(record.site->format, record.args, text);
+      } catch (const std::exception &e) {
+        text.clear();
+        fmt::format_to(fmt::appender(text), "Bad binlog format \"{}\": {}", record.site->format,
+                       e.what());
+      }
+      logger->log(record.time, spdlog::source_loc{}, record.site->level,
+                  spdlog::string_view_t(text.data(), text.size()));
+    }
+    ring->tail.store(tail, std::memory_order_release);
+    dropped += ring->dropped.exchange(0, std::memory_order_relaxed);
+    if (orphaned) {
+      std::lock_guard<std::mutex> lock(g_registry_mutex);
+      std::erase(g_rings, ring);
+    }
+  }
+  if (dropped > 0) {
+    logger->warn("Binary log ring full; dropped {} records", dropped);
+  }
+}
+
+class Drainer {
+public:
+  Drainer() : thread_([this](std::stop_token st) { run(st); }) {}
+  ~Drainer() {
+    thread_.request_stop();
+    thread_.join();
+    drain();
+  }
+
+private:
+  void run(std::stop_token st) {
+    LIZARD_TRACE_THREAD("binlog");
+    std::mutex mutex;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!st.stop_requested()) {
+      wake_.wait_for(lock, st, kDrainInterval, [] { return false; });
+      drain();
+    }
+  }
+
+  std::condition_variable_any wake_;
+  std::jthread thread_;
+};
+
+Drainer &drainer() {
+  static Drainer instance;
+  return instance;
+}
+
+Ring &local_ring() {
+  if (!t_owner.ring) {
+    drainer();
+    auto ring = std::make_shared<Ring>();
+    std::lock_guard<std::mutex> lock(g_registry_mutex);
+    g_rings.push_back(ring);
+    t_owner.ring = std::move(ring);
+  }
+  return *t_owner.ring;
+}
+
+} // namespace
+
+void flush() {
+  drain();
+  spdlog::default_logger()->flush();
+}
+
+void register_thread() { local_ring(); }
+
+namespace detail {
+
+std::byte *reserve(const Site &site, Render render) {
+  auto &ring = local_ring();
+  auto head = ring.head.load(std::memory_order_relaxed);
+  if (head - ring.tail.load(std::memory_order_acquire) >= kRecordsPerThread) {
+    ring.dropped.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+  }
+  auto &record = ring.records[head % kRecordsPerThread];
+  record.site = &site;
+  record.render = render;
+  record.time = spdlog::log_clock::now();
+  return record.args;
+}
+
+void commit() {
+  auto &ring = *t_owner.ring;
+  ring.head.store(ring.head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+} // namespace detail
+
+} // namespace lizard::util::binlog
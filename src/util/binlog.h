@@ -0,0 +1,169 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+
+#include <spdlog/spdlog.h>
+
+namespace lizard::util::binlog {
+
+// Deferred-formatting log for hot paths such as the keyboard hook and the
+// trigger path. A call copies a pointer to its Site, a timestamp and the raw
+// argument bytes into a fixed-size record in a lock-free ring owned by the
+// calling thread. A background thread drains every ring, formats the records
+// and hands them to the default spdlog logger, whose sinks write and rotate
+// the file. The caller never formats, allocates or takes a lock.
+//
+// Arguments may be arithmetic, enums (logged as their value), pointers or
+// anything convertible to std::string_view; strings are copied and cut to
+// fit the record. When a ring is full, records are dropped and counted.
+
+// Bytes available for arguments in one record.
+inline constexpr std::size_t kArgBytes = 40;
+
+using Render = void (*)(std::string_view format, const std::byte *args,
+                        spdlog::memory_buf_t &out);
+
+// The constant part of a log statement, one per call site; its address is
+// the record's format id.
+struct Site {
+  spdlog::level::level_enum level;
+  std::string_view format;
+};
+
+// Formats and writes everything recorded so far, from any thread, before
+// returning.
+void flush();
+
+// Sets up the calling thread's ring. The first record on a thread would
+// otherwise allocate it and take a lock, so hot threads call this before
+// their first event.
+void register_thread();
+
+namespace detail {
+
+template <typename T> auto stored() {
+  using D = std::decay_t<T>;
+  if constexpr (std::is_convertible_v<const D &, std::string_view>) {
+    return std::string_view{};
+  } else if constexpr (std::is_enum_v<D>) {
+    return std::underlying_type_t<D>{};
+  } else if constexpr (std::is_arithmetic_v<D>) {
+    return D{};
+  } else {
+    static_assert(std::is_pointer_v<D>, "binlog arguments must be numbers, strings or pointers");
+    return static_cast<const void *>(nullptr);
+  }
+}
+
+// What an argument of type T is recorded as.
+template <typename T> using Stored = decltype(stored<T>());
+
+// Bytes an argument takes at least; a string takes its length byte.
+template <typename T> constexpr std::size_t min_size() {
+  return std::is_same_v<Stored<T>, std::string_view> ? 1 : sizeof(Stored<T>);
+}
+
+class Writer {
+public:
+  // `reserved` is the sum of min_size() over the arguments to come.
+  Writer(std::byte *out, std::size_t reserved) : out_(out), reserved_(reserved) {}
+
+  template <typename T> void put(const T &value) {
+    using S = Stored<T>;
+    reserved_ -= min_size<T>();
+    if constexpr (std::is_same_v<S, std::string_view>) {
+      // Leave room for the arguments after this one.
+      std::string_view text = value;
+      auto n = std::min({text.size(), kArgBytes - reserved_ - used_ - 1, std::size_t{255}});
+      out_[used_++] = static_cast<std::byte>(n);
+      std::memcpy(out_ + used_, text.data(), n);
+      used_ += n;
+    } else {
+      auto stored = static_cast<S>(value);
+      std::memcpy(out_ + used_, &stored, sizeof(S));
+      used_ += sizeof(S);
+    }
+  }
+
+private:
+  std::byte *out_;
+  std::size_t reserved_;
+  std::size_t used_ = 0;
+};
+
+class Reader {
+public:
+  explicit Reader(const std::byte *in) : in_(in) {}
+
+  template <typename S> S get() {
+    if constexpr (std::is_same_v<S, std::string_view>) {
+      auto n = static_cast<std::size_t>(in_[used_++]);
+      std::string_view text(reinterpret_cast<const char *>(in_ + used_), n);
+      used_ += n;
+      return text;
+    } else {
+      S value;
+      std::memcpy(&value, in_ + used_, sizeof(S));
+      used_ += sizeof(S);
+      return value;
+    }
+  }
+
+private:
+  const std::byte *in_;
+  std::size_t used_ = 0;
+};
+
+template <typename... S>
+void render(std::string_view format, const std::byte *args, spdlog::memory_buf_t &out) {
+  Reader reader(args);
+  // Braced initialisation reads the arguments in order.
+  std::tuple<S...> values{reader.template get<S>()...};
+  std::apply(
+      [&](auto &...v) {
+        fmt::vformat_to(fmt::appender(out), fmt::string_view(format.data(), format.size()),
+                        fmt::make_format_args(v...));
+      },
+      values);
+}
+
+// The calling thread's ring; nullptr if full. commit() publishes the record.
+std::byte *reserve(const Site &site, Render render);
+void commit();
+
+} // namespace detail
+
+template <typename... Args> void log(const Site &site, const Args &...args) {
+  constexpr std::size_t reserved = (detail::min_size<Args>() + ... + 0);
+  static_assert(reserved <= kArgBytes, "too many binlog arguments for one record");
+  auto *logger = spdlog::default_logger_raw();
+  if (logger == nullptr || !logger->should_log(site.level)) {
+    return;
+  }
+  auto *out = detail::reserve(site, &detail::render<detail::Stored<Args>...>);
+  if (out == nullptr) {
+    return;
+  }
+  detail::Writer writer(out, reserved);
+  (writer.put(args), ...);
+  detail::commit();
+}
+
+} // namespace lizard::util::binlog
+
+// `format` must be a string literal, checked when the record is formatted.
+#define LIZARD_LOG(level, format, ...)                                                             \
+  do {                                                                                             \
+    static constexpr ::lizard::util::binlog::Site lizard_log_site{level, format};                  \
+    ::lizard::util::binlog::log(lizard_log_site __VA_OPT__(, ) __VA_ARGS__);                       \
+  } while (false)
+#define LIZARD_LOG_TRACE(...) LIZARD_LOG(::spdlog::level::trace, __VA_ARGS__)
+#define LIZARD_LOG_DEBUG(...) LIZARD_LOG(::spdlog::level::debug, __VA_ARGS__)
+#define LIZARD_LOG_INFO(...) LIZARD_LOG(::spdlog::level::info, __VA_ARGS__)
+#define LIZARD_LOG_WARN(...) LIZARD_LOG(::spdlog::level::warn, __VA_ARGS__)
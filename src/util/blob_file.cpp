@@ -0,0 +1,81 @@
+#include "blob_file.h"
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <system_error>
+
+#include <spdlog/spdlog.h>
+
+namespace lizard::util {
+
+namespace {
+
+struct Header {
+  char magic[4];
+  std::uint32_t version;
+  std::uint64_t key;
+  std::uint64_t size;
+  std::uint64_t payload_hash;
+};
+
+} // namespace
+
+std::uint64_t fnv1a(std::string_view bytes, std::uint64_t hash) {
+  for (unsigned char c : bytes) {
+    hash = (hash ^ c) * 1099511628211ull;
+  }
+  return hash;
+}
+
+std::optional<std::string> read_blob(const std::filesystem::path &path, const BlobTag &tag) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in.is_open()) {
+    return std::nullopt;
+  }
+  std::string bytes{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+  Header header{};
+  if (bytes.size() < sizeof(header)) {
+    return std::nullopt;
+  }
+  std::memcpy(&header, bytes.data(), sizeof(header));
+  std::string_view payload(bytes.data() + sizeof(header), bytes.size() - sizeof(header));
+  if (std::memcmp(header.magic, tag.magic.data(), sizeof(header.magic)) != 0 ||
+      header.version != tag.version || header.key != tag.key || header.size != payload.size() ||
+      header.payload_hash != fnv1a(payload)) {
+    return std::nullopt;
+  }
+  return std::string(payload);
+}
+
+bool write_blob(const std::filesystem::path &path, const BlobTag &tag, std::string_view payload) {
+  Header header{};
+  std::memcpy(header.magic, tag.magic.data(), sizeof(header.magic));
+  header.version = tag.version;
+  header.key = tag.key;
+  header.size = payload.size();
+  header.payload_hash = fnv1a(payload);
+
+  std::error_code ec;
+  std::filesystem::create_directories(path.parent_path(), ec);
+  auto temp = path;
+  temp += ".tmp";
+  {
+    std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+    if (!out) {
+      spdlog::debug("Could not write {}", temp.string());
+      return false;
+    }
+  }
+  std::filesystem::rename(temp, path, ec);
+  if (ec) {
+    spdlog::debug("Could not replace {}: {}", path.string(), ec.message());
+    std::filesystem::remove(temp, ec);
+    return false;
+  }
+  return true;
+}
+
+} // namespace lizard::util
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace lizard::util {
+
+// 64-bit FNV-1a. Pass a previous result as `hash` to extend it.
+std::uint64_t fnv1a(std::string_view bytes, std::uint64_t hash = 14695981039346656037ull);
+
+// What a blob file must carry to be read back: the file type, the layout
+// version and a key for the inputs the payload was built from.
+struct BlobTag {
+  std::array<char, 4> magic;
+  std::uint32_t version = 0;
+  std::uint64_t key = 0;
+};
+
+// Caches that are only a startup shortcut, such as the config snapshot and
+// saved GL programs, are stored as a header and a payload. A file with a
+// different tag, or a payload that is cut short or does not hash as recorded,
+// reads as nullopt and the caller rebuilds it.
+std::optional<std::string> read_blob(const std::filesystem::path &path, const BlobTag &tag);
+// Written to a temporary and renamed, so a reader never sees half a file.
+// Failures are logged at debug level.
+bool write_blob(const std::filesystem::path &path, const BlobTag &tag, std::string_view payload);
+
+} // namespace lizard::util
@@ -1,20 +1,127 @@
 #include "log.h"
 
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+
 #include <spdlog/async.h>
 #include <spdlog/sinks/rotating_file_sink.h>
+#include <spdlog/sinks/stdout_sinks.h>
 #include <spdlog/spdlog.h>
 
+#include "trace.h"
+
 namespace lizard::util {
 
+namespace {
+
+// How long a swap waits for the old queue to empty.
+constexpr auto kDrainTimeout = std::chrono::seconds(2);
+
+// The installed logger, its sink and its pool are owned by spdlog's registry,
+// as spdlog's own factories leave them, so spdlog::shutdown() still joins the
+// workers and closes the file.
+struct Pipeline {
+  std::size_t queue_size = 0;
+  std::size_t worker_count = 0;
+  OverflowPolicy overflow = OverflowPolicy::block;
+  std::filesystem::path path;
+  std::weak_ptr<spdlog::details::thread_pool> pool;
+  std::weak_ptr<spdlog::sinks::sink> sink;
+  std::weak_ptr<spdlog::async_logger> logger;
+};
+
+std::mutex g_mutex;
+Pipeline g_current;
+// What the last swap replaced. Threads that fetched the raw default logger
+// just before the swap may still be posting to it.
+std::shared_ptr<spdlog::async_logger> g_retired_logger;
+std::shared_ptr<spdlog::details::thread_pool> g_retired_pool;
+
+// Whether g_current is still installed; spdlog::shutdown() tears it down.
+bool live() {
+  auto logger = g_current.logger.lock();
+  return logger && spdlog::get("lizard") == logger &&
+         spdlog::thread_pool() == g_current.pool.lock();
+}
+
+spdlog::sink_ptr open_sink(const std::filesystem::path &path) {
+  try {
+    return std::make_shared<spdlog::sinks::rotating_file_sink_mt>(path.string(), 1024 * 1024 * 5,
+                                                                  3);
+  } catch (const spdlog::spdlog_ex &e) {
+    if (!g_current.sink.expired()) {
+      spdlog::error("Could not open log file {}: {}; keeping {}", path.string(), e.what(),
+                    g_current.path.string());
+      return nullptr;
+    }
+    spdlog::error("Could not open log file {}: {}; logging to stderr", path.string(), e.what());
+    return std::make_shared<spdlog::sinks::stderr_sink_mt>();
+  }
+}
+
+// Waits, for a bounded time, until `pool` has written what was queued, then
+// flushes the file.
+void drain(spdlog::details::thread_pool &pool, spdlog::sinks::sink &sink) {
+  auto deadline = std::chrono::steady_clock::now() + kDrainTimeout;
+  while (pool.queue_size() > 0 && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  sink.flush();
+}
+
+} // namespace
+
 void init_logging(std::string_view level, std::size_t queue_size, std::size_t worker_count,
-                  std::optional<std::filesystem::path> file_path) {
-  auto logger = spdlog::get("lizard");
-  if (!logger) {
-    spdlog::init_thread_pool(queue_size, worker_count);
-    auto path = file_path.value_or("lizard.log");
-    logger = spdlog::rotating_logger_mt<spdlog::async_factory>("lizard", path.string(),
-                                                               1024 * 1024 * 5, 3);
+                  std::optional<std::filesystem::path> file_path, OverflowPolicy overflow) {
+  std::lock_guard<std::mutex> lock(g_mutex);
+  queue_size = std::max<std::size_t>(queue_size, 1);
+  worker_count = std::max<std::size_t>(worker_count, 1);
+  auto path = file_path.value_or("lizard.log");
+  if (!live()) {
+    g_current = {};
   }
+
+  auto old_logger = g_current.logger.lock();
+  auto old_pool = g_current.pool.lock();
+  auto old_sink = g_current.sink.lock();
+  auto sink = old_sink;
+  if (!sink || path != g_current.path) {
+    if (auto opened = open_sink(path)) {
+      sink = std::move(opened);
+      g_current.path = path;
+    }
+  }
+  auto pool = old_pool;
+  if (!pool || queue_size != g_current.queue_size || worker_count != g_current.worker_count) {
+    pool = std::make_shared<spdlog::details::thread_pool>(
+        queue_size, worker_count, [] { LIZARD_TRACE_THREAD("log_worker"); });
+    g_current.queue_size = queue_size;
+    g_current.worker_count = worker_count;
+  }
+  auto logger = old_logger;
+  if (!logger || pool != old_pool || sink != old_sink || overflow != g_current.overflow) {
+    logger = std::make_shared<spdlog::async_logger>(
+        "lizard", sink, pool,
+        overflow == OverflowPolicy::overrun_oldest ? spdlog::async_overflow_policy::overrun_oldest
+                                                   : spdlog::async_overflow_policy::block);
+    spdlog::drop("lizard");
+    spdlog::details::registry::instance().set_tp(pool);
+    spdlog::register_logger(logger);
+    spdlog::set_default_logger(logger);
+    if (old_logger) {
+      drain(*old_pool, *old_sink);
+    }
+    g_retired_logger = std::move(old_logger);
+    g_retired_pool = old_pool == pool ? nullptr : std::move(old_pool);
+    g_current.overflow = overflow;
+    g_current.pool = pool;
+    g_current.sink = sink;
+    g_current.logger = logger;
+  }
+
   spdlog::set_default_logger(logger);
   auto lvl = spdlog::level::from_str(std::string(level));
   if (lvl == spdlog::level::off && level != "off") {
@@ -7,7 +7,22 @@
 
 namespace lizard::util {
 
+// What a producer does when the async queue is full: wait for room, or
+// replace the oldest queued message.
+enum class OverflowPolicy { block, overrun_oldest };
+
+// Points the default logger at a rotating file behind an async queue. Safe
+// to call again with new settings, as every config load does:
+//
+// - the level is always applied;
+// - a new path swaps the file sink, and a new overflow policy the logger;
+// - a new queue size or worker count starts a new thread pool.
+//
+// A swap never blocks producers. Messages already queued on the old pipeline
+// are written to its file before this returns; the old pipeline is kept
+// until the next swap for callers still inside it.
 void init_logging(std::string_view level, std::size_t queue_size, std::size_t worker_count,
-                  std::optional<std::filesystem::path> file_path = std::nullopt);
+                  std::optional<std::filesystem::path> file_path = std::nullopt,
+                  OverflowPolicy overflow = OverflowPolicy::block);
 
 } // namespace lizard::util
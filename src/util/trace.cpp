@@ -0,0 +1,172 @@
+#include "trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+namespace lizard::util::trace {
+
+namespace {
+
+// Per-thread cap so a forgotten session cannot grow without bound.
+constexpr std::size_t kMaxEventsPerThread = 1u << 20;
+
+struct Event {
+  const char *name;
+  std::int64_t start_ns;
+  std::int64_t dur_ns;
+};
+
+struct ThreadBuffer {
+  std::mutex mutex; // uncontended except while a session is being written
+  std::vector<Event> events;
+  std::string name;
+  std::uint32_t tid = 0;
+  std::size_t dropped = 0;
+};
+
+std::mutex g_registry_mutex;
+std::vector<std::shared_ptr<ThreadBuffer>> g_buffers;
+std::atomic<std::uint32_t> g_next_tid{1};
+std::atomic<bool> g_active{false};
+std::filesystem::path g_path;
+std::chrono::steady_clock::time_point g_epoch;
+
+thread_local std::shared_ptr<ThreadBuffer> t_buffer;
+
+std::int64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+ThreadBuffer &local_buffer() {
+  if (!t_buffer) {
+    auto buffer = std::make_shared<ThreadBuffer>();
+    buffer->tid = g_next_tid.fetch_add(1, std::memory_order_relaxed);
+    buffer->events.reserve(4096);
+    std::lock_guard<std::mutex> lock(g_registry_mutex);
+    g_buffers.push_back(buffer);
+    t_buffer = std::move(buffer);
+  }
+  return *t_buffer;
+}
+
+// JSON string escaping; control characters would make the file unloadable.
+void write_escaped(std::ofstream &out, const std::string &s) {
+  constexpr char kHex[] = "0123456789abcdef";
+  for (char c : s) {
+    auto byte = static_cast<unsigned char>(c);
+    if (c == '"' || c == '\\') {
+      out << '\\' << c;
+    } else if (c == '\n') {
+      out << "\\n";
+    } else if (c == '\t') {
+      out << "\\t";
+    } else if (c == '\r') {
+      out << "\\r";
+    } else if (byte < 0x20) {
+      out << "\\u00" << kHex[byte >> 4] << kHex[byte & 0xF];
+    } else {
+      out << c;
+    }
+  }
+}
+
+} // namespace
+
+bool begin_session(const std::filesystem::path &path) {
+  std::lock_guard<std::mutex> lock(g_registry_mutex);
+  if (g_active.load(std::memory_order_relaxed)) {
+    return false;
+  }
+  for (auto &buffer : g_buffers) {
+    std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+    buffer->events.clear();
+    buffer->dropped = 0;
+  }
+  g_path = path;
+  g_epoch = std::chrono::steady_clock::now();
+  g_active.store(true, std::memory_order_release);
+  return true;
+}
+
+void end_session() {
+  std::lock_guard<std::mutex> lock(g_registry_mutex);
+  if (!g_active.exchange(false, std::memory_order_acq_rel)) {
+    return;
+  }
+  std::ofstream out(g_path, std::ios::trunc);
+  if (!out.is_open()) {
+    spdlog::error("Could not open trace file {}", g_path.string());
+    return;
+  }
+  const std::int64_t epoch_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                    g_epoch.time_since_epoch())
+                                    .count();
+  out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+  bool first = true;
+  auto separator = [&] {
+    if (!first) {
+      out << ",\n";
+    }
+    first = false;
+  };
+  std::size_t dropped = 0;
+  for (auto &buffer : g_buffers) {
+    std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+    if (!buffer->name.empty()) {
+      separator();
+      out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->tid
+          << ",\"args\":{\"name\":\"";
+      write_escaped(out, buffer->name);
+      out << "\"}}";
+    }
+    for (const auto &ev : buffer->events) {
+      separator();
+      out << "{\"name\":\"";
+      write_escaped(out, ev.name);
+      out << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid
+          << ",\"ts\":" << static_cast<double>(ev.start_ns - epoch_ns) / 1000.0
+          << ",\"dur\":" << static_cast<double>(ev.dur_ns) / 1000.0 << "}";
+    }
+    dropped += buffer->dropped;
+    buffer->events.clear();
+    buffer->events.shrink_to_fit();
+  }
+  out << "]}\n";
+  if (dropped > 0) {
+    spdlog::warn("Trace buffer full; dropped {} events", dropped);
+  }
+}
+
+void set_thread_name(const char *name) {
+  auto &buffer = local_buffer();
+  std::lock_guard<std::mutex> lock(buffer.mutex);
+  buffer.name = name;
+}
+
+Zone::Zone(const char *name) noexcept
+    : name_(name), start_ns_(g_active.load(std::memory_order_relaxed) ? now_ns() : 0) {}
+
+Zone::~Zone() {
+  if (start_ns_ == 0 || !g_active.load(std::memory_order_acquire)) {
+    return;
+  }
+  std::int64_t end = now_ns();
+  auto &buffer = local_buffer();
+  std::lock_guard<std::mutex> lock(buffer.mutex);
+  if (buffer.events.size() >= kMaxEventsPerThread) {
+    ++buffer.dropped;
+    return;
+  }
+  buffer.events.push_back(Event{name_, start_ns_, end - start_ns_});
+}
+
+} // namespace lizard::util::trace
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+
+namespace lizard::util::trace {
+
+// Starts collecting trace zones from every thread. The collected events are
+// written to `path` as Chrome trace-event JSON (loadable in Perfetto or
+// chrome://tracing) when end_session() is called. Returns false if a session
+// is already active.
+bool begin_session(const std::filesystem::path &path);
+
+// Stops collecting and writes the trace file. Safe to call without a session.
+void end_session();
+
+// Labels the calling thread in the trace output.
+void set_thread_name(const char *name);
+
+// Records the lifetime of a scope as a complete ("X") event. `name` must be a
+// string literal or otherwise outlive the session.
+class Zone {
+public:
+  explicit Zone(const char *name) noexcept;
+  ~Zone();
+  Zone(const Zone &) = delete;
+  Zone &operator=(const Zone &) = delete;
+
+private:
+  const char *name_;
+  std::int64_t start_ns_;
+};
+
+} // namespace lizard::util::trace
+
+// Zones compile to nothing unless the build enables LIZARD_TRACE.
+#ifdef LIZARD_TRACE
+#define LIZARD_TRACE_CONCAT_INNER(a, b) a##b
+#define LIZARD_TRACE_CONCAT(a, b) LIZARD_TRACE_CONCAT_INNER(a, b)
+#define LIZARD_TRACE_ZONE(name)                                                                    \
+  ::lizard::util::trace::Zone LIZARD_TRACE_CONCAT(lizard_trace_zone_, __LINE__)(name)
+#define LIZARD_TRACE_THREAD(name) ::lizard::util::trace::set_thread_name(name)
+#else
+#define LIZARD_TRACE_ZONE(name) static_cast<void>(0)
+#define LIZARD_TRACE_THREAD(name) static_cast<void>(0)
+#endif